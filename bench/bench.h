@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bonsai/stats.h"
+
+/* Longest any phase of the client waits on the compositor. */
+#define BSI_BENCH_PHASE_TIMEOUT_MS 10000
+/* The damage check commits this many 1x1 damages, none of the frames they
+ * make may damage more pixels than the limit. */
+#define BSI_BENCH_DAMAGE_FRAMES 10
+#define BSI_BENCH_DAMAGE_MAX_PX 64
+/* Quiet time before the damage check, so earlier changes are composed. */
+#define BSI_BENCH_DAMAGE_SETTLE_MS 200
+
+/* Written by the client process to the compositor process as phases begin. */
+enum bsi_bench_mark
+{
+    BSI_BENCH_MARK_QUIET = 'q',  /* Stop switching workspaces. */
+    BSI_BENCH_MARK_DAMAGE = 'd', /* Measure the damage of every frame. */
+};
+
+struct bsi_bench_options
+{
+    size_t outputs;       /* Headless outputs. */
+    size_t clients;       /* xdg-shell toplevels. */
+    size_t layers;        /* layer-shell surfaces, spread over the outputs. */
+    size_t workspaces;    /* Workspaces per output. */
+    uint32_t switch_ms;   /* Workspace switch interval, 0 to never switch. */
+    uint32_t toggles;     /* Maximize round trips per toplevel. */
+    uint32_t duration_ms; /* Length of the steady state phase. */
+    uint32_t launches;    /* Programs to launch instead, 0 for the clients. */
+    size_t mapped_mb;     /* Memory the compositor holds while launching. */
+    uint32_t power_off_s; /* Idle output power-off, 0 to keep them on. */
+    const char* json_path;
+};
+
+/**
+ * @brief What the client process reports back to the compositor process.
+ *
+ */
+struct bsi_bench_client_result
+{
+    bool ok;        /* Every phase finished before timing out. */
+    uint64_t frames; /* Buffers committed in the steady state phase. */
+    struct bsi_histogram map;       /* Toplevel creation to first frame. */
+    struct bsi_histogram configure; /* Maximize request to configure. */
+};
+
+/**
+ * @brief Runs the synthetic clients against the compositor and writes a
+ * `struct bsi_bench_client_result` to `fd`.
+ *
+ * @param socket The compositor socket name.
+ * @param options The benchmark options.
+ * @param fd Where to write the result.
+ * @param mark_fd Where to write a `enum bsi_bench_mark` as phases begin.
+ * @return int The exit status for the client process.
+ */
+int
+bench_client_run(const char* socket,
+                 const struct bsi_bench_options* options,
+                 int fd,
+                 int mark_fd);
+
+/**
+ * @brief Times launching programs with a fork of the compositor against the
+ * launcher helper, and prints the numbers as JSON.
+ *
+ * @param options The benchmark options.
+ * @return int The exit status.
+ */
+int
+bench_launch_run(const struct bsi_bench_options* options);
+
+/**
+ * @brief Prints a histogram as a JSON member.
+ *
+ * @param f Where to print.
+ * @param name The member name.
+ * @param histogram The histogram.
+ * @param last No comma after the member.
+ */
+void
+bench_json_histogram(FILE* f,
+                     const char* name,
+                     const struct bsi_histogram* histogram,
+                     bool last);
@@ -0,0 +1,583 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wayland-client.h>
+
+#include "bench.h"
+#include "bonsai/stats.h"
+#include "wlr-layer-shell-unstable-v1-client-protocol.h"
+#include "xdg-shell-client-protocol.h"
+
+#define BENCH_DEFAULT_WIDTH 640
+#define BENCH_DEFAULT_HEIGHT 480
+#define BENCH_LAYER_HEIGHT 30
+
+struct bench_client
+{
+    const struct bsi_bench_options* options;
+    struct bsi_bench_client_result result;
+
+    struct wl_display* display;
+    struct wl_registry* registry;
+    struct wl_compositor* compositor;
+    struct wl_shm* shm;
+    struct xdg_wm_base* wm_base;
+    struct zwlr_layer_shell_v1* layer_shell;
+    struct wl_output* outputs[16];
+    size_t len_outputs;
+
+    struct wl_list windows; // bench_window::link
+    size_t mapped;
+    size_t configures_pending;
+    size_t frames_pending;
+    bool animating;
+    int mark_fd;
+};
+
+struct bench_window
+{
+    struct bench_client* client;
+    struct wl_surface* surface;
+    struct xdg_surface* xdg_surface;
+    struct xdg_toplevel* toplevel;
+    struct zwlr_layer_surface_v1* layer_surface;
+    struct wl_buffer* buffer;
+    struct wl_callback* frame;
+
+    int32_t width, height;                 /* Size of the current buffer. */
+    int32_t pending_width, pending_height; /* From the last configure. */
+    bool mapped;
+    uint32_t color;
+    uint64_t created_usec; /* Toplevel creation. */
+    uint64_t request_usec; /* Outstanding maximize request, or 0. */
+
+    struct wl_list link; // bench_client::windows
+};
+
+/* Buffers */
+static struct wl_buffer*
+buffer_create(struct wl_shm* shm, int32_t width, int32_t height, uint32_t color)
+{
+    size_t stride = width * 4;
+    size_t size = stride * height;
+
+    int fd = memfd_create("bonsai-bench", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        perror("bonsai-bench: memfd");
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    uint32_t* data =
+        mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("bonsai-bench: mmap");
+        close(fd);
+        return NULL;
+    }
+    for (size_t i = 0; i < size / 4; ++i)
+        data[i] = color;
+    munmap(data, size);
+
+    struct wl_shm_pool* pool = wl_shm_create_pool(shm, fd, size);
+    struct wl_buffer* buffer = wl_shm_pool_create_buffer(
+        pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+
+    return buffer;
+}
+
+static void
+window_attach(struct bench_window* window, int32_t width, int32_t height)
+{
+    struct bench_client* client = window->client;
+
+    if (window->buffer == NULL || window->width != width ||
+        window->height != height) {
+        if (window->buffer)
+            wl_buffer_destroy(window->buffer);
+        window->buffer =
+            buffer_create(client->shm, width, height, window->color);
+        window->width = width;
+        window->height = height;
+    }
+
+    wl_surface_attach(window->surface, window->buffer, 0, 0);
+    wl_surface_damage_buffer(window->surface, 0, 0, width, height);
+}
+
+/* Frame callbacks */
+static const struct wl_callback_listener frame_listener;
+
+static void
+window_request_frame(struct bench_window* window)
+{
+    window->frame = wl_surface_frame(window->surface);
+    wl_callback_add_listener(window->frame, &frame_listener, window);
+    ++window->client->frames_pending;
+}
+
+static void
+handle_frame_done(void* data, struct wl_callback* callback, uint32_t time)
+{
+    struct bench_window* window = data;
+    struct bench_client* client = window->client;
+
+    wl_callback_destroy(callback);
+    window->frame = NULL;
+    --client->frames_pending;
+
+    if (!window->mapped) {
+        window->mapped = true;
+        ++client->mapped;
+        if (window->toplevel)
+            histogram_record(&client->result.map,
+                             stats_now_usec() - window->created_usec);
+    }
+
+    /* Redraw on every frame, like an animating client would. */
+    if (client->animating) {
+        window_attach(window, window->width, window->height);
+        window_request_frame(window);
+        wl_surface_commit(window->surface);
+        ++client->result.frames;
+    }
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = handle_frame_done,
+};
+
+/* xdg-shell */
+static void
+handle_wm_base_ping(void* data, struct xdg_wm_base* wm_base, uint32_t serial)
+{
+    xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+    .ping = handle_wm_base_ping,
+};
+
+static void
+handle_xdg_surface_configure(void* data,
+                             struct xdg_surface* xdg_surface,
+                             uint32_t serial)
+{
+    struct bench_window* window = data;
+    struct bench_client* client = window->client;
+
+    if (window->request_usec) {
+        histogram_record(&client->result.configure,
+                         stats_now_usec() - window->request_usec);
+        window->request_usec = 0;
+        --client->configures_pending;
+    }
+
+    int32_t width = window->pending_width ? window->pending_width
+                                          : BENCH_DEFAULT_WIDTH;
+    int32_t height = window->pending_height ? window->pending_height
+                                            : BENCH_DEFAULT_HEIGHT;
+
+    xdg_surface_ack_configure(xdg_surface, serial);
+    window_attach(window, width, height);
+    if (!window->mapped && window->frame == NULL)
+        window_request_frame(window);
+    wl_surface_commit(window->surface);
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    .configure = handle_xdg_surface_configure,
+};
+
+static void
+handle_toplevel_configure(void* data,
+                          struct xdg_toplevel* toplevel,
+                          int32_t width,
+                          int32_t height,
+                          struct wl_array* states)
+{
+    struct bench_window* window = data;
+    window->pending_width = width;
+    window->pending_height = height;
+}
+
+static void
+handle_toplevel_close(void* data, struct xdg_toplevel* toplevel)
+{
+}
+
+static void
+handle_toplevel_configure_bounds(void* data,
+                                 struct xdg_toplevel* toplevel,
+                                 int32_t width,
+                                 int32_t height)
+{
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+    .configure = handle_toplevel_configure,
+    .close = handle_toplevel_close,
+    .configure_bounds = handle_toplevel_configure_bounds,
+};
+
+/* layer-shell */
+static void
+handle_layer_surface_configure(void* data,
+                               struct zwlr_layer_surface_v1* layer_surface,
+                               uint32_t serial,
+                               uint32_t width,
+                               uint32_t height)
+{
+    struct bench_window* window = data;
+
+    zwlr_layer_surface_v1_ack_configure(layer_surface, serial);
+    window_attach(window,
+                  width ? width : BENCH_DEFAULT_WIDTH,
+                  height ? height : BENCH_LAYER_HEIGHT);
+    if (!window->mapped && window->frame == NULL)
+        window_request_frame(window);
+    wl_surface_commit(window->surface);
+}
+
+static void
+handle_layer_surface_closed(void* data,
+                            struct zwlr_layer_surface_v1* layer_surface)
+{
+}
+
+static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
+    .configure = handle_layer_surface_configure,
+    .closed = handle_layer_surface_closed,
+};
+
+/* Registry */
+static void
+handle_registry_global(void* data,
+                       struct wl_registry* registry,
+                       uint32_t name,
+                       const char* interface,
+                       uint32_t version)
+{
+    struct bench_client* client = data;
+
+    if (strcmp(interface, wl_compositor_interface.name) == 0) {
+        client->compositor =
+            wl_registry_bind(registry, name, &wl_compositor_interface, 4);
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        client->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+        client->wm_base =
+            wl_registry_bind(registry, name, &xdg_wm_base_interface, 4);
+        xdg_wm_base_add_listener(client->wm_base, &wm_base_listener, client);
+    } else if (strcmp(interface, zwlr_layer_shell_v1_interface.name) == 0) {
+        client->layer_shell =
+            wl_registry_bind(registry, name, &zwlr_layer_shell_v1_interface, 1);
+    } else if (strcmp(interface, wl_output_interface.name) == 0 &&
+               client->len_outputs < 16) {
+        client->outputs[client->len_outputs++] =
+            wl_registry_bind(registry, name, &wl_output_interface, 1);
+    }
+}
+
+static void
+handle_registry_global_remove(void* data,
+                              struct wl_registry* registry,
+                              uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = handle_registry_global,
+    .global_remove = handle_registry_global_remove,
+};
+
+/* Event loop */
+static bool
+client_dispatch(struct bench_client* client, int timeout_ms)
+{
+    struct wl_display* display = client->display;
+
+    while (wl_display_prepare_read(display) != 0)
+        wl_display_dispatch_pending(display);
+    wl_display_flush(display);
+
+    struct pollfd pfd = {
+        .fd = wl_display_get_fd(display),
+        .events = POLLIN,
+    };
+    int ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0 && errno != EINTR) {
+        wl_display_cancel_read(display);
+        return false;
+    }
+
+    if (ret > 0 && (pfd.revents & POLLIN)) {
+        if (wl_display_read_events(display) < 0)
+            return false;
+    } else {
+        wl_display_cancel_read(display);
+    }
+
+    return wl_display_dispatch_pending(display) >= 0;
+}
+
+/* Dispatches until `*count` drops to `target` or rises to it, depending on
+ * `rising`. */
+static bool
+client_wait(struct bench_client* client,
+            const size_t* count,
+            size_t target,
+            bool rising)
+{
+    uint64_t deadline = stats_now_usec() + BSI_BENCH_PHASE_TIMEOUT_MS * 1000;
+
+    while (rising ? *count < target : *count > target) {
+        uint64_t now = stats_now_usec();
+        if (now >= deadline)
+            return false;
+        if (!client_dispatch(client, (deadline - now) / 1000 + 1))
+            return false;
+    }
+
+    return true;
+}
+
+/* Dispatches for `duration_ms`, whatever comes in. */
+static bool
+client_idle(struct bench_client* client, uint32_t duration_ms)
+{
+    uint64_t deadline = stats_now_usec() + (uint64_t)duration_ms * 1000;
+    for (uint64_t now; (now = stats_now_usec()) < deadline;) {
+        if (!client_dispatch(client, (deadline - now) / 1000 + 1))
+            return false;
+    }
+
+    return true;
+}
+
+/* Tells the compositor process a phase begins. It reads the mark in the
+ * dispatch that answers the roundtrip, or an earlier one. */
+static bool
+client_mark(struct bench_client* client, enum bsi_bench_mark mark)
+{
+    char c = mark;
+    ssize_t len;
+    while ((len = write(client->mark_fd, &c, 1)) < 0 && errno == EINTR)
+        ;
+    return len == 1 && wl_display_roundtrip(client->display) >= 0;
+}
+
+/* Phases */
+static struct bench_window*
+window_create(struct bench_client* client)
+{
+    struct bench_window* window = calloc(1, sizeof(struct bench_window));
+    window->client = client;
+    window->surface = wl_compositor_create_surface(client->compositor);
+    window->color = 0xff000000 | (rand() & 0xffffff);
+    wl_list_insert(client->windows.prev, &window->link);
+    return window;
+}
+
+static bool
+phase_layers(struct bench_client* client)
+{
+    if (client->layer_shell == NULL || client->len_outputs == 0)
+        return client->options->layers == 0;
+
+    for (size_t i = 0; i < client->options->layers; ++i) {
+        struct bench_window* window = window_create(client);
+        window->layer_surface = zwlr_layer_shell_v1_get_layer_surface(
+            client->layer_shell,
+            window->surface,
+            client->outputs[i % client->len_outputs],
+            ZWLR_LAYER_SHELL_V1_LAYER_TOP,
+            "bonsai-bench");
+        zwlr_layer_surface_v1_add_listener(
+            window->layer_surface, &layer_surface_listener, window);
+        zwlr_layer_surface_v1_set_anchor(
+            window->layer_surface,
+            ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
+        zwlr_layer_surface_v1_set_size(
+            window->layer_surface, 0, BENCH_LAYER_HEIGHT);
+        zwlr_layer_surface_v1_set_exclusive_zone(window->layer_surface,
+                                                 BENCH_LAYER_HEIGHT);
+        wl_surface_commit(window->surface);
+    }
+
+    return client_wait(client, &client->mapped, client->options->layers, true);
+}
+
+static struct bench_window*
+toplevel_create(struct bench_client* client)
+{
+    struct bench_window* window = window_create(client);
+    window->created_usec = stats_now_usec();
+    window->xdg_surface =
+        xdg_wm_base_get_xdg_surface(client->wm_base, window->surface);
+    xdg_surface_add_listener(
+        window->xdg_surface, &xdg_surface_listener, window);
+    window->toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+    xdg_toplevel_add_listener(window->toplevel, &toplevel_listener, window);
+    xdg_toplevel_set_title(window->toplevel, "bonsai-bench");
+    wl_surface_commit(window->surface);
+    return window;
+}
+
+static bool
+phase_map(struct bench_client* client)
+{
+    /* One at a time, so every map is measured on an otherwise idle
+     * compositor. */
+    for (size_t i = 0; i < client->options->clients; ++i) {
+        toplevel_create(client);
+        if (!client_wait(
+                client, &client->mapped, client->options->layers + i + 1, true))
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+phase_configure(struct bench_client* client)
+{
+    for (uint32_t i = 0; i < client->options->toggles; ++i) {
+        struct bench_window* window;
+        wl_list_for_each(window, &client->windows, link)
+        {
+            if (window->toplevel == NULL)
+                continue;
+
+            window->request_usec = stats_now_usec();
+            ++client->configures_pending;
+            if (i % 2 == 0)
+                xdg_toplevel_set_maximized(window->toplevel);
+            else
+                xdg_toplevel_unset_maximized(window->toplevel);
+        }
+
+        if (!client_wait(client, &client->configures_pending, 0, false))
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+phase_animate(struct bench_client* client)
+{
+    client->animating = true;
+
+    struct bench_window* window;
+    wl_list_for_each(window, &client->windows, link)
+    {
+        if (window->frame)
+            continue;
+        window_attach(window, window->width, window->height);
+        window_request_frame(window);
+        wl_surface_commit(window->surface);
+    }
+
+    if (!client_idle(client, client->options->duration_ms))
+        return false;
+
+    client->animating = false;
+    return true;
+}
+
+static bool
+phase_damage(struct bench_client* client)
+{
+    /* Outputs that are off compose nothing. */
+    if (client->options->power_off_s)
+        return true;
+
+    /* Nothing else may damage the outputs, no workspace switches and no
+     * redraws. */
+    if (!client_mark(client, BSI_BENCH_MARK_QUIET) ||
+        !client_wait(client, &client->frames_pending, 0, false))
+        return false;
+
+    /* A toplevel of its own, mapped last, so it is in front. */
+    struct bench_window* window = toplevel_create(client);
+    if (!client_wait(client, &client->mapped, client->mapped + 1, true) ||
+        !client_idle(client, BSI_BENCH_DAMAGE_SETTLE_MS))
+        return false;
+
+    if (!client_mark(client, BSI_BENCH_MARK_DAMAGE))
+        return false;
+    for (uint32_t i = 0; i < BSI_BENCH_DAMAGE_FRAMES; ++i) {
+        wl_surface_attach(window->surface, window->buffer, 0, 0);
+        wl_surface_damage_buffer(window->surface, i, i, 1, 1);
+        window_request_frame(window);
+        wl_surface_commit(window->surface);
+        if (!client_wait(client, &client->frames_pending, 0, false))
+            return false;
+    }
+
+    return true;
+}
+
+int
+bench_client_run(const char* socket,
+                 const struct bsi_bench_options* options,
+                 int fd,
+                 int mark_fd)
+{
+    struct bench_client client = { 0 };
+    client.options = options;
+    client.mark_fd = mark_fd;
+    wl_list_init(&client.windows);
+
+    client.display = wl_display_connect(socket);
+    if (client.display == NULL) {
+        fprintf(stderr, "bonsai-bench: failed to connect to '%s'\n", socket);
+        return EXIT_FAILURE;
+    }
+
+    client.registry = wl_display_get_registry(client.display);
+    wl_registry_add_listener(client.registry, &registry_listener, &client);
+    wl_display_roundtrip(client.display);
+
+    if (client.compositor == NULL || client.shm == NULL ||
+        client.wm_base == NULL) {
+        fprintf(stderr, "bonsai-bench: compositor lacks required globals\n");
+        wl_display_disconnect(client.display);
+        return EXIT_FAILURE;
+    }
+
+    client.result.ok = phase_layers(&client) && phase_map(&client) &&
+                       phase_configure(&client) && phase_animate(&client) &&
+                       phase_damage(&client);
+    if (!client.result.ok)
+        fprintf(stderr, "bonsai-bench: client phase timed out\n");
+
+    const char* out = (const char*)&client.result;
+    size_t left = sizeof(client.result);
+    while (left > 0) {
+        ssize_t len = write(fd, out, left);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            break;
+        out += len;
+        left -= len;
+    }
+
+    /* The compositor is about to go away, don't bother cleaning up. */
+    wl_display_disconnect(client.display);
+    return client.result.ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,167 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+
+#include "bench.h"
+#include "bonsai/launcher.h"
+#include "bonsai/stats.h"
+
+struct bench_launch
+{
+    struct bsi_histogram fork_stall; /* Time the event loop is stuck in fork. */
+    struct bsi_histogram fork_exec;  /* Keypress to exec with a fork. */
+    struct bsi_histogram launcher_stall;
+    uint64_t fork_failed;
+};
+
+static bool
+bench_launch_fork(struct bench_launch* bench, char* const* argp)
+{
+    extern char** environ;
+
+    /* Closes on exec, like the helper knows the program is running. */
+    int exec_pipe[2];
+    if (pipe2(exec_pipe, O_CLOEXEC) < 0) {
+        perror("bonsai-bench: pipe2");
+        return false;
+    }
+
+    /* What `util_forkexec(...)` does. */
+    uint64_t begin_usec = stats_now_usec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        execve(argp[0], argp, environ);
+        _exit(EXIT_FAILURE);
+    }
+    uint64_t forked_usec = stats_now_usec();
+    close(exec_pipe[1]);
+    if (pid < 0) {
+        perror("bonsai-bench: fork");
+        close(exec_pipe[0]);
+        return false;
+    }
+
+    char c;
+    while (read(exec_pipe[0], &c, 1) < 0 && errno == EINTR)
+        ;
+    uint64_t exec_usec = stats_now_usec();
+    close(exec_pipe[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        ++bench->fork_failed;
+
+    histogram_record(&bench->fork_stall, forked_usec - begin_usec);
+    histogram_record(&bench->fork_exec, exec_usec - begin_usec);
+    return true;
+}
+
+static bool
+bench_launch_dispatch(struct wl_event_loop* loop, struct wl_list* list)
+{
+    uint64_t deadline_usec =
+        stats_now_usec() + BSI_BENCH_PHASE_TIMEOUT_MS * UINT64_C(1000);
+    while (!wl_list_empty(list)) {
+        if (stats_now_usec() > deadline_usec)
+            return false;
+        wl_event_loop_dispatch(loop, BSI_BENCH_PHASE_TIMEOUT_MS);
+    }
+    return true;
+}
+
+int
+bench_launch_run(const struct bsi_bench_options* options)
+{
+    /* Forked first, like the compositor does it. */
+    struct bsi_launcher* launcher = launcher_create();
+    if (launcher == NULL) {
+        fprintf(stderr, "bonsai-bench: failed to start the launcher\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Stands in for the GPU and shm mappings of a running compositor, touched
+     * so that fork has page tables to copy. */
+    size_t len_mapped = options->mapped_mb << 20;
+    char* mapped = NULL;
+    if (len_mapped) {
+        mapped = mmap(NULL,
+                      len_mapped,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1,
+                      0);
+        if (mapped == MAP_FAILED) {
+            perror("bonsai-bench: mmap");
+            launcher_destroy(launcher);
+            return EXIT_FAILURE;
+        }
+        memset(mapped, 1, len_mapped);
+    }
+
+    struct wl_event_loop* loop = wl_event_loop_create();
+    launcher_attach(launcher, loop);
+
+    char* const argp[] = { "/bin/true", NULL };
+    struct bench_launch bench = { 0 };
+    bool ok = true;
+
+    for (uint32_t i = 0; i < options->launches && ok; ++i)
+        ok = bench_launch_fork(&bench, argp);
+
+    for (uint32_t i = 0; i < options->launches && ok; ++i) {
+        uint64_t begin_usec = stats_now_usec();
+        ok = launcher_exec(launcher, argp, 2, NULL);
+        histogram_record(&bench.launcher_stall, stats_now_usec() - begin_usec);
+        /* One at a time, same as the forks. */
+        ok = ok && bench_launch_dispatch(loop, &launcher->requests);
+    }
+    ok = ok && bench_launch_dispatch(loop, &launcher->children);
+    ok = ok && bench.fork_failed == 0 && launcher->failed == 0;
+
+    FILE* f = stdout;
+    if (options->json_path && !(f = fopen(options->json_path, "w"))) {
+        fprintf(stderr,
+                "bonsai-bench: failed to open '%s': %s\n",
+                options->json_path,
+                strerror(errno));
+        f = stdout;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f,
+            "  \"options\": { \"launches\": %u, \"mapped_mb\": %ld },\n",
+            options->launches,
+            options->mapped_mb);
+    fprintf(f, "  \"ok\": %s,\n", ok ? "true" : "false");
+    fprintf(f, "  \"fork\": {\n");
+    fprintf(f, "    \"failed\": %lu,\n", bench.fork_failed);
+    bench_json_histogram(f, "stall_us", &bench.fork_stall, false);
+    bench_json_histogram(f, "exec_latency_us", &bench.fork_exec, true);
+    fprintf(f, "  },\n");
+    fprintf(f, "  \"launcher\": {\n");
+    fprintf(f, "    \"failed\": %lu,\n", launcher->failed);
+    bench_json_histogram(f, "stall_us", &bench.launcher_stall, false);
+    bench_json_histogram(f, "exec_latency_us", &launcher->latency, true);
+    fprintf(f, "  }\n");
+    fprintf(f, "}\n");
+
+    if (f != stdout)
+        fclose(f);
+
+    launcher_destroy(launcher);
+    wl_event_loop_destroy(loop);
+    if (mapped != NULL)
+        munmap(mapped, len_mapped);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
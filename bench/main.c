@@ -0,0 +1,518 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+
+#include "bench.h"
+#include "bonsai/config/config.h"
+#include "bonsai/output.h"
+#include "bonsai/server.h"
+#include "bonsai/stats.h"
+#include "pixman.h"
+
+struct bench
+{
+    struct bsi_server* server;
+    const struct bsi_bench_options* options;
+    pid_t client_pid;
+    int fd;
+    struct bsi_bench_client_result result;
+    size_t len_result;
+    struct rusage usage_begin;
+    struct wl_event_source* switch_timer;
+    struct wl_event_source* mark_source;
+    struct wl_listener new_output;
+    uint64_t commits_off; /* Output commits while it was off. */
+    bool quiet;           /* The client asked for no more switches. */
+
+    /* Pixels the scene damaged in each frame of the damage check. */
+    struct
+    {
+        bool measuring;
+        uint64_t frames;
+        uint64_t max_px;
+    } damage;
+
+    int status;
+};
+
+struct bench_output
+{
+    struct bench* bench;
+    struct wl_listener precommit;
+    struct wl_listener commit;
+};
+
+static void
+usage(const char* argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [-o outputs] [-c clients] [-l layers] [-w workspaces]\n"
+            "          [-s switch_ms] [-t toggles] [-d duration_ms] "
+            "[-p power_off_s]\n"
+            "          [-j json_path]\n"
+            "       %s -L launches [-m mapped_mb] [-j json_path]\n",
+            argv0,
+            argv0);
+}
+
+void
+bench_json_histogram(FILE* f,
+                     const char* name,
+                     const struct bsi_histogram* histogram,
+                     bool last)
+{
+    fprintf(f,
+            "    \"%s\": { \"count\": %lu, \"mean\": %lu, \"min\": %lu, "
+            "\"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"max\": %lu }%s\n",
+            name,
+            histogram->count,
+            histogram->count ? histogram->sum / histogram->count : 0,
+            histogram->min,
+            histogram_quantile(histogram, 0.5),
+            histogram_quantile(histogram, 0.9),
+            histogram_quantile(histogram, 0.99),
+            histogram->max,
+            last ? "" : ",");
+}
+
+static long
+rss_current_kb(void)
+{
+    long pages_total, pages_resident;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f == NULL)
+        return -1;
+    if (fscanf(f, "%ld %ld", &pages_total, &pages_resident) != 2)
+        pages_resident = -1;
+    fclose(f);
+    if (pages_resident < 0)
+        return -1;
+    return pages_resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static uint64_t
+timeval_usec(const struct timeval* tv)
+{
+    return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static bool
+bench_damage_ok(struct bench* bench)
+{
+    /* The check doesn't run with the outputs turned off. */
+    if (bench->options->power_off_s)
+        return true;
+    return bench->damage.frames > 0 &&
+           bench->damage.max_px <= BSI_BENCH_DAMAGE_MAX_PX;
+}
+
+static void
+bench_report(struct bench* bench)
+{
+    const struct bsi_bench_options* options = bench->options;
+    struct bsi_bench_client_result* result = &bench->result;
+
+    /* All outputs together. */
+    struct bsi_output_stats total = { 0 };
+    struct bsi_output* output;
+    wl_list_for_each(output, &bench->server->output.outputs, link_server)
+    {
+        if (output->stats == NULL)
+            continue;
+        histogram_merge(&total.commit, &output->stats->commit);
+        histogram_merge(&total.cpu, &output->stats->cpu);
+        histogram_merge(&total.interval, &output->stats->interval);
+        histogram_merge(&total.delay, &output->stats->delay);
+        total.frames += output->stats->frames;
+        total.skipped += output->stats->skipped;
+        total.missed += output->stats->missed;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    FILE* f = stdout;
+    if (options->json_path && !(f = fopen(options->json_path, "w"))) {
+        fprintf(stderr,
+                "bonsai-bench: failed to open '%s': %s\n",
+                options->json_path,
+                strerror(errno));
+        f = stdout;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f,
+            "  \"options\": { \"outputs\": %ld, \"clients\": %ld, "
+            "\"layers\": %ld, \"workspaces\": %ld, \"switch_ms\": %u, "
+            "\"toggles\": %u, \"duration_ms\": %u, \"power_off_s\": %u },\n",
+            options->outputs,
+            options->clients,
+            options->layers,
+            options->workspaces,
+            options->switch_ms,
+            options->toggles,
+            options->duration_ms,
+            options->power_off_s);
+    fprintf(f, "  \"ok\": %s,\n", result->ok ? "true" : "false");
+    fprintf(f, "  \"client\": {\n");
+    fprintf(f, "    \"frames\": %lu,\n", result->frames);
+    bench_json_histogram(f, "map_latency_us", &result->map, false);
+    bench_json_histogram(f, "configure_rtt_us", &result->configure, true);
+    fprintf(f, "  },\n");
+    fprintf(f,
+            "  \"damage\": { \"frames\": %lu, \"max_px\": %lu, "
+            "\"limit_px\": %d, \"ok\": %s },\n",
+            bench->damage.frames,
+            bench->damage.max_px,
+            BSI_BENCH_DAMAGE_MAX_PX,
+            bench_damage_ok(bench) ? "true" : "false");
+    fprintf(f, "  \"compositor\": {\n");
+    fprintf(f,
+            "    \"frames\": %lu,\n"
+            "    \"frames_without_damage\": %lu,\n"
+            "    \"missed_vblanks\": %lu,\n"
+            "    \"power_offs\": %lu,\n"
+            "    \"commits_while_off\": %lu,\n",
+            total.frames,
+            total.skipped,
+            total.missed,
+            bench->server->idle.power_offs,
+            bench->commits_off);
+    fprintf(f,
+            "    \"cpu_user_us\": %lu,\n"
+            "    \"cpu_system_us\": %lu,\n"
+            "    \"max_rss_kb\": %ld,\n"
+            "    \"rss_kb\": %ld,\n",
+            timeval_usec(&usage.ru_utime) -
+                timeval_usec(&bench->usage_begin.ru_utime),
+            timeval_usec(&usage.ru_stime) -
+                timeval_usec(&bench->usage_begin.ru_stime),
+            usage.ru_maxrss,
+            rss_current_kb());
+    bench_json_histogram(f, "frame_cpu_us", &total.cpu, false);
+    bench_json_histogram(f, "frame_commit_us", &total.commit, false);
+    bench_json_histogram(f, "frame_interval_us", &total.interval, false);
+    bench_json_histogram(f, "frame_delay_us", &total.delay, true);
+    fprintf(f, "  }\n");
+    fprintf(f, "}\n");
+
+    if (f != stdout)
+        fclose(f);
+}
+
+static int
+handle_client_result(int fd, uint32_t mask, void* data)
+{
+    struct bench* bench = data;
+
+    if (mask & WL_EVENT_READABLE) {
+        ssize_t len = read(fd,
+                           (char*)&bench->result + bench->len_result,
+                           sizeof(bench->result) - bench->len_result);
+        if (len < 0 && errno == EINTR)
+            return 0;
+        if (len > 0) {
+            bench->len_result += len;
+            if (bench->len_result < sizeof(bench->result))
+                return 0;
+        }
+    }
+
+    if (bench->len_result < sizeof(bench->result)) {
+        fprintf(stderr, "bonsai-bench: client exited without a result\n");
+        memset(&bench->result, 0, sizeof(bench->result));
+    }
+    bench->status = (bench->result.ok && bench_damage_ok(bench))
+                        ? EXIT_SUCCESS
+                        : EXIT_FAILURE;
+
+    bench_report(bench);
+    wl_display_terminate(bench->server->wl_display);
+    return 0;
+}
+
+static int
+handle_client_mark(int fd, uint32_t mask, void* data)
+{
+    struct bench* bench = data;
+
+    char mark;
+    ssize_t len = read(fd, &mark, 1);
+    if (len < 0 && errno == EINTR)
+        return 0;
+    if (len != 1) {
+        /* The client is done, the result comes in on its own fd. */
+        wl_event_source_remove(bench->mark_source);
+        bench->mark_source = NULL;
+        return 0;
+    }
+
+    switch (mark) {
+        case BSI_BENCH_MARK_QUIET:
+            bench->quiet = true;
+            if (bench->switch_timer)
+                wl_event_source_timer_update(bench->switch_timer, 0);
+            break;
+        case BSI_BENCH_MARK_DAMAGE:
+            bench->damage.measuring = true;
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+/* The scene output damage of this frame, before the commit moves it into the
+ * history of the buffers. */
+static void
+handle_output_precommit(struct wl_listener* listener, void* data)
+{
+    struct bench_output* output = wl_container_of(listener, output, precommit);
+    struct bench* bench = output->bench;
+    struct wlr_output_event_precommit* event = data;
+
+    if (!bench->damage.measuring)
+        return;
+
+    struct wlr_scene_output* wlr_scene_output =
+        wlr_scene_get_scene_output(bench->server->wlr_scene, event->output);
+    if (wlr_scene_output == NULL)
+        return;
+
+    int len_rects;
+    pixman_box32_t* rects = pixman_region32_rectangles(
+        &wlr_scene_output->damage->current, &len_rects);
+    uint64_t px = 0;
+    for (int i = 0; i < len_rects; ++i)
+        px += (uint64_t)(rects[i].x2 - rects[i].x1) *
+              (rects[i].y2 - rects[i].y1);
+    if (px == 0)
+        return;
+
+    ++bench->damage.frames;
+    if (px > bench->damage.max_px)
+        bench->damage.max_px = px;
+}
+
+/* Turning the output off is a commit too, everything after it shouldn't be. */
+static void
+handle_output_commit(struct wl_listener* listener, void* data)
+{
+    struct bench_output* output = wl_container_of(listener, output, commit);
+    struct wlr_output_event_commit* event = data;
+    if (!event->output->enabled &&
+        !(event->committed & WLR_OUTPUT_STATE_ENABLED))
+        ++output->bench->commits_off;
+}
+
+static void
+handle_new_output(struct wl_listener* listener, void* data)
+{
+    struct bench* bench = wl_container_of(listener, bench, new_output);
+    struct wlr_output* wlr_output = data;
+
+    /* Lives as long as the process, like the outputs. */
+    struct bench_output* output = calloc(1, sizeof(struct bench_output));
+    output->bench = bench;
+    output->precommit.notify = handle_output_precommit;
+    wl_signal_add(&wlr_output->events.precommit, &output->precommit);
+    output->commit.notify = handle_output_commit;
+    wl_signal_add(&wlr_output->events.commit, &output->commit);
+}
+
+static int
+handle_switch_timer(void* data)
+{
+    struct bench* bench = data;
+    if (bench->quiet)
+        return 0;
+
+    struct bsi_output* output;
+    wl_list_for_each(output, &bench->server->output.outputs, link_server)
+    {
+        workspaces_next(output);
+    }
+
+    wl_event_source_timer_update(bench->switch_timer,
+                                 bench->options->switch_ms);
+    return 0;
+}
+
+int
+main(int argc, char** argv)
+{
+    struct bsi_bench_options options = {
+        .outputs = 1,
+        .clients = 10,
+        .layers = 1,
+        .workspaces = 5,
+        .switch_ms = 0,
+        .toggles = 10,
+        .duration_ms = 5000,
+        .launches = 0,
+        .mapped_mb = 512,
+        .power_off_s = 0,
+        .json_path = NULL,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:c:l:w:s:t:d:L:m:p:j:h")) != -1) {
+        switch (opt) {
+            case 'o':
+                options.outputs = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                options.clients = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                options.layers = strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                options.workspaces = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                options.switch_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                options.toggles = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                options.duration_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'L':
+                options.launches = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                options.mapped_mb = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                options.power_off_s = strtoul(optarg, NULL, 10);
+                break;
+            case 'j':
+                options.json_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (options.outputs == 0 || options.workspaces == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.launches)
+        return bench_launch_run(&options);
+
+    /* Headless outputs with the software renderer, so the numbers don't depend
+     * on the GPU of the machine. */
+    char outputs[16];
+    snprintf(outputs, sizeof(outputs), "%ld", options.outputs);
+    setenv("WLR_BACKENDS", "headless", true);
+    setenv("WLR_RENDERER", "pixman", true);
+    setenv("WLR_HEADLESS_OUTPUTS", outputs, true);
+    setenv("WLR_LIBINPUT_NO_DEVICES", "1", true);
+    wlr_log_init(WLR_ERROR, NULL);
+
+    struct bsi_config config;
+    struct bsi_server server;
+
+    config_init(&config, &server);
+    char workspaces[64];
+    snprintf(workspaces,
+             sizeof(workspaces),
+             "workspace count max %ld",
+             options.workspaces);
+    config_add(&config, workspaces);
+    config_add(&config, "frame stats yes");
+    if (options.power_off_s) {
+        char power_off[64];
+        snprintf(power_off,
+                 sizeof(power_off),
+                 "idle power-off %u",
+                 options.power_off_s);
+        config_add(&config, power_off);
+    }
+
+    server_init(&server, &config);
+
+    /* No wallpaper or bar, only the synthetic clients. */
+    for (size_t i = 0; i < BSI_SERVER_EXTERN_PROG_MAX; ++i)
+        server.output.setup[i] = true;
+
+    server.wl_socket = wl_display_add_socket_auto(server.wl_display);
+    if (server.wl_socket == NULL) {
+        fprintf(stderr, "bonsai-bench: failed to create socket\n");
+        return EXIT_FAILURE;
+    }
+
+    int fds[2], mark_fds[2];
+    if (pipe(fds) < 0 || pipe(mark_fds) < 0) {
+        perror("bonsai-bench: pipe");
+        return EXIT_FAILURE;
+    }
+
+    struct bench bench = {
+        .server = &server,
+        .options = &options,
+        .commits_off = 0,
+        .status = EXIT_FAILURE,
+    };
+    bench.new_output.notify = handle_new_output;
+    wl_signal_add(&server.wlr_backend->events.new_output, &bench.new_output);
+
+    bench.client_pid = fork();
+    if (bench.client_pid < 0) {
+        perror("bonsai-bench: fork");
+        return EXIT_FAILURE;
+    }
+    if (bench.client_pid == 0) {
+        close(fds[0]);
+        close(mark_fds[0]);
+        _exit(bench_client_run(
+            server.wl_socket, &options, fds[1], mark_fds[1]));
+    }
+    close(fds[1]);
+    close(mark_fds[1]);
+    bench.fd = fds[0];
+
+    struct wl_event_loop* loop = wl_display_get_event_loop(server.wl_display);
+    wl_event_loop_add_fd(loop,
+                         bench.fd,
+                         WL_EVENT_READABLE | WL_EVENT_HANGUP,
+                         handle_client_result,
+                         &bench);
+    bench.mark_source = wl_event_loop_add_fd(loop,
+                                             mark_fds[0],
+                                             WL_EVENT_READABLE,
+                                             handle_client_mark,
+                                             &bench);
+    if (options.switch_ms) {
+        bench.switch_timer =
+            wl_event_loop_add_timer(loop, handle_switch_timer, &bench);
+        wl_event_source_timer_update(bench.switch_timer, options.switch_ms);
+    }
+
+    getrusage(RUSAGE_SELF, &bench.usage_begin);
+    server_run(&server);
+
+    waitpid(bench.client_pid, NULL, 0);
+    close(bench.fd);
+    close(mark_fds[0]);
+
+    /* The report is out. Destroying the last output exits the process without
+     * the status, so skip the teardown. */
+    return bench.status;
+}
@@ -8,6 +8,8 @@
 #include <wlr/types/wlr_output.h>
 
 #include "bonsai/config/atom.h"
+#include "bonsai/desktop/idle.h"
+#include "bonsai/input/keybinds.h"
 #include "bonsai/log.h"
 #include "bonsai/output.h"
 #include "bonsai/server.h"
@@ -22,6 +24,7 @@ config_atom_init(struct bsi_config_atom* atom,
     atom->type = type;
     atom->impl = impl;
     atom->cmd = strdup(config);
+    atom->line = strdup(config);
     return atom;
 }
 
@@ -29,6 +32,7 @@ void
 config_atom_destroy(struct bsi_config_atom* atom)
 {
     free(atom->cmd);
+    free(atom->line);
     free(atom);
 }
 
@@ -50,8 +54,10 @@ config_output_apply(struct bsi_config_atom* atom, struct bsi_server* server)
 {
     /* Syntax: output <name> mode <w>x<h> refresh <r> */
 
+    /* Applied again for every new output, so it splits a copy. */
+    char* line = strdup(atom->line);
     char **cmd = NULL, **resl = NULL;
-    size_t len_cmd = util_split_delim(atom->cmd, " ", &cmd, false);
+    size_t len_cmd = util_split_delim(line, " ", &cmd, false);
 
     if (len_cmd != 7 || strcasecmp("output", cmd[0]) ||
         strcasecmp("mode", cmd[2]) || strcasecmp("refresh", cmd[4]))
@@ -83,7 +89,7 @@ config_output_apply(struct bsi_config_atom* atom, struct bsi_server* server)
     if (errno)
         goto error;
 
-    bool found = false;
+    bool found = false, applied = false;
     struct bsi_output* output;
     wl_list_for_each(output, &server->output.outputs, link_server)
     {
@@ -98,7 +104,7 @@ config_output_apply(struct bsi_config_atom* atom, struct bsi_server* server)
             wlr_output_enable(output->output, true);
             if (!wlr_output_commit(output->output)) {
                 error("Failed to commit on output '%s'", output->output->name);
-                return false;
+                break;
             }
 
             info("Set mode { width=%d, height=%d, refresh=%d } for output "
@@ -111,7 +117,8 @@ config_output_apply(struct bsi_config_atom* atom, struct bsi_server* server)
                  output->output->make,
                  output->output->model);
 
-            return true;
+            applied = true;
+            break;
         } else {
             debug("Found output %s (%s %s), doesn't match current config entry",
                   output->output->name,
@@ -123,16 +130,20 @@ config_output_apply(struct bsi_config_atom* atom, struct bsi_server* server)
     if (!found)
         info("No output matching config for entry '%s'", output_name);
 
-    return false;
+    util_split_free(&cmd);
+    util_split_free(&resl);
+    free(line);
+    return applied;
 
 error:
     if (cmd)
         util_split_free(&cmd);
     if (resl)
         util_split_free(&resl);
+    free(line);
     error("Invalid output config syntax '%s', syntax is 'output <name> "
           "mode <w>x<h> refresh <r>'",
-          atom->cmd);
+          atom->line);
     return false;
 }
 
@@ -317,7 +328,13 @@ config_input_apply(struct bsi_config_atom* atom, struct bsi_server* server)
         }
     }
 
+    /* No key matched. */
+    if (config->devname == NULL)
+        goto error;
+
+    config->atom = atom;
     wl_list_insert(&server->config.input, &config->link);
+    util_split_free(&cmd);
 
     return true;
 
@@ -391,3 +408,266 @@ config_wallpaper_apply(struct bsi_config_atom* atom, struct bsi_server* server)
 
     return true;
 }
+
+bool
+config_cursor_apply(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    /* Syntax: cursor coalesce_motion <yes/no> */
+    char** cmd = NULL;
+    size_t len_cmd = util_split_delim(atom->cmd, " ", &cmd, false);
+    if (len_cmd != 4 || strcasecmp("cursor", cmd[0]) ||
+        strcasecmp("coalesce_motion", cmd[1])) {
+        util_split_free(&cmd);
+        error("Invalid cursor config syntax '%s', syntax is 'cursor "
+              "coalesce_motion <yes/no>'",
+              atom->cmd);
+        return false;
+    }
+
+    server->cursor.motion.coalesce = (strcasecmp("yes", cmd[2]) == 0);
+    util_split_free(&cmd);
+
+    info("Cursor motion coalescing is %s",
+         server->cursor.motion.coalesce ? "on" : "off");
+
+    return true;
+}
+
+bool
+config_frame_apply(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    /* Syntax: frame throttle_hidden <hz>
+     *         frame stats <yes/no>
+     *         frame schedule <off|adaptive|fixed <ms>>
+     *         frame show_damage <yes/no>
+     *         frame hud <yes/no> */
+    char** cmd = NULL;
+    size_t len_cmd = util_split_delim(atom->cmd, " ", &cmd, false);
+    if (len_cmd < 4 || len_cmd > 5 || strcasecmp("frame", cmd[0]) ||
+        (len_cmd == 5 && strcasecmp("fixed", cmd[2]))) {
+        util_split_free(&cmd);
+        error("Invalid frame config syntax '%s', syntax is 'frame "
+              "throttle_hidden <hz>', 'frame stats <yes/no>', 'frame "
+              "schedule <off|adaptive|fixed <ms>>', 'frame show_damage "
+              "<yes/no>' or 'frame hud <yes/no>'",
+              atom->cmd);
+        return false;
+    }
+
+    if (strcasecmp("schedule", cmd[1]) == 0) {
+        if (strcasecmp("off", cmd[2]) == 0) {
+            server->frame.schedule = BSI_OUTPUT_SCHEDULE_OFF;
+        } else if (strcasecmp("adaptive", cmd[2]) == 0) {
+            server->frame.schedule = BSI_OUTPUT_SCHEDULE_ADAPTIVE;
+        } else if (strcasecmp("fixed", cmd[2]) == 0 && len_cmd == 5) {
+            char* end = NULL;
+            long ms = strtol(cmd[3], &end, 10);
+            if (*end != '\0' || ms < 0 || ms > 100) {
+                util_split_free(&cmd);
+                error("Invalid frame schedule delay '%s', expected 0-100",
+                      atom->cmd);
+                return false;
+            }
+            server->frame.schedule = BSI_OUTPUT_SCHEDULE_FIXED;
+            server->frame.schedule_delay_usec = ms * 1000;
+        } else {
+            error("Unknown frame schedule '%s'", cmd[2]);
+            util_split_free(&cmd);
+            return false;
+        }
+        info("Frame schedule is %s", cmd[2]);
+    } else if (len_cmd == 5) {
+        error("Invalid frame config syntax '%s'", atom->cmd);
+        util_split_free(&cmd);
+        return false;
+    } else if (strcasecmp("throttle_hidden", cmd[1]) == 0) {
+        char* end = NULL;
+        long hz = strtol(cmd[2], &end, 10);
+        if (*end != '\0' || hz < 0 || hz > 1000) {
+            util_split_free(&cmd);
+            error("Invalid hidden view frame rate '%s', expected 0-1000",
+                  atom->cmd);
+            return false;
+        }
+        server->frame.throttle_hz = hz;
+        info("Hidden views get %ld frame callbacks per second", hz);
+    } else if (strcasecmp("stats", cmd[1]) == 0) {
+        server->stats.enabled = (strcasecmp("yes", cmd[2]) == 0);
+        info("Frame stats are %s", server->stats.enabled ? "on" : "off");
+    } else if (strcasecmp("show_damage", cmd[1]) == 0) {
+        /* Outputs aren't there yet, they pick this up when they come. */
+        server->overlay.damage = (strcasecmp("yes", cmd[2]) == 0);
+        info("Damage overlay is %s", server->overlay.damage ? "on" : "off");
+    } else if (strcasecmp("hud", cmd[1]) == 0) {
+        server->overlay.hud.enabled = (strcasecmp("yes", cmd[2]) == 0);
+        info("HUD is %s", server->overlay.hud.enabled ? "on" : "off");
+    } else {
+        error("Unknown frame config key '%s'", cmd[1]);
+        util_split_free(&cmd);
+        return false;
+    }
+    util_split_free(&cmd);
+
+    return true;
+}
+
+bool
+config_bind_apply(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    /* Syntax: bind <mods+key> <action> [args] */
+    if (!keybinds_add(&server->input.keybinds, atom->cmd))
+        return false;
+
+    debug("Applied keybind '%s'", atom->cmd);
+    return true;
+}
+
+bool
+config_idle_apply(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    /* Syntax: idle granularity <ms>
+     *         idle power-off <seconds> */
+    char** cmd = NULL;
+    size_t len_cmd = util_split_delim(atom->cmd, " ", &cmd, false);
+    if (len_cmd != 4 || strcasecmp("idle", cmd[0]) ||
+        (strcasecmp("granularity", cmd[1]) &&
+         strcasecmp("power-off", cmd[1]))) {
+        util_split_free(&cmd);
+        error("Invalid idle config syntax '%s', syntax is 'idle granularity "
+              "<ms>' or 'idle power-off <seconds>'",
+              atom->cmd);
+        return false;
+    }
+
+    char* end = NULL;
+    long value = strtol(cmd[2], &end, 10);
+    if (strcasecmp("granularity", cmd[1]) == 0) {
+        if (*end != '\0' || value < 0 || value > 60000) {
+            util_split_free(&cmd);
+            error("Invalid idle granularity '%s', expected 0-60000 ms",
+                  atom->cmd);
+            return false;
+        }
+        server->idle.granularity_msec = value;
+        info("Idle timers are reset at most every %ld ms", value);
+    } else {
+        if (*end != '\0' || value < 0 || value > 86400) {
+            util_split_free(&cmd);
+            error("Invalid idle power-off '%s', expected 0-86400 s",
+                  atom->cmd);
+            return false;
+        }
+        server->idle.power_off_sec = value;
+        if (value)
+            info("Outputs are turned off after %ld s without input", value);
+    }
+    util_split_free(&cmd);
+
+    return true;
+}
+
+void
+config_output_reset(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    /* Not modesetting back, the mode stays until the output comes again. */
+    info("Output config '%s' is gone, the mode stays until the output is "
+         "replugged",
+         atom->line);
+}
+
+void
+config_input_reset(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    struct bsi_input_config *conf, *conf_tmp;
+    wl_list_for_each_safe(conf, conf_tmp, &server->config.input, link)
+    {
+        if (conf->atom == atom) {
+            wl_list_remove(&conf->link);
+            config_input_destroy(conf);
+        }
+    }
+}
+
+void
+config_workspace_reset(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    server->config.workspaces = 5;
+    info("Workspace count is %ld", server->config.workspaces);
+}
+
+void
+config_wallpaper_reset(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    /* Points into the atom, which is going away. */
+    server->config.wallpaper = "assets/Wallpaper-Default.jpg";
+    info("Wallpaper is '%s'", server->config.wallpaper);
+}
+
+void
+config_cursor_reset(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    server->cursor.motion.coalesce = false;
+    info("Cursor motion coalescing is off");
+}
+
+void
+config_frame_reset(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    char* line = strdup(atom->line);
+    char** cmd = NULL;
+    size_t len_cmd = util_split_delim(line, " ", &cmd, false);
+    if (len_cmd < 3) {
+        util_split_free(&cmd);
+        free(line);
+        return;
+    }
+
+    if (strcasecmp("schedule", cmd[1]) == 0) {
+        server->frame.schedule = BSI_OUTPUT_SCHEDULE_OFF;
+        server->frame.schedule_delay_usec = 0;
+        info("Frame schedule is off");
+    } else if (strcasecmp("throttle_hidden", cmd[1]) == 0) {
+        server->frame.throttle_hz = 1;
+        info("Hidden views get 1 frame callback per second");
+    } else if (strcasecmp("stats", cmd[1]) == 0) {
+        server->stats.enabled = false;
+        info("Frame stats are off for new outputs");
+    } else if (strcasecmp("show_damage", cmd[1]) == 0) {
+        server->overlay.damage = false;
+    } else if (strcasecmp("hud", cmd[1]) == 0) {
+        server->overlay.hud.enabled = false;
+    }
+    util_split_free(&cmd);
+    free(line);
+}
+
+void
+config_bind_reset(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    keybinds_remove(&server->input.keybinds, atom->line);
+    debug("Removed keybind '%s'", atom->line);
+}
+
+void
+config_idle_reset(struct bsi_config_atom* atom, struct bsi_server* server)
+{
+    char* line = strdup(atom->line);
+    char** cmd = NULL;
+    size_t len_cmd = util_split_delim(line, " ", &cmd, false);
+    if (len_cmd < 3) {
+        util_split_free(&cmd);
+        free(line);
+        return;
+    }
+
+    if (strcasecmp("granularity", cmd[1]) == 0) {
+        server->idle.granularity_msec = BSI_IDLE_GRANULARITY_MSEC;
+        info("Idle timers are reset at most every %d ms",
+             BSI_IDLE_GRANULARITY_MSEC);
+    } else if (strcasecmp("power-off", cmd[1]) == 0) {
+        server->idle.power_off_sec = 0;
+        info("Outputs aren't turned off without input");
+    }
+    util_split_free(&cmd);
+    free(line);
+}
@@ -7,7 +7,10 @@
 
 #include "bonsai/config/atom.h"
 #include "bonsai/config/config.h"
+#include "bonsai/desktop/idle.h"
+#include "bonsai/input.h"
 #include "bonsai/log.h"
+#include "bonsai/overlay.h"
 #include "bonsai/server.h"
 
 #define len_fnames 2
@@ -25,13 +28,17 @@ static const char* fallback[] = {
     BSI_PREFIX "/" BSI_SYSCONFDIR "/bonsai/config",
 };
 
-#define len_keywords 4
+#define len_keywords 8
 
 static const char* keywords[] = {
     [BSI_CONFIG_ATOM_OUTPUT] = "output",
     [BSI_CONFIG_ATOM_INPUT] = "input",
     [BSI_CONFIG_ATOM_WORKSPACE] = "workspace",
     [BSI_CONFIG_ATOM_WALLPAPER] = "wallpaper",
+    [BSI_CONFIG_ATOM_CURSOR] = "cursor",
+    [BSI_CONFIG_ATOM_FRAME] = "frame",
+    [BSI_CONFIG_ATOM_BIND] = "bind",
+    [BSI_CONFIG_ATOM_IDLE] = "idle",
 };
 
 static const struct bsi_config_atom_impl* impls[] = {
@@ -39,6 +46,10 @@ static const struct bsi_config_atom_impl* impls[] = {
     [BSI_CONFIG_ATOM_INPUT] = &input_impl,
     [BSI_CONFIG_ATOM_WORKSPACE] = &workspace_impl,
     [BSI_CONFIG_ATOM_WALLPAPER] = &wallpaper_impl,
+    [BSI_CONFIG_ATOM_CURSOR] = &cursor_impl,
+    [BSI_CONFIG_ATOM_FRAME] = &frame_impl,
+    [BSI_CONFIG_ATOM_BIND] = &bind_impl,
+    [BSI_CONFIG_ATOM_IDLE] = &idle_impl,
 };
 
 struct bsi_config*
@@ -127,6 +138,22 @@ config_find(struct bsi_config* config)
     }
 }
 
+bool
+config_add(struct bsi_config* config, const char* line)
+{
+    for (size_t i = 0; i < len_keywords; ++i) {
+        if (strncmp(keywords[i], line, strlen(keywords[i])) == 0) {
+            struct bsi_config_atom* atom =
+                calloc(1, sizeof(struct bsi_config_atom));
+            config_atom_init(atom, i, impls[i], line);
+            wl_list_insert(&config->atoms, &atom->link);
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void
 config_parse(struct bsi_config* config)
 {
@@ -138,10 +165,17 @@ config_parse(struct bsi_config* config)
 
     info("Found config '%s'", config->path);
 
-    FILE* f;
-    if (!(f = fopen(config->path, "r"))) {
-        errn("Failed to open config '%s'", config->path);
+    if (!config_read(config, config->path))
         exit(EXIT_FAILURE);
+}
+
+bool
+config_read(struct bsi_config* config, const char* path)
+{
+    FILE* f;
+    if (!(f = fopen(path, "r"))) {
+        errn("Failed to open config '%s'", path);
+        return false;
     }
 
     size_t len = 0;
@@ -151,22 +185,13 @@ config_parse(struct bsi_config* config)
             /* Skip comments. */
             continue;
         }
-        for (size_t i = 0; i < len_keywords; ++i) {
-            if (strncmp(keywords[i], line, strlen(keywords[i])) == 0) {
-                line[strcspn(line, "\r\n")] = '\0';
-                line[len] = '\0';
-                struct bsi_config_atom* atom =
-                    calloc(1, sizeof(struct bsi_config_atom));
-                config_atom_init(atom, i, impls[i], line);
-                wl_list_insert(&config->atoms, &atom->link);
-                free(line);
-                line = NULL;
-                break;
-            }
-        }
+        line[strcspn(line, "\r\n")] = '\0';
+        config_add(config, line);
     }
 
+    free(line);
     fclose(f);
+    return true;
 }
 
 void
@@ -184,6 +209,10 @@ config_apply(struct bsi_config* config)
             case BSI_CONFIG_ATOM_WALLPAPER:
             case BSI_CONFIG_ATOM_WORKSPACE:
             case BSI_CONFIG_ATOM_INPUT:
+            case BSI_CONFIG_ATOM_CURSOR:
+            case BSI_CONFIG_ATOM_FRAME:
+            case BSI_CONFIG_ATOM_BIND:
+            case BSI_CONFIG_ATOM_IDLE:
                 atom->impl->apply(atom, config->server);
                 ++len_applied;
                 break;
@@ -196,5 +225,101 @@ config_apply(struct bsi_config* config)
     debug("Applied %ld config commands", len_applied);
 }
 
+static struct bsi_config_atom*
+config_atoms_find(struct wl_list* atoms, const char* line)
+{
+    struct bsi_config_atom* atom;
+    wl_list_for_each(atom, atoms, link)
+    {
+        if (strcmp(atom->line, line) == 0)
+            return atom;
+    }
+    return NULL;
+}
+
+/* Brings the running server in line with the settings of the changed atom
+ * types. Settings that are only read when something is created, like the
+ * workspace count, wait for it. */
+static void
+config_reload_sync(struct bsi_server* server, uint32_t changed)
+{
+    if (changed & (1 << BSI_CONFIG_ATOM_INPUT)) {
+        struct bsi_input_device* device;
+        wl_list_for_each(device, &server->input.inputs, link_server)
+        {
+            input_device_configure(device);
+        }
+    }
+    if (changed & (1 << BSI_CONFIG_ATOM_FRAME)) {
+        server_frame_throttle_update(server);
+        overlays_damage_set(server, server->overlay.damage);
+        overlays_hud_set(server, server->overlay.hud.enabled);
+    }
+    if (changed & (1 << BSI_CONFIG_ATOM_IDLE))
+        idle_power_configure(server);
+}
+
+size_t
+config_reload(struct bsi_config* config, struct bsi_config* next)
+{
+    struct bsi_server* server = config->server;
+    size_t len_applied = 0, len_reverted = 0, len_unchanged = 0;
+    uint32_t changed = 0;
+
+    /* Lines in both are left as they are. Configs are a few dozen lines,
+     * comparing every pair is cheap enough. */
+    struct wl_list kept;
+    wl_list_init(&kept);
+    struct bsi_config_atom *atom, *atom_tmp;
+    wl_list_for_each_safe(atom, atom_tmp, &config->atoms, link)
+    {
+        struct bsi_config_atom* same =
+            config_atoms_find(&next->atoms, atom->line);
+        if (same == NULL)
+            continue;
+        wl_list_remove(&same->link);
+        config_atom_destroy(same);
+        wl_list_remove(&atom->link);
+        wl_list_insert(kept.prev, &atom->link);
+        ++len_unchanged;
+    }
+
+    /* Reverted first, so a changed line ends up with its new value. */
+    wl_list_for_each_safe(atom, atom_tmp, &config->atoms, link)
+    {
+        /* A duplicate of a kept line still holds. */
+        if (config_atoms_find(&kept, atom->line) == NULL) {
+            debug("Reverting config '%s'", atom->line);
+            atom->impl->reset(atom, server);
+            changed |= 1 << atom->type;
+            ++len_reverted;
+        }
+        wl_list_remove(&atom->link);
+        config_atom_destroy(atom);
+    }
+    wl_list_insert_list(&config->atoms, &kept);
+
+    wl_list_for_each_safe(atom, atom_tmp, &next->atoms, link)
+    {
+        wl_list_remove(&atom->link);
+        wl_list_insert(config->atoms.prev, &atom->link);
+        /* An output atom only modesets the output it names. */
+        debug("Applying config '%s'", atom->line);
+        atom->impl->apply(atom, server);
+        changed |= 1 << atom->type;
+        ++len_applied;
+    }
+
+    config_reload_sync(server, changed);
+
+    info("Reloaded config '%s', %ld lines applied, %ld reverted, %ld "
+         "unchanged",
+         config->path,
+         len_applied,
+         len_reverted,
+         len_unchanged);
+    return len_applied + len_reverted;
+}
+
 #undef len_config_loc
 #undef len_keywords
@@ -0,0 +1,193 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+
+#include "bonsai/config/atom.h"
+#include "bonsai/config/config.h"
+#include "bonsai/config/watch.h"
+#include "bonsai/log.h"
+#include "bonsai/server.h"
+#include "bonsai/worker.h"
+
+/* The file is read and split into lines by the workers, the event loop only
+ * compares the lines and applies the ones that changed. */
+struct bsi_config_watch_job
+{
+    struct bsi_config_watch* watch; /* NULL once the watch is gone. */
+    char path[255];
+    struct bsi_config config; /* The lines read. */
+    bool read;
+};
+
+static void
+config_watch_job_work(void* data)
+{
+    struct bsi_config_watch_job* job = data;
+    job->read = config_read(&job->config, job->path);
+}
+
+static void
+config_watch_job_free(struct bsi_config_watch_job* job)
+{
+    struct bsi_config_atom *atom, *atom_tmp;
+    wl_list_for_each_safe(atom, atom_tmp, &job->config.atoms, link)
+    {
+        wl_list_remove(&atom->link);
+        config_atom_destroy(atom);
+    }
+    free(job);
+}
+
+static void
+config_watch_job_done(void* data, bool ran)
+{
+    struct bsi_config_watch_job* job = data;
+    struct bsi_config_watch* watch = job->watch;
+    if (watch == NULL || !ran) {
+        if (watch != NULL)
+            watch->job = NULL;
+        config_watch_job_free(job);
+        return;
+    }
+
+    watch->job = NULL;
+    if (job->read) {
+        ++watch->reloads;
+        config_reload(watch->config, &job->config);
+    } else {
+        /* Likely gone for a moment, the editor saving it. */
+        error("Keeping the config as it was");
+    }
+    config_watch_job_free(job);
+
+    if (watch->again) {
+        watch->again = false;
+        wl_event_source_timer_update(watch->settle_timer,
+                                     BSI_CONFIG_WATCH_SETTLE_MSEC);
+    }
+}
+
+static int
+handle_settle_timer(void* data)
+{
+    struct bsi_config_watch* watch = data;
+    if (watch->job != NULL) {
+        /* Read again once this one is applied. */
+        watch->again = true;
+        return 0;
+    }
+
+    struct bsi_config_watch_job* job =
+        calloc(1, sizeof(struct bsi_config_watch_job));
+    if (job == NULL) {
+        errn("Failed to allocate config reload");
+        return 0;
+    }
+    job->watch = watch;
+    memcpy(job->path, watch->config->path, sizeof(job->path));
+    config_init(&job->config, watch->config->server);
+
+    debug("Config '%s' changed, reloading", job->path);
+    watch->job = job;
+    workers_submit(watch->config->server->workers,
+                   config_watch_job_work,
+                   config_watch_job_done,
+                   job);
+    return 0;
+}
+
+static int
+handle_inotify(int fd, uint32_t mask, void* data)
+{
+    struct bsi_config_watch* watch = data;
+
+    char buf[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char* ptr = buf; ptr < buf + len;) {
+            const struct inotify_event* event =
+                (const struct inotify_event*)ptr;
+            /* Anything else in the directory is none of our business. */
+            if (event->len > 0 && strcmp(event->name, watch->name) == 0)
+                changed = true;
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    if (len < 0 && errno != EAGAIN)
+        errn("Failed to read config file events");
+
+    if (changed)
+        wl_event_source_timer_update(watch->settle_timer,
+                                     BSI_CONFIG_WATCH_SETTLE_MSEC);
+    return 0;
+}
+
+struct bsi_config_watch*
+config_watch_create(struct bsi_config* config)
+{
+    struct bsi_config_watch* watch =
+        calloc(1, sizeof(struct bsi_config_watch));
+    if (watch == NULL) {
+        errn("Failed to allocate config watch");
+        return NULL;
+    }
+    watch->config = config;
+
+    const char* slash = strrchr(config->path, '/');
+    if (slash == NULL) {
+        snprintf(watch->dir, sizeof(watch->dir), ".");
+        watch->name = config->path;
+    } else {
+        int len_dir = (slash == config->path) ? 1 : slash - config->path;
+        snprintf(watch->dir, sizeof(watch->dir), "%.*s", len_dir, config->path);
+        watch->name = slash + 1;
+    }
+
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd < 0) {
+        errn("Failed to create config watch");
+        free(watch);
+        return NULL;
+    }
+    /* Saving in place closes the file, saving by rename moves a new one in. */
+    if (inotify_add_watch(watch->fd,
+                          watch->dir,
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        errn("Failed to watch config directory '%s'", watch->dir);
+        close(watch->fd);
+        free(watch);
+        return NULL;
+    }
+
+    struct wl_event_loop* loop =
+        wl_display_get_event_loop(config->server->wl_display);
+    watch->event_source = wl_event_loop_add_fd(
+        loop, watch->fd, WL_EVENT_READABLE, handle_inotify, watch);
+    watch->settle_timer =
+        wl_event_loop_add_timer(loop, handle_settle_timer, watch);
+
+    info("Watching config '%s' for changes", config->path);
+    return watch;
+}
+
+void
+config_watch_destroy(struct bsi_config_watch* watch)
+{
+    debug("Config was reloaded %ld times", watch->reloads);
+
+    if (watch->job != NULL)
+        watch->job->watch = NULL;
+    wl_event_source_remove(watch->settle_timer);
+    wl_event_source_remove(watch->event_source);
+    close(watch->fd);
+    free(watch);
+}
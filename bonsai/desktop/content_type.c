@@ -0,0 +1,202 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/util/addon.h>
+
+#include "bonsai/desktop/content_type.h"
+#include "bonsai/log.h"
+#include "bonsai/server.h"
+#include "bonsai/util.h"
+#include "content-type-v1-protocol.h"
+
+static const struct wp_content_type_v1_interface content_type_impl;
+static const struct wp_content_type_manager_v1_interface manager_impl;
+
+static void
+content_type_destroy(struct bsi_content_type* content_type)
+{
+    if (content_type == NULL)
+        return;
+
+    wlr_addon_finish(&content_type->addon);
+    util_slot_disconnect(&content_type->listen.commit);
+    wl_resource_set_user_data(content_type->resource, NULL);
+    free(content_type);
+}
+
+static struct bsi_content_type*
+content_type_from_resource(struct wl_resource* resource)
+{
+    assert(wl_resource_instance_of(
+        resource, &wp_content_type_v1_interface, &content_type_impl));
+    return wl_resource_get_user_data(resource);
+}
+
+static void
+handle_surface_addon_destroy(struct wlr_addon* addon)
+{
+    /* The surface is going away, the object stays around inert. */
+    struct bsi_content_type* content_type =
+        wl_container_of(addon, content_type, addon);
+    content_type_destroy(content_type);
+}
+
+static const struct wlr_addon_interface surface_addon_impl = {
+    .name = "bsi_content_type",
+    .destroy = handle_surface_addon_destroy,
+};
+
+static void
+handle_surface_commit(struct wl_listener* listener, void* data)
+{
+    struct bsi_content_type* content_type =
+        wl_container_of(listener, content_type, listen.commit);
+    content_type->current = content_type->pending;
+}
+
+/* wp_content_type_v1 */
+static void
+handle_destroy(struct wl_client* client, struct wl_resource* resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static void
+handle_set_content_type(struct wl_client* client,
+                        struct wl_resource* resource,
+                        uint32_t type)
+{
+    struct bsi_content_type* content_type =
+        content_type_from_resource(resource);
+    if (content_type == NULL || type > WP_CONTENT_TYPE_V1_TYPE_GAME)
+        return;
+    content_type->pending = type;
+}
+
+static const struct wp_content_type_v1_interface content_type_impl = {
+    .destroy = handle_destroy,
+    .set_content_type = handle_set_content_type,
+};
+
+static void
+handle_resource_destroy(struct wl_resource* resource)
+{
+    content_type_destroy(content_type_from_resource(resource));
+}
+
+/* wp_content_type_manager_v1 */
+static void
+handle_manager_get_surface_content_type(struct wl_client* client,
+                                        struct wl_resource* resource,
+                                        uint32_t id,
+                                        struct wl_resource* surface_resource)
+{
+    struct bsi_content_type_manager* manager =
+        wl_resource_get_user_data(resource);
+    struct wlr_surface* surface = wlr_surface_from_resource(surface_resource);
+
+    if (wlr_addon_find(&surface->addons, manager, &surface_addon_impl)) {
+        wl_resource_post_error(
+            resource,
+            WP_CONTENT_TYPE_MANAGER_V1_ERROR_ALREADY_CONSTRUCTED,
+            "wl_surface already has a content type object");
+        return;
+    }
+
+    struct bsi_content_type* content_type =
+        calloc(1, sizeof(struct bsi_content_type));
+    if (content_type == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    content_type->resource =
+        wl_resource_create(client,
+                           &wp_content_type_v1_interface,
+                           wl_resource_get_version(resource),
+                           id);
+    if (content_type->resource == NULL) {
+        free(content_type);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    wl_resource_set_implementation(content_type->resource,
+                                   &content_type_impl,
+                                   content_type,
+                                   handle_resource_destroy);
+
+    content_type->manager = manager;
+    content_type->surface = surface;
+    content_type->pending = content_type->current =
+        WP_CONTENT_TYPE_V1_TYPE_NONE;
+    wlr_addon_init(
+        &content_type->addon, &surface->addons, manager, &surface_addon_impl);
+    util_slot_connect(&surface->events.commit,
+                      &content_type->listen.commit,
+                      handle_surface_commit);
+}
+
+static const struct wp_content_type_manager_v1_interface manager_impl = {
+    .destroy = handle_destroy,
+    .get_surface_content_type = handle_manager_get_surface_content_type,
+};
+
+static void
+handle_manager_bind(struct wl_client* client,
+                    void* data,
+                    uint32_t version,
+                    uint32_t id)
+{
+    struct bsi_content_type_manager* manager = data;
+
+    struct wl_resource* resource = wl_resource_create(
+        client, &wp_content_type_manager_v1_interface, version, id);
+    if (resource == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &manager_impl, manager, NULL);
+}
+
+static void
+handle_display_destroy(struct wl_listener* listener, void* data)
+{
+    struct bsi_content_type_manager* manager =
+        wl_container_of(listener, manager, listen.display_destroy);
+    util_slot_disconnect(&manager->listen.display_destroy);
+    wl_global_destroy(manager->global);
+    free(manager);
+}
+
+struct bsi_content_type_manager*
+content_type_manager_create(struct bsi_server* server)
+{
+    struct bsi_content_type_manager* manager =
+        calloc(1, sizeof(struct bsi_content_type_manager));
+    manager->server = server;
+    manager->global = wl_global_create(server->wl_display,
+                                       &wp_content_type_manager_v1_interface,
+                                       1,
+                                       manager,
+                                       handle_manager_bind);
+    manager->listen.display_destroy.notify = handle_display_destroy;
+    wl_display_add_destroy_listener(server->wl_display,
+                                    &manager->listen.display_destroy);
+    return manager;
+}
+
+enum wp_content_type_v1_type
+content_type_get(struct bsi_content_type_manager* manager,
+                 struct wlr_surface* surface)
+{
+    struct wlr_addon* addon =
+        wlr_addon_find(&surface->addons, manager, &surface_addon_impl);
+    if (addon == NULL)
+        return WP_CONTENT_TYPE_V1_TYPE_NONE;
+
+    struct bsi_content_type* content_type =
+        wl_container_of(addon, content_type, addon);
+    return content_type->current;
+}
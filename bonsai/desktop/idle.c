@@ -4,13 +4,20 @@
 #include <wayland-util.h>
 #include <wlr/types/wlr_idle.h>
 #include <wlr/types/wlr_idle_inhibit_v1.h>
+#include <wlr/types/wlr_output.h>
 
 #include "bonsai/desktop/idle.h"
 #include "bonsai/desktop/view.h"
 #include "bonsai/events.h"
 #include "bonsai/log.h"
+#include "bonsai/output.h"
 #include "bonsai/server.h"
+#include "bonsai/stats.h"
 #include "bonsai/util.h"
+#include "ext-idle-notify-v1-protocol.h"
+
+static const struct ext_idle_notification_v1_interface notification_impl;
+static const struct ext_idle_notifier_v1_interface notifier_impl;
 
 struct bsi_idle_inhibitor*
 idle_inhibitor_init(struct bsi_idle_inhibitor* inhibitor,
@@ -116,10 +123,376 @@ handle_idle_manager_new_inhibitor(struct wl_listener* listener, void* data)
     idle_inhibitors_update(server);
 }
 
+/* ext_idle_notification_v1 */
+static uint64_t
+idle_now_msec(void)
+{
+    return stats_now_usec() / 1000;
+}
+
+static void
+notification_arm(struct bsi_idle_notification* notification, uint64_t msec)
+{
+    /* A zero delay would disarm the timer. */
+    wl_event_source_timer_update(notification->timer, msec ? msec : 1);
+}
+
+static int
+handle_notification_timer(void* data)
+{
+    struct bsi_idle_notification* notification = data;
+    struct bsi_server* server = notification->notifier->server;
+    if (notification->idle || server->idle.inhibited)
+        return 0;
+
+    uint64_t idle_msec = idle_now_msec() - server->idle.activity_msec;
+    if (idle_msec < notification->timeout_msec) {
+        /* There was input since it was armed, wait for the rest. */
+        notification_arm(notification, notification->timeout_msec - idle_msec);
+        return 0;
+    }
+
+    notification->idle = true;
+    ++server->idle.idled;
+    ext_idle_notification_v1_send_idled(notification->resource);
+    return 0;
+}
+
+static struct bsi_idle_notification*
+notification_from_resource(struct wl_resource* resource)
+{
+    assert(wl_resource_instance_of(
+        resource, &ext_idle_notification_v1_interface, &notification_impl));
+    return wl_resource_get_user_data(resource);
+}
+
+static void
+handle_notification_destroy(struct wl_client* client,
+                            struct wl_resource* resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static const struct ext_idle_notification_v1_interface notification_impl = {
+    .destroy = handle_notification_destroy,
+};
+
+static void
+handle_notification_resource_destroy(struct wl_resource* resource)
+{
+    struct bsi_idle_notification* notification =
+        notification_from_resource(resource);
+    if (notification == NULL)
+        return;
+
+    if (notification->idle)
+        --notification->notifier->server->idle.idled;
+    wl_event_source_remove(notification->timer);
+    wl_list_remove(&notification->link);
+    free(notification);
+}
+
+/* ext_idle_notifier_v1 */
+static void
+handle_notifier_destroy(struct wl_client* client, struct wl_resource* resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static void
+handle_notifier_get_idle_notification(struct wl_client* client,
+                                      struct wl_resource* resource,
+                                      uint32_t id,
+                                      uint32_t timeout,
+                                      struct wl_resource* seat_resource)
+{
+    struct bsi_idle_notifier* notifier = wl_resource_get_user_data(resource);
+    struct bsi_server* server = notifier->server;
+
+    struct bsi_idle_notification* notification =
+        calloc(1, sizeof(struct bsi_idle_notification));
+    if (notification == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    notification->resource =
+        wl_resource_create(client,
+                           &ext_idle_notification_v1_interface,
+                           wl_resource_get_version(resource),
+                           id);
+    if (notification->resource == NULL) {
+        free(notification);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    notification->timer =
+        wl_event_loop_add_timer(wl_display_get_event_loop(server->wl_display),
+                                handle_notification_timer,
+                                notification);
+    if (notification->timer == NULL) {
+        wl_resource_destroy(notification->resource);
+        free(notification);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    /* There is only one seat, every notification is for it. */
+    notification->notifier = notifier;
+    notification->timeout_msec = timeout;
+    notification->idle = false;
+    wl_list_insert(&notifier->notifications, &notification->link);
+    wl_resource_set_implementation(notification->resource,
+                                   &notification_impl,
+                                   notification,
+                                   handle_notification_resource_destroy);
+
+    /* The timeout starts now, not at the last input. */
+    if (!server->idle.inhibited)
+        notification_arm(notification, timeout);
+}
+
+static const struct ext_idle_notifier_v1_interface notifier_impl = {
+    .destroy = handle_notifier_destroy,
+    .get_idle_notification = handle_notifier_get_idle_notification,
+};
+
+static void
+handle_notifier_bind(struct wl_client* client,
+                     void* data,
+                     uint32_t version,
+                     uint32_t id)
+{
+    struct bsi_idle_notifier* notifier = data;
+
+    struct wl_resource* resource = wl_resource_create(
+        client, &ext_idle_notifier_v1_interface, version, id);
+    if (resource == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &notifier_impl, notifier, NULL);
+}
+
+static void
+handle_display_destroy(struct wl_listener* listener, void* data)
+{
+    struct bsi_idle_notifier* notifier =
+        wl_container_of(listener, notifier, listen.display_destroy);
+    util_slot_disconnect(&notifier->listen.display_destroy);
+    notifier->server->idle.notifier = NULL;
+
+    /* Notifications of clients still around stay inert. */
+    struct bsi_idle_notification *notification, *notification_tmp;
+    wl_list_for_each_safe(
+        notification, notification_tmp, &notifier->notifications, link)
+    {
+        wl_resource_set_user_data(notification->resource, NULL);
+        wl_event_source_remove(notification->timer);
+        wl_list_remove(&notification->link);
+        free(notification);
+    }
+    wl_global_destroy(notifier->global);
+    free(notifier);
+}
+
+struct bsi_idle_notifier*
+idle_notifier_create(struct bsi_server* server)
+{
+    struct bsi_idle_notifier* notifier =
+        calloc(1, sizeof(struct bsi_idle_notifier));
+    notifier->server = server;
+    wl_list_init(&notifier->notifications);
+    notifier->global = wl_global_create(server->wl_display,
+                                        &ext_idle_notifier_v1_interface,
+                                        1,
+                                        notifier,
+                                        handle_notifier_bind);
+    notifier->listen.display_destroy.notify = handle_display_destroy;
+    wl_display_add_destroy_listener(server->wl_display,
+                                    &notifier->listen.display_destroy);
+    return notifier;
+}
+
+/* Idle state */
+static void
+idle_notifications_resume(struct bsi_server* server)
+{
+    server->idle.idled = 0;
+    if (server->idle.notifier == NULL)
+        return;
+
+    struct bsi_idle_notification* notification;
+    wl_list_for_each(
+        notification, &server->idle.notifier->notifications, link)
+    {
+        if (!notification->idle)
+            continue;
+        notification->idle = false;
+        ext_idle_notification_v1_send_resumed(notification->resource);
+        if (!server->idle.inhibited)
+            notification_arm(notification, notification->timeout_msec);
+    }
+}
+
+/* Output power */
+static void
+idle_power_arm(struct bsi_server* server, uint64_t msec)
+{
+    wl_event_source_timer_update(server->idle.power_timer, msec ? msec : 1);
+}
+
+static int
+handle_power_timer(void* data)
+{
+    struct bsi_server* server = data;
+    if (server->idle.powered_off || server->idle.inhibited)
+        return 0;
+
+    uint64_t timeout_msec = (uint64_t)server->idle.power_off_sec * 1000;
+    uint64_t idle_msec = idle_now_msec() - server->idle.activity_msec;
+    if (idle_msec < timeout_msec) {
+        idle_power_arm(server, timeout_msec - idle_msec);
+        return 0;
+    }
+
+    info("Idle for %lu s, turning the outputs off", idle_msec / 1000);
+    server->idle.powered_off = true;
+    ++server->idle.power_offs;
+    struct bsi_output* output;
+    wl_list_for_each(output, &server->output.outputs, link_server)
+    {
+        /* Leave the ones a client turned off to the client. */
+        if (output->output->enabled && output_power_set(output, false))
+            output->power.idle_off = true;
+    }
+    return 0;
+}
+
+static void
+idle_power_wake(struct bsi_server* server)
+{
+    server->idle.powered_off = false;
+    struct bsi_output* output;
+    wl_list_for_each(output, &server->output.outputs, link_server)
+    {
+        if (!output->power.idle_off)
+            continue;
+        output->power.idle_off = false;
+        output_power_set(output, true);
+    }
+    if (!server->idle.inhibited)
+        idle_power_arm(server, (uint64_t)server->idle.power_off_sec * 1000);
+}
+
 void
-handle_idle_activity_notify(struct wl_listener* listener, void* data)
+idle_power_init(struct bsi_server* server)
 {
-    struct bsi_server* server =
-        wl_container_of(listener, server, listen.activity_notify);
-    idle_inhibitors_update(server);
+    server->idle.powered_off = false;
+    server->idle.power_offs = 0;
+    server->idle.power_timer = NULL;
+    idle_power_configure(server);
+}
+
+void
+idle_power_configure(struct bsi_server* server)
+{
+    if (server->idle.power_off_sec == 0) {
+        if (server->idle.power_timer == NULL)
+            return;
+        /* Nothing would turn them on again. */
+        if (server->idle.powered_off)
+            idle_power_wake(server);
+        wl_event_source_remove(server->idle.power_timer);
+        server->idle.power_timer = NULL;
+        return;
+    }
+
+    if (server->idle.power_timer == NULL)
+        server->idle.power_timer = wl_event_loop_add_timer(
+            wl_display_get_event_loop(server->wl_display),
+            handle_power_timer,
+            server);
+    if (server->idle.powered_off || server->idle.inhibited)
+        return;
+
+    /* The time already spent idle counts. */
+    uint64_t timeout_msec = (uint64_t)server->idle.power_off_sec * 1000;
+    uint64_t idle_msec = idle_now_msec() - server->idle.activity_msec;
+    idle_power_arm(server,
+                   idle_msec < timeout_msec ? timeout_msec - idle_msec : 0);
+}
+
+/* No longer than the shortest legacy timer either, so that one that went idle
+ * resumes on the next input. */
+static uint64_t
+idle_legacy_interval(struct bsi_server* server)
+{
+    uint64_t interval_msec = server->idle.granularity_msec;
+    struct wlr_idle_timeout* timeout;
+    wl_list_for_each(timeout, &server->wlr_idle->idle_timers, link)
+    {
+        if (timeout->timeout < interval_msec)
+            interval_msec = timeout->timeout;
+    }
+    return interval_msec;
+}
+
+void
+idle_activity_notify(struct bsi_server* server)
+{
+    uint64_t now_msec = idle_now_msec();
+    server->idle.activity_msec = now_msec;
+    ++server->idle.activity;
+
+    if (server->idle.idled > 0)
+        idle_notifications_resume(server);
+    if (server->idle.powered_off)
+        idle_power_wake(server);
+
+    /* Resetting them rearms a timer per legacy client, not on every event. */
+    if (now_msec - server->idle.reset_msec < server->idle.reset_interval_msec)
+        return;
+    server->idle.reset_msec = now_msec;
+    server->idle.reset_interval_msec = idle_legacy_interval(server);
+    ++server->idle.resets;
+    wlr_idle_notify_activity(server->wlr_idle, server->wlr_seat);
+}
+
+void
+idle_set_inhibited(struct bsi_server* server, bool inhibited)
+{
+    if (server->idle.inhibited == inhibited)
+        return;
+
+    debug("Idle is %s", inhibited ? "inhibited" : "no longer inhibited");
+    server->idle.inhibited = inhibited;
+    /* Both globals go away with the display, views hidden while outputs are
+     * destroyed after that land here too. */
+    if (server->idle.notifier == NULL)
+        return;
+
+    wlr_idle_set_enabled(server->wlr_idle, NULL, !inhibited);
+    /* The timeouts start over once nothing inhibits them. */
+    if (!inhibited)
+        server->idle.activity_msec = idle_now_msec();
+
+    /* Outputs that are already off stay off until there is input. */
+    if (server->idle.power_timer && !server->idle.powered_off) {
+        if (inhibited)
+            wl_event_source_timer_update(server->idle.power_timer, 0);
+        else
+            idle_power_arm(server,
+                           (uint64_t)server->idle.power_off_sec * 1000);
+    }
+
+    struct bsi_idle_notification* notification;
+    wl_list_for_each(
+        notification, &server->idle.notifier->notifications, link)
+    {
+        if (inhibited)
+            wl_event_source_timer_update(notification->timer, 0);
+        else if (!notification->idle)
+            notification_arm(notification, notification->timeout_msec);
+    }
 }
@@ -8,7 +8,6 @@
 #include <wayland-util.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_cursor.h>
-#include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_region.h>
 #include <wlr/types/wlr_subcompositor.h>
@@ -126,6 +125,64 @@ layer_surface_focus(struct bsi_layer_surface_toplevel* toplevel)
                                    &keyboard->modifiers);
 }
 
+uint32_t
+layer_surface_state_diff(struct bsi_layer_surface_toplevel* toplevel)
+{
+    struct wlr_layer_surface_v1_state* old = &toplevel->arranged;
+    struct wlr_layer_surface_v1_state* new = &toplevel->layer_surface->current;
+
+    /* Clients tend to resend the same state on every commit, so the committed
+     * bits alone are not enough to know if anything changed. */
+    uint32_t dirty = BSI_LAYER_DIRTY_NONE;
+    if (old->desired_width != new->desired_width ||
+        old->desired_height != new->desired_height)
+        dirty |= BSI_LAYER_DIRTY_SIZE;
+    if (old->anchor != new->anchor)
+        dirty |= BSI_LAYER_DIRTY_ANCHOR;
+    if (old->margin.top != new->margin.top ||
+        old->margin.right != new->margin.right ||
+        old->margin.bottom != new->margin.bottom ||
+        old->margin.left != new->margin.left)
+        dirty |= BSI_LAYER_DIRTY_MARGIN;
+    if (old->exclusive_zone != new->exclusive_zone)
+        dirty |= BSI_LAYER_DIRTY_EXCLUSIVE;
+    if (toplevel->at_layer != new->layer)
+        dirty |= BSI_LAYER_DIRTY_LAYER;
+    if (old->keyboard_interactive != new->keyboard_interactive)
+        dirty |= BSI_LAYER_DIRTY_KEYBOARD;
+
+    return dirty;
+}
+
+void
+layer_surface_mark_dirty(struct bsi_layer_surface_toplevel* toplevel,
+                         uint32_t dirty)
+{
+    if (dirty == BSI_LAYER_DIRTY_NONE)
+        return;
+
+    struct bsi_output* output = toplevel->output;
+    toplevel->dirty |= dirty;
+    output->arrange.layers |= 1 << toplevel->at_layer;
+
+    uint32_t output_dirty = BSI_OUTPUT_DIRTY_LAYERS;
+    /* Surfaces with an exclusive zone shrink the usable area of the output, so
+     * any change to their geometry means everything has to be redone. */
+    const bool exclusive =
+        toplevel->layer_surface->current.exclusive_zone > 0 ||
+        toplevel->arranged.exclusive_zone > 0;
+    if ((dirty & BSI_LAYER_DIRTY_EXCLUSIVE) ||
+        (exclusive &&
+         (dirty & (BSI_LAYER_DIRTY_SIZE | BSI_LAYER_DIRTY_ANCHOR |
+                   BSI_LAYER_DIRTY_MARGIN | BSI_LAYER_DIRTY_MAP))))
+        output_dirty |= BSI_OUTPUT_DIRTY_EXCLUSIVE;
+    if (dirty & (BSI_LAYER_DIRTY_LAYER | BSI_LAYER_DIRTY_KEYBOARD |
+                 BSI_LAYER_DIRTY_MAP))
+        output_dirty |= BSI_OUTPUT_DIRTY_STACKING;
+
+    output_arrange_mark(output, output_dirty);
+}
+
 void
 layer_surface_destroy(union bsi_layer_surface layer_surface,
                       enum bsi_layer_surface_type type)
@@ -164,7 +221,6 @@ layer_surface_destroy(union bsi_layer_surface layer_surface,
             wl_list_remove(&popup->listen.new_popup.link);
             wl_list_remove(&popup->listen.map.link);
             wl_list_remove(&popup->listen.unmap.link);
-            wl_list_remove(&popup->listen.commit.link);
             free(popup);
             break;
         }
@@ -188,18 +244,10 @@ layer_move(struct bsi_layer_surface_toplevel* toplevel,
 {
     wl_list_remove(&toplevel->link_output);
     wl_list_insert(&output->layers[to_layer], &toplevel->link_output);
+    toplevel->at_layer = to_layer;
 }
 
 /* Handlers */
-/**
- * On map and unmap events, the entire output surface should always be damaged.
- * On commit events, only the surface of the layer should be damaged.
- *
- * Kinda makes sense, we don't want to waste CPU time updating the surface of
- * the entire output, if a surface is already mapped, so only update that
- * surface area.
- *
- */
 /*
  * bsi_layer_surface_subsurface
  */
@@ -215,7 +263,6 @@ handle_subsurface_map(struct wl_listener* listener, void* data)
 
     wlr_surface_send_enter(layer_subsurface->subsurface->surface,
                            output->output);
-    output_surface_damage(output, NULL, true);
 }
 
 static void
@@ -234,11 +281,6 @@ handle_subsurface_unmap(struct wl_listener* listener, void* data)
     if (wlr_seat_pointer_surface_has_focus(
             output->server->wlr_seat, layer_subsurface->subsurface->surface))
         wlr_seat_pointer_notify_clear_focus(output->server->wlr_seat);
-
-    if (output->destroying)
-        return;
-
-    output_surface_damage(output, NULL, true);
 }
 
 static void
@@ -259,25 +301,6 @@ handle_subsurface_destroy(struct wl_listener* listener, void* data)
 
     wl_list_remove(&layer_subsurface->link);
     layer_surface_destroy(layer_surface, BSI_LAYER_SURFACE_SUBSURFACE);
-
-    if (toplevel_parent->output->destroying)
-        return;
-
-    output_surface_damage(toplevel_parent->output, NULL, true);
-}
-
-/* wlr_surface -> subsurface::surface */
-
-static void
-handle_subsurface_commit(struct wl_listener* listener, void* data)
-{
-    debug("Got event commit from bsi_layer_surface_subsurface");
-
-    struct bsi_layer_surface_subsurface* layer_subsurface =
-        wl_container_of(listener, layer_subsurface, listen.commit);
-    struct bsi_output* output = layer_subsurface->member_of->output;
-
-    output_surface_damage(output, layer_subsurface->subsurface->surface, false);
 }
 
 /*
@@ -298,8 +321,6 @@ handle_popup_map(struct wl_listener* listener, void* data)
     struct bsi_output* output = toplevel_parent->output;
 
     wlr_surface_send_enter(layer_popup->popup->base->surface, output->output);
-
-    output_surface_damage(output, NULL, true);
 }
 
 static void
@@ -322,11 +343,6 @@ handle_popup_unmap(struct wl_listener* listener, void* data)
     if (wlr_seat_pointer_surface_has_focus(output->server->wlr_seat,
                                            layer_popup->popup->base->surface))
         wlr_seat_pointer_notify_clear_focus(output->server->wlr_seat);
-
-    if (output->destroying)
-        return;
-
-    output_surface_damage(output, NULL, true);
 }
 
 static void
@@ -346,28 +362,6 @@ handle_popup_destroy(struct wl_listener* listener, void* data)
         return;
 
     layer_surface_destroy(layer_surface, BSI_LAYER_SURFACE_POPUP);
-
-    if (toplevel_parent->output->destroying)
-        return;
-
-    output_surface_damage(toplevel_parent->output, NULL, true);
-}
-
-/* wlr_xdg_surface -> popup::base::surface */
-static void
-handle_popup_commit(struct wl_listener* listener, void* data)
-{
-    debug("Got event commit from bsi_layer_surface_popup");
-
-    struct bsi_layer_surface_popup* layer_popup =
-        wl_container_of(listener, layer_popup, listen.commit);
-    union bsi_layer_surface layer_surface = { .popup = layer_popup };
-    struct bsi_layer_surface_toplevel* toplevel_parent =
-        layer_surface_get_toplevel_parent(layer_surface,
-                                          BSI_LAYER_SURFACE_POPUP);
-    struct bsi_output* output = toplevel_parent->output;
-
-    output_surface_damage(output, layer_popup->popup->base->surface, false);
 }
 
 /* wlr_xdg_surface -> popup::base */
@@ -398,9 +392,6 @@ handle_popup_new_popup(struct wl_listener* listener, void* data)
     util_slot_connect(&xdg_popup->base->events.new_popup,
                       &layer_popup->listen.new_popup,
                       handle_popup_new_popup);
-    util_slot_connect(&xdg_popup->base->surface->events.commit,
-                      &layer_popup->listen.commit,
-                      handle_popup_commit);
 
     /* Unconstrain popup to its largest parent box. */
     union bsi_layer_surface layer_surface = { .popup = layer_popup };
@@ -431,9 +422,13 @@ handle_map(struct wl_listener* listener, void* data)
         wl_container_of(listener, layer_toplevel, listen.map);
     struct bsi_output* output = layer_toplevel->output;
 
+    /* The scene shows it on map, it stays hidden while locked. */
+    if (output->server->session.locked)
+        wlr_scene_node_set_enabled(&layer_toplevel->scene_node->tree->node,
+                                   false);
+
     wlr_surface_send_enter(layer_toplevel->layer_surface->surface,
                            output->output);
-    output_surface_damage(output, NULL, true);
 }
 
 static void
@@ -453,11 +448,6 @@ handle_unmap(struct wl_listener* listener, void* data)
             output->server->wlr_seat, layer_toplevel->layer_surface->surface))
         wlr_seat_pointer_notify_clear_focus(
             layer_toplevel->output->server->wlr_seat);
-
-    if (output->destroying)
-        return;
-
-    output_surface_damage(output, NULL, true);
 }
 
 static void
@@ -476,12 +466,14 @@ handle_destroy(struct wl_listener* listener, void* data)
     if (output->destroying)
         return;
 
-    /* Destroy the layer and rearrange this output. */
+    /* Destroy the layer and rearrange this output, only an exclusive zone
+     * going away frees up area for the others. */
+    if (layer_toplevel->arranged.exclusive_zone > 0)
+        output_arrange_mark(output, BSI_OUTPUT_DIRTY_EXCLUSIVE);
     union bsi_layer_surface layer_surface = { .toplevel = layer_toplevel };
     layers_remove(layer_toplevel);
     layer_surface_destroy(layer_surface, BSI_LAYER_SURFACE_TOPLEVEL);
     output_layers_arrange(output);
-    output_surface_damage(output, NULL, true);
 }
 
 static void
@@ -511,9 +503,6 @@ handle_new_popup(struct wl_listener* listener, void* data)
     util_slot_connect(&xdg_popup->base->events.new_popup,
                       &layer_popup->listen.new_popup,
                       handle_popup_new_popup);
-    util_slot_connect(&xdg_popup->base->surface->events.commit,
-                      &layer_popup->listen.commit,
-                      handle_popup_commit);
 
     /* Unconstrain popup to its largest parent box. */
     struct wlr_box toplevel_parent_box = {
@@ -540,21 +529,25 @@ handle_commit(struct wl_listener* listener, void* data)
     debug("Toplevel namespace is '%s'",
           layer_toplevel->layer_surface->namespace);
 
-    bool to_another_layer = false;
-    if (layer_toplevel->layer_surface->current.committed != 0 ||
-        layer_toplevel->mapped != layer_toplevel->layer_surface->mapped) {
+    uint32_t dirty = BSI_LAYER_DIRTY_NONE;
+    if (layer_toplevel->layer_surface->current.committed != 0)
+        dirty |= layer_surface_state_diff(layer_toplevel);
+    if (layer_toplevel->mapped != layer_toplevel->layer_surface->mapped) {
         layer_toplevel->mapped = layer_toplevel->layer_surface->mapped;
-        to_another_layer = layer_toplevel->at_layer !=
-                           layer_toplevel->layer_surface->current.layer;
-        if (to_another_layer)
+        dirty |= BSI_LAYER_DIRTY_MAP;
+    }
+
+    if (dirty != BSI_LAYER_DIRTY_NONE) {
+        if (dirty & BSI_LAYER_DIRTY_LAYER) {
+            /* Mark the old layer as well, the order there changes too. */
+            output->arrange.layers |= 1 << layer_toplevel->at_layer;
             layer_move(layer_toplevel,
                        output,
                        layer_toplevel->layer_surface->current.layer);
-        output_layers_arrange(output);
+        }
+        layer_surface_mark_dirty(layer_toplevel, dirty);
     }
-
-    output_surface_damage(
-        layer_toplevel->output, layer_toplevel->layer_surface->surface, false);
+    output_layers_arrange(output);
 }
 
 static void
@@ -581,9 +574,6 @@ handle_new_subsurface(struct wl_listener* listener, void* data)
     util_slot_connect(&wlr_subsurface->events.destroy,
                       &layer_subsurface->listen.destroy,
                       handle_subsurface_destroy);
-    util_slot_connect(&wlr_subsurface->surface->events.commit,
-                      &layer_subsurface->listen.commit,
-                      handle_subsurface_commit);
 }
 
 void
@@ -652,6 +642,7 @@ handle_layer_shell_new_surface(struct wl_listener* listener, void* data)
                       handle_commit);
 
     layers_add(active_output, layer);
+    layer_surface_mark_dirty(layer, BSI_LAYER_DIRTY_ALL);
 
     /* Overwrite the current state with pending, so we can look up the
      * desired state when arrangeing the surfaces. Then restore state for
@@ -1,12 +1,16 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <wayland-util.h>
+#include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_session_lock_v1.h>
+#include <wlr/util/box.h>
 
+#include "bonsai/desktop/layers.h"
 #include "bonsai/desktop/lock.h"
 #include "bonsai/events.h"
 #include "bonsai/input.h"
+#include "bonsai/input/cursor.h"
 #include "bonsai/log.h"
 #include "bonsai/output.h"
 #include "bonsai/util.h"
@@ -19,6 +23,7 @@ session_lock_init(struct bsi_session_lock* lock,
     lock->lock = wlr_lock;
     lock->server = server;
     lock->tree = wlr_scene_tree_create(&server->wlr_scene->tree);
+    lock->blank = NULL;
     wl_list_init(&lock->surfaces);
     return lock;
 }
@@ -29,9 +34,70 @@ session_lock_destroy(struct bsi_session_lock* lock)
     wl_list_remove(&lock->listen.new_surface.link);
     wl_list_remove(&lock->listen.unlock.link);
     wl_list_remove(&lock->listen.destroy.link);
+    wlr_scene_node_destroy(&lock->tree->node);
     free(lock);
 }
 
+void
+session_lock_blank_update(struct bsi_server* server)
+{
+    static const float color[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    /* The blank of a lock goes under its surfaces, one left behind by a dead
+     * lock client goes on top of everything. */
+    struct bsi_session_lock* lock = server->session.lock;
+    struct wlr_scene_tree** blank =
+        (lock) ? &lock->blank : &server->session.blank;
+    struct wlr_scene_tree* parent =
+        (lock) ? lock->tree : &server->wlr_scene->tree;
+
+    if (*blank)
+        wlr_scene_node_destroy(&(*blank)->node);
+    *blank = wlr_scene_tree_create(parent);
+    if (lock)
+        wlr_scene_node_lower_to_bottom(&(*blank)->node);
+    else
+        wlr_scene_node_raise_to_top(&(*blank)->node);
+
+    struct bsi_output* output;
+    wl_list_for_each(output, &server->output.outputs, link_server)
+    {
+        struct wlr_box box;
+        wlr_output_layout_get_box(
+            server->wlr_output_layout, output->output, &box);
+        if (wlr_box_empty(&box))
+            continue;
+        struct wlr_scene_rect* rect =
+            wlr_scene_rect_create(*blank, box.width, box.height, color);
+        wlr_scene_node_set_position(&rect->node, box.x, box.y);
+    }
+}
+
+void
+session_lock_scene_hide(struct bsi_server* server, bool hidden)
+{
+    /* Views and their workspaces keep their own state, only the output trees
+     * above them are toggled. The overlays sit above the lock, they would
+     * show what they sample of the session. */
+    wlr_scene_node_set_enabled(&server->overlay.tree->node, !hidden);
+
+    struct bsi_output* output;
+    wl_list_for_each(output, &server->output.outputs, link_server)
+    {
+        wlr_scene_node_set_enabled(&output->tree->node, !hidden);
+        for (size_t i = 0; i < 4; ++i) {
+            struct bsi_layer_surface_toplevel* toplevel;
+            wl_list_for_each(toplevel, &output->layers[i], link_output)
+            {
+                wlr_scene_node_set_enabled(
+                    &toplevel->scene_node->tree->node,
+                    !hidden && toplevel->layer_surface->mapped);
+            }
+        }
+    }
+    cursor_scene_invalidate(server);
+}
+
 struct bsi_session_lock_surface*
 session_lock_surface_init(struct bsi_session_lock_surface* surface,
                           struct bsi_session_lock* lock,
@@ -48,7 +114,6 @@ session_lock_surface_destroy(struct bsi_session_lock_surface* surface)
 {
     wl_list_remove(&surface->listen.map.link);
     wl_list_remove(&surface->listen.destroy.link);
-    wl_list_remove(&surface->listen.surface_commit.link);
     wl_list_remove(&surface->listen.mode.link);
     wl_list_remove(&surface->listen.output_commit.link);
     free(surface);
@@ -84,12 +149,6 @@ handle_surface_map(struct wl_listener* listener, void* data)
                 break;
         }
     }
-
-    struct bsi_output* output;
-    wl_list_for_each(output, &server->output.outputs, link_server)
-    {
-        output_surface_damage(output, NULL, true);
-    }
 }
 
 static void
@@ -102,20 +161,6 @@ handle_surface_destroy(struct wl_listener* listener, void* data)
     session_lock_surface_destroy(lock_surface);
 }
 
-static void
-handle_surface_commit(struct wl_listener* listener, void* data)
-{
-    struct bsi_session_lock_surface* lock_surface =
-        wl_container_of(listener, lock_surface, listen.surface_commit);
-    struct bsi_server* server = lock_surface->lock->server;
-
-    struct bsi_output* output;
-    wl_list_for_each(output, &server->output.outputs, link_server)
-    {
-        output_surface_damage(output, NULL, true);
-    }
-}
-
 static void
 handle_output_mode(struct wl_listener* listener, void* data)
 {
@@ -153,7 +198,6 @@ handle_new_surface(struct wl_listener* listener, void* data)
     struct bsi_session_lock* lock =
         wl_container_of(listener, lock, listen.new_surface);
     struct wlr_session_lock_surface_v1* surface = data;
-    struct bsi_server* server = lock->server;
 
     struct bsi_session_lock_surface* lock_surface =
         calloc(1, sizeof(struct bsi_session_lock_surface));
@@ -164,9 +208,6 @@ handle_new_surface(struct wl_listener* listener, void* data)
     util_slot_connect(&surface->events.destroy,
                       &lock_surface->listen.destroy,
                       handle_surface_destroy);
-    util_slot_connect(&surface->surface->events.commit,
-                      &lock_surface->listen.surface_commit,
-                      handle_surface_commit);
     util_slot_connect(&surface->output->events.mode,
                       &lock_surface->listen.mode,
                       handle_output_mode);
@@ -180,12 +221,6 @@ handle_new_surface(struct wl_listener* listener, void* data)
 
     wlr_session_lock_surface_v1_configure(
         surface, surface->output->width, surface->output->height);
-
-    struct bsi_output* output;
-    wl_list_for_each(output, &server->output.outputs, link_server)
-    {
-        output_surface_damage(output, NULL, true);
-    }
 }
 
 static void
@@ -200,11 +235,9 @@ handle_unlock(struct wl_listener* listener, void* data)
     server->session.locked = false;
     info("Session unlocked");
 
-    struct bsi_output* output;
-    wl_list_for_each(output, &server->output.outputs, link_server)
-    {
-        output_surface_damage(output, NULL, true);
-    }
+    /* Everything comes back as it was, the clients were never told. */
+    wlr_scene_node_set_enabled(&lock->tree->node, false);
+    session_lock_scene_hide(server, false);
 }
 
 static void
@@ -216,14 +249,15 @@ handle_destroy(struct wl_listener* listener, void* data)
         wl_container_of(listener, lock, listen.destroy);
     struct bsi_server* server = lock->server;
 
+    /* A lock client that goes away without unlocking leaves the session
+     * locked, with the blank up until a new lock comes. */
     server->session.lock = NULL;
-    session_lock_destroy(lock);
-
-    struct bsi_output* output;
-    wl_list_for_each(output, &server->output.outputs, link_server)
-    {
-        output_surface_damage(output, NULL, true);
+    if (server->session.locked) {
+        error("Session lock destroyed while locked, staying locked");
+        session_lock_blank_update(server);
     }
+    session_lock_destroy(lock);
+    cursor_scene_invalidate(server);
 }
 
 /* Global server handlers. */
@@ -258,11 +292,17 @@ handle_session_lock_manager_new_lock(struct wl_listener* listener, void* data)
 
     server->session.lock = session_lock;
 
-    wlr_session_lock_v1_send_locked(session_lock->lock);
-
-    struct bsi_output* output;
-    wl_list_for_each(output, &server->output.outputs, link_server)
-    {
-        output_surface_damage(output, NULL, true);
+    /* A new lock client takes over from one that died while locked. */
+    if (server->session.blank) {
+        wlr_scene_node_destroy(&server->session.blank->node);
+        server->session.blank = NULL;
     }
+
+    /* Blank in the next frame, without waiting on the lock client. */
+    wlr_scene_node_raise_to_top(&session_lock->tree->node);
+    session_lock_blank_update(server);
+    session_lock_scene_hide(server, true);
+
+    /* Nothing of the session can be seen anymore. */
+    wlr_session_lock_v1_send_locked(session_lock->lock);
 }
@@ -0,0 +1,275 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#include "bonsai/desktop/transaction.h"
+#include "bonsai/desktop/view.h"
+#include "bonsai/input/cursor.h"
+#include "bonsai/log.h"
+#include "bonsai/server.h"
+#include "bonsai/util.h"
+
+static void
+transaction_view_destroy(struct bsi_transaction_view* tview)
+{
+    if (tview->snapshot) {
+        util_slot_disconnect(&tview->listen.ack_configure);
+        util_slot_disconnect(&tview->listen.commit);
+        wlr_scene_node_destroy(&tview->snapshot->node);
+    }
+    tview->view->transaction = NULL;
+    wl_list_remove(&tview->link);
+    free(tview);
+}
+
+static void
+transaction_view_ready(struct bsi_transaction_view* tview)
+{
+    struct bsi_transaction* transaction = tview->transaction;
+
+    if (tview->ready)
+        return;
+    tview->ready = true;
+
+    if (transaction->committed && --transaction->waiting == 0)
+        transaction_apply(transaction);
+}
+
+static void
+snapshot_buffer(struct wlr_scene_buffer* scene_buffer,
+                int sx,
+                int sy,
+                void* user_data)
+{
+    struct bsi_transaction_view* tview = user_data;
+    struct wlr_scene_node* node = &tview->view->tree->node;
+
+    if (scene_buffer->buffer == NULL)
+        return;
+
+    struct wlr_scene_buffer* copy =
+        wlr_scene_buffer_create(tview->snapshot, scene_buffer->buffer);
+    if (copy == NULL)
+        return;
+
+    /* Coordinates are relative to the parent of the view tree. */
+    wlr_scene_node_set_position(&copy->node, sx - node->x, sy - node->y);
+    wlr_scene_buffer_set_dest_size(
+        copy, scene_buffer->dst_width, scene_buffer->dst_height);
+    wlr_scene_buffer_set_source_box(copy, &scene_buffer->src_box);
+    wlr_scene_buffer_set_transform(copy, scene_buffer->transform);
+}
+
+static void
+transaction_view_snapshot(struct bsi_transaction_view* tview)
+{
+    struct wlr_scene_node* node = &tview->view->tree->node;
+
+    /* The snapshot takes the place of the view in the stack, the view itself
+     * stays hidden until the transaction applies. */
+    tview->snapshot = wlr_scene_tree_create(node->parent);
+    wlr_scene_node_set_position(&tview->snapshot->node, node->x, node->y);
+    wlr_scene_node_for_each_buffer(node, snapshot_buffer, tview);
+    wlr_scene_node_place_above(&tview->snapshot->node, node);
+    wlr_scene_node_set_enabled(node, false);
+}
+
+static void
+handle_ack_configure(struct wl_listener* listener, void* data)
+{
+    struct bsi_transaction_view* tview =
+        wl_container_of(listener, tview, listen.ack_configure);
+    struct wlr_xdg_surface_configure* configure = data;
+
+    if ((int32_t)(configure->serial - tview->serial) >= 0)
+        tview->acked = true;
+}
+
+static void
+handle_commit(struct wl_listener* listener, void* data)
+{
+    struct bsi_transaction_view* tview =
+        wl_container_of(listener, tview, listen.commit);
+
+    /* The first commit after the ack carries the new state. */
+    if (tview->acked)
+        transaction_view_ready(tview);
+}
+
+static int
+handle_timeout(void* data)
+{
+    struct bsi_transaction* transaction = data;
+
+    info("Transaction timed out with %ld views waiting", transaction->waiting);
+    ++transaction->server->scene.transaction.timed_out;
+    transaction_apply(transaction);
+    return 0;
+}
+
+static void
+transaction_commit(struct bsi_transaction* transaction)
+{
+    struct bsi_server* server = transaction->server;
+
+    transaction->committed = true;
+    wl_list_insert(&server->scene.transaction.running,
+                   &transaction->link_server);
+
+    struct bsi_transaction_view* tview;
+    wl_list_for_each(tview, &transaction->views, link)
+    {
+        struct bsi_view* view = tview->view;
+        struct wlr_xdg_surface* xdg_surface = view->wlr_xdg_toplevel->base;
+
+        /* The position waits for the transaction, the rest goes out now. */
+        if (view->pending.fields & BSI_VIEW_PENDING_POSITION) {
+            tview->has_position = true;
+            tview->x = view->pending.x;
+            tview->y = view->pending.y;
+            view->pending.fields &= ~BSI_VIEW_PENDING_POSITION;
+        }
+        view_pending_flush(view);
+
+        /* Nothing visible to keep in sync, or no configure went out. */
+        if (!view->mapped || !view->tree->node.enabled ||
+            xdg_surface->configure_idle == NULL) {
+            tview->ready = true;
+            continue;
+        }
+
+        tview->serial = xdg_surface->scheduled_serial;
+        transaction_view_snapshot(tview);
+        util_slot_connect(&xdg_surface->events.ack_configure,
+                          &tview->listen.ack_configure,
+                          handle_ack_configure);
+        util_slot_connect(&xdg_surface->surface->events.commit,
+                          &tview->listen.commit,
+                          handle_commit);
+        ++transaction->waiting;
+    }
+
+    debug("Committed transaction with %d views, %ld waiting",
+          wl_list_length(&transaction->views),
+          transaction->waiting);
+
+    if (transaction->waiting == 0) {
+        transaction_apply(transaction);
+        return;
+    }
+
+    struct wl_event_loop* loop = wl_display_get_event_loop(server->wl_display);
+    transaction->timeout =
+        wl_event_loop_add_timer(loop, handle_timeout, transaction);
+    wl_event_source_timer_update(transaction->timeout,
+                                 BSI_TRANSACTION_TIMEOUT_MS);
+}
+
+void
+transaction_begin(struct bsi_server* server)
+{
+    if (server->scene.transaction.depth++ > 0)
+        return;
+
+    struct bsi_transaction* transaction =
+        calloc(1, sizeof(struct bsi_transaction));
+    transaction->server = server;
+    wl_list_init(&transaction->views);
+    wl_list_init(&transaction->link_server);
+    server->scene.transaction.open = transaction;
+}
+
+void
+transaction_end(struct bsi_server* server)
+{
+    assert(server->scene.transaction.depth > 0);
+    if (--server->scene.transaction.depth > 0)
+        return;
+
+    struct bsi_transaction* transaction = server->scene.transaction.open;
+    server->scene.transaction.open = NULL;
+
+    if (wl_list_empty(&transaction->views)) {
+        free(transaction);
+        return;
+    }
+
+    ++server->scene.transaction.committed;
+    transaction_commit(transaction);
+}
+
+bool
+transaction_view_add(struct bsi_server* server, struct bsi_view* view)
+{
+    struct bsi_transaction* open = server->scene.transaction.open;
+
+    if (view->transaction && view->transaction->transaction == open)
+        return open != NULL;
+
+    /* New state for a view that is still waiting, get the old state out of
+     * the way first. */
+    transaction_view_flush(view);
+
+    if (open == NULL)
+        return false;
+
+    struct bsi_transaction_view* tview =
+        calloc(1, sizeof(struct bsi_transaction_view));
+    tview->transaction = open;
+    tview->view = view;
+    wl_list_insert(open->views.prev, &tview->link);
+    view->transaction = tview;
+    return true;
+}
+
+void
+transaction_view_flush(struct bsi_view* view)
+{
+    if (view->transaction && view->transaction->transaction->committed)
+        transaction_apply(view->transaction->transaction);
+}
+
+void
+transaction_view_remove(struct bsi_view* view)
+{
+    struct bsi_transaction_view* tview = view->transaction;
+    if (tview == NULL)
+        return;
+
+    struct bsi_transaction* transaction = tview->transaction;
+    bool waiting = transaction->committed && !tview->ready;
+    transaction_view_destroy(tview);
+
+    if (waiting && --transaction->waiting == 0)
+        transaction_apply(transaction);
+}
+
+void
+transaction_apply(struct bsi_transaction* transaction)
+{
+    struct bsi_server* server = transaction->server;
+
+    struct bsi_transaction_view *tview, *tview_tmp;
+    wl_list_for_each_safe(tview, tview_tmp, &transaction->views, link)
+    {
+        struct bsi_view* view = tview->view;
+        if (tview->has_position)
+            wlr_scene_node_set_position(&view->tree->node, tview->x, tview->y);
+        if (tview->snapshot)
+            wlr_scene_node_set_enabled(&view->tree->node,
+                                       tview->snapshot->node.enabled);
+        transaction_view_destroy(tview);
+    }
+
+    if (transaction->timeout)
+        wl_event_source_remove(transaction->timeout);
+    wl_list_remove(&transaction->link_server);
+    free(transaction);
+
+    cursor_scene_invalidate(server);
+    /* Views may have been shown or hidden. */
+    idle_inhibitors_update(server);
+}
@@ -1,7 +1,14 @@
 #include <stdlib.h>
+#include <wayland-server-core.h>
 #include <wayland-util.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
 
 #include "bonsai/desktop/view.h"
+#include "bonsai/input/cursor.h"
+#include "bonsai/log.h"
+#include "bonsai/output.h"
+#include "bonsai/server.h"
 
 struct bsi_view*
 view_init(struct bsi_view* view,
@@ -14,15 +21,30 @@ view_init(struct bsi_view* view,
     view->server = server;
     view->workspace = NULL;
     view->mapped = false;
+    view->frame_early = false;
     view->tree = NULL;
     view->inhibit.fullscreen = NULL;
     view->state = BSI_VIEW_STATE_NORMAL;
+    view->resize.serial = 0;
+    view->resize.pending = false;
+    view->resize.sent = view->resize.superseded = 0;
+    view->pending.fields = BSI_VIEW_PENDING_NONE;
+    view->pending.idle = NULL;
+    view->pending.requested = view->pending.flushed = 0;
+    view->transaction = NULL;
     return view;
 }
 
 void
 view_destroy(struct bsi_view* view)
 {
+    if (view->pending.idle)
+        wl_event_source_remove(view->pending.idle);
+    transaction_view_remove(view);
+    debug("View sent %ld configures for %ld state changes",
+          view->pending.flushed,
+          view->pending.requested);
+
     if (view->impl->destroy) {
         view->impl->destroy(view);
     } else {
@@ -34,6 +56,7 @@ void
 view_focus(struct bsi_view* view)
 {
     view->impl->focus(view);
+    cursor_scene_invalidate(view->server);
 }
 
 void
@@ -47,37 +70,51 @@ view_cursor_interactive(struct bsi_view* view,
 void
 view_set_maximized(struct bsi_view* view, bool maximized)
 {
+    transaction_begin(view->server);
     view->impl->set_maximized(view, maximized);
+    transaction_end(view->server);
+    cursor_scene_invalidate(view->server);
 }
 
 void
 view_set_minimized(struct bsi_view* view, bool minimized)
 {
     view->impl->set_minimized(view, minimized);
+    cursor_scene_invalidate(view->server);
 }
 
 void
 view_set_fullscreen(struct bsi_view* view, bool fullscreen)
 {
+    transaction_begin(view->server);
     view->impl->set_fullscreen(view, fullscreen);
+    transaction_end(view->server);
+    cursor_scene_invalidate(view->server);
 }
 
 void
 view_set_tiled_left(struct bsi_view* view, bool tiled)
 {
+    transaction_begin(view->server);
     view->impl->set_tiled_left(view, tiled);
+    transaction_end(view->server);
+    cursor_scene_invalidate(view->server);
 }
 
 void
 view_set_tiled_right(struct bsi_view* view, bool tiled)
 {
+    transaction_begin(view->server);
     view->impl->set_tiled_right(view, tiled);
+    transaction_end(view->server);
+    cursor_scene_invalidate(view->server);
 }
 
 void
 view_restore_prev(struct bsi_view* view)
 {
     view->impl->restore_prev(view);
+    cursor_scene_invalidate(view->server);
 }
 
 bool
@@ -97,11 +134,189 @@ view_get_correct(struct bsi_view* view,
 void
 view_set_correct(struct bsi_view* view, struct wlr_box* correction)
 {
+    transaction_begin(view->server);
     view->impl->set_correct(view, correction);
+    transaction_end(view->server);
+    cursor_scene_invalidate(view->server);
 }
 
 void
 view_request_activate(struct bsi_view* view)
 {
     view->impl->request_activate(view);
+    cursor_scene_invalidate(view->server);
+}
+
+void
+view_set_resizing(struct bsi_view* view, bool resizing)
+{
+    view->impl->set_resizing(view, resizing);
+}
+
+void
+view_request_size(struct bsi_view* view,
+                  int32_t x,
+                  int32_t y,
+                  int32_t width,
+                  int32_t height)
+{
+    view->impl->request_size(view, x, y, width, height);
+}
+
+static void
+view_geom_clamp(struct wlr_box* geom, const struct wlr_box* box)
+{
+    if (geom->width > box->width)
+        geom->width = box->width;
+    if (geom->height > box->height)
+        geom->height = box->height;
+    if (geom->x < box->x)
+        geom->x = box->x;
+    if (geom->x + geom->width > box->x + box->width)
+        geom->x = box->x + box->width - geom->width;
+    if (geom->y < box->y)
+        geom->y = box->y;
+    if (geom->y + geom->height > box->y + box->height)
+        geom->y = box->y + box->height - geom->height;
+}
+
+void
+view_relayout(struct bsi_view* view)
+{
+    struct bsi_output* output = view->workspace->output;
+    struct wlr_box* usable = &output->usable;
+
+    transaction_begin(view->server);
+
+    /* The geometry a view restores to has to be on the output as well. */
+    if (view->state == BSI_VIEW_STATE_NORMAL)
+        wlr_scene_node_coords(&view->tree->node, &view->geom.x, &view->geom.y);
+    view_geom_clamp(&view->geom, usable);
+
+    switch (view->state) {
+        case BSI_VIEW_STATE_NORMAL:
+            view_pending_position(view, view->geom.x, view->geom.y);
+            view_pending_size(view, view->geom.width, view->geom.height);
+            break;
+        case BSI_VIEW_STATE_MAXIMIZED:
+            view_pending_position(view, usable->x, usable->y);
+            view_pending_size(view, usable->width, usable->height);
+            break;
+        case BSI_VIEW_STATE_FULLSCREEN: {
+            struct wlr_box output_box;
+            wlr_output_layout_get_box(
+                view->server->wlr_output_layout, output->output, &output_box);
+            view_pending_position(view, output_box.x, output_box.y);
+            view_pending_size(view, output_box.width, output_box.height);
+            break;
+        }
+        case BSI_VIEW_STATE_TILED_LEFT:
+            view_pending_position(view, usable->x, usable->y);
+            view_pending_size(view, usable->width / 2, usable->height);
+            break;
+        case BSI_VIEW_STATE_TILED_RIGHT:
+            view_pending_position(
+                view, usable->x + usable->width / 2, usable->y);
+            view_pending_size(view, usable->width / 2, usable->height);
+            break;
+        default:
+            /* Minimized views are placed when they are restored. */
+            break;
+    }
+
+    transaction_end(view->server);
+    cursor_scene_invalidate(view->server);
+}
+
+static void
+handle_pending_idle(void* data)
+{
+    struct bsi_view* view = data;
+    view->pending.idle = NULL;
+    view_pending_flush(view);
+}
+
+static void
+view_pending_add(struct bsi_view* view, uint32_t field)
+{
+    transaction_view_add(view->server, view);
+    view->pending.fields |= field;
+    ++view->pending.requested;
+    if (view->pending.idle == NULL) {
+        struct wl_event_loop* loop =
+            wl_display_get_event_loop(view->server->wl_display);
+        view->pending.idle =
+            wl_event_loop_add_idle(loop, handle_pending_idle, view);
+    }
+}
+
+void
+view_pending_size(struct bsi_view* view, int32_t width, int32_t height)
+{
+    view->pending.width = width;
+    view->pending.height = height;
+    view_pending_add(view, BSI_VIEW_PENDING_SIZE);
+}
+
+void
+view_pending_position(struct bsi_view* view, int32_t x, int32_t y)
+{
+    view->pending.x = x;
+    view->pending.y = y;
+    view_pending_add(view, BSI_VIEW_PENDING_POSITION);
+}
+
+void
+view_pending_activated(struct bsi_view* view, bool activated)
+{
+    view->pending.activated = activated;
+    view_pending_add(view, BSI_VIEW_PENDING_ACTIVATED);
+}
+
+void
+view_pending_maximized(struct bsi_view* view, bool maximized)
+{
+    view->pending.maximized = maximized;
+    view_pending_add(view, BSI_VIEW_PENDING_MAXIMIZED);
+}
+
+void
+view_pending_fullscreen(struct bsi_view* view, bool fullscreen)
+{
+    view->pending.fullscreen = fullscreen;
+    view_pending_add(view, BSI_VIEW_PENDING_FULLSCREEN);
+}
+
+void
+view_pending_tiled(struct bsi_view* view, uint32_t edges)
+{
+    view->pending.tiled = edges;
+    view_pending_add(view, BSI_VIEW_PENDING_TILED);
+}
+
+void
+view_pending_resizing(struct bsi_view* view, bool resizing)
+{
+    view->pending.resizing = resizing;
+    view_pending_add(view, BSI_VIEW_PENDING_RESIZING);
+}
+
+void
+view_pending_flush(struct bsi_view* view)
+{
+    if (view->pending.idle) {
+        wl_event_source_remove(view->pending.idle);
+        view->pending.idle = NULL;
+    }
+
+    if (view->pending.fields == BSI_VIEW_PENDING_NONE)
+        return;
+
+    view->impl->configure(view);
+    view->pending.fields = BSI_VIEW_PENDING_NONE;
+    ++view->pending.flushed;
+    cursor_scene_invalidate(view->server);
+
+    debug("Flushed view configure, %ld configures saved so far",
+          view->pending.requested - view->pending.flushed);
 }
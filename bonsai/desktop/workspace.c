@@ -24,6 +24,8 @@ workspace_init(struct bsi_workspace* workspace,
     workspace->id = wl_list_length(&output->workspaces);
     workspace->name = strdup(name);
     workspace->active = false;
+    workspace->tree = wlr_scene_tree_create(output->tree);
+    wlr_scene_node_set_enabled(&workspace->tree->node, false);
 
     wl_list_init(&workspace->views);
     wl_signal_init(&workspace->signal.active);
@@ -38,6 +40,16 @@ workspace_init(struct bsi_workspace* workspace,
 void
 workspace_destroy(struct bsi_workspace* workspace)
 {
+    /* Views that are left over get destroyed by their clients, don't take
+     * their trees along. */
+    struct bsi_view* view;
+    wl_list_for_each(view, &workspace->views, link_workspace)
+    {
+        wlr_scene_node_reparent(&view->tree->node,
+                                &workspace->server->wlr_scene->tree);
+    }
+    wlr_scene_node_destroy(&workspace->tree->node);
+    cursor_scene_invalidate(workspace->server);
     free(workspace->foreign_listeners);
     free(workspace->name);
     free(workspace);
@@ -54,6 +66,8 @@ void
 workspace_set_active(struct bsi_workspace* workspace, bool active)
 {
     workspace->active = active;
+    wlr_scene_node_set_enabled(&workspace->tree->node, active);
+    cursor_scene_invalidate(workspace->server);
     wl_signal_emit(&workspace->signal.active, workspace);
 }
 
@@ -61,9 +75,10 @@ void
 workspace_view_add(struct bsi_workspace* workspace, struct bsi_view* view)
 {
     wl_list_insert(&workspace->views, &view->link_workspace);
-    util_slot_connect(&workspace->signal.active,
-                      &view->listen.workspace_active,
-                      handle_view_workspace_active);
+    if (view->tree && view->tree->node.parent != workspace->tree) {
+        wlr_scene_node_reparent(&view->tree->node, workspace->tree);
+        cursor_scene_invalidate(workspace->server);
+    }
     view->workspace = workspace;
 }
 
@@ -71,7 +86,6 @@ void
 workspace_view_remove(struct bsi_workspace* workspace, struct bsi_view* view)
 {
     wl_list_remove(&view->link_workspace);
-    util_slot_disconnect(&view->listen.workspace_active);
     view->workspace = NULL;
 }
 
@@ -82,6 +96,7 @@ workspace_view_move(struct bsi_workspace* workspace_from,
 {
     workspace_view_remove(workspace_from, view);
     workspace_view_add(workspace_to, view);
+    idle_inhibitors_update(view->server);
 }
 
 void
@@ -90,6 +105,9 @@ workspace_views_show_all(struct bsi_workspace* workspace, bool show_all)
     if (wl_list_empty(&workspace->views))
         return;
 
+    /* Views restore or leave their maximized and fullscreen geometry together. */
+    transaction_begin(workspace->server);
+
     struct bsi_view* view;
     if (show_all) {
         info("Show all views of workspace '%s'", workspace->name);
@@ -121,6 +139,8 @@ workspace_views_show_all(struct bsi_workspace* workspace, bool show_all)
             }
         }
     }
+
+    transaction_end(workspace->server);
 }
 
 /* Handlers */
@@ -132,6 +152,7 @@ handle_server_workspace_active(struct wl_listener* listener, void* data)
     struct bsi_workspace* workspace = data;
     struct bsi_server* server = workspace->server;
     server->active_workspace = (workspace->active) ? workspace : NULL;
+    idle_inhibitors_update(server);
     info("Server workspace %ld/%s is now %s",
          workspace_get_global_id(workspace),
          workspace->name,
@@ -146,6 +167,12 @@ handle_output_workspace_active(struct wl_listener* listener, void* data)
     struct bsi_workspace* workspace = data;
     struct bsi_output* output = workspace->output;
     output->active_workspace = (workspace->active) ? workspace : NULL;
+
+    /* A fullscreen view on the new workspace goes above the layers. */
+    if (workspace->active) {
+        output_arrange_mark(output, BSI_OUTPUT_DIRTY_STACKING);
+        output_layers_arrange(output);
+    }
     debug("Workspace %ld/%s for output %ld/%s is now %s",
           workspace_get_global_id(workspace),
           workspace->name,
@@ -153,19 +180,3 @@ handle_output_workspace_active(struct wl_listener* listener, void* data)
           output->output->name,
           (workspace->active) ? "active" : "inactive");
 }
-
-void
-handle_view_workspace_active(struct wl_listener* listener, void* data)
-{
-    debug("Got event active for bsi_view from bsi_workspace");
-
-    struct bsi_workspace* workspace = data;
-    struct bsi_view* view =
-        wl_container_of(listener, view, listen.workspace_active);
-    wlr_scene_node_set_enabled(&view->tree->node, workspace->active);
-    debug("View with app_id '%s' of workspace %ld/%s is now %s",
-          view->wlr_xdg_toplevel->app_id,
-          workspace_get_global_id(workspace),
-          workspace->name,
-          (workspace->active) ? "enabled" : "disabled");
-}
@@ -18,6 +18,7 @@
 #include "bonsai/log.h"
 #include "bonsai/output.h"
 #include "bonsai/server.h"
+#include "bonsai/stats.h"
 #include "bonsai/util.h"
 
 /* Implementation. */
@@ -27,6 +28,19 @@ xdg_shell_view_from_view(struct bsi_view* view)
     return (struct bsi_xdg_shell_view*)view;
 }
 
+static void
+xdg_shell_view_save_geom(struct bsi_view* view)
+{
+    wlr_xdg_surface_get_geometry(view->wlr_xdg_toplevel->base, &view->geom);
+    if (view->pending.fields & BSI_VIEW_PENDING_POSITION) {
+        /* The node hasn't moved yet. */
+        view->geom.x = view->pending.x;
+        view->geom.y = view->pending.y;
+    } else {
+        wlr_scene_node_coords(&view->tree->node, &view->geom.x, &view->geom.y);
+    }
+}
+
 static void
 xdg_shell_view_destroy(struct bsi_view* view)
 {
@@ -35,6 +49,8 @@ xdg_shell_view_destroy(struct bsi_view* view)
     wl_list_remove(&v->listen.map.link);
     wl_list_remove(&v->listen.unmap.link);
     wl_list_remove(&v->listen.destroy.link);
+    wl_list_remove(&v->listen.ack_configure.link);
+    wl_list_remove(&v->listen.commit.link);
     wl_list_remove(&v->listen.request_maximize.link);
     wl_list_remove(&v->listen.request_fullscreen.link);
     wl_list_remove(&v->listen.request_minimize.link);
@@ -60,7 +76,12 @@ xdg_shell_view_focus(struct bsi_view* view)
     if (prev_keyboard && wlr_surface_is_xdg_surface(prev_keyboard)) {
         struct wlr_xdg_surface* prev_focused =
             wlr_xdg_surface_from_wlr_surface(prev_keyboard);
-        wlr_xdg_toplevel_set_activated(prev_focused->toplevel, false);
+        struct wlr_scene_tree* prev_tree = prev_focused->data;
+        if (prev_focused->role == WLR_XDG_SURFACE_ROLE_TOPLEVEL && prev_tree &&
+            prev_tree->node.data)
+            view_pending_activated(prev_tree->node.data, false);
+        else
+            wlr_xdg_toplevel_set_activated(prev_focused->toplevel, false);
     }
 
     /* Move to front of server views. */
@@ -69,7 +90,7 @@ xdg_shell_view_focus(struct bsi_view* view)
 
     /* Node to top & activate. */
     wlr_scene_node_raise_to_top(&view->tree->node);
-    wlr_xdg_toplevel_set_activated(view->wlr_xdg_toplevel, true);
+    view_pending_activated(view, true);
 
     /* Seat, enter this surface with the keyboard. Leave the pointer. */
     struct wlr_keyboard* keyboard = wlr_seat_get_keyboard(seat);
@@ -141,6 +162,7 @@ xdg_shell_view_cursor_interactive(struct bsi_view* view,
         server->cursor.grab_box.width += surface_box.x;
         server->cursor.grab_box.height += surface_box.y;
         server->cursor.resize_edges = event->edges;
+        view_set_resizing(view, true);
 
         debug("Surface local resize coords are (%.2f, %.2f)",
               server->cursor.grab_sx,
@@ -172,18 +194,13 @@ xdg_shell_view_set_maximized(struct bsi_view* view, bool maximized)
         debug("Maximize view '%s'", view->wlr_xdg_toplevel->app_id);
 
         /* Save the geometry. */
-        wlr_xdg_surface_get_geometry(view->wlr_xdg_toplevel->base, &view->geom);
-        wlr_scene_node_coords(&view->tree->node, &view->geom.x, &view->geom.y);
+        xdg_shell_view_save_geom(view);
 
         /* Maximize. */
         struct wlr_box* usable_box = &view->workspace->output->usable;
-        wlr_scene_node_set_position(
-            &view->tree->node, usable_box->x, usable_box->y);
-        wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, true);
-        wlr_xdg_toplevel_set_size(
-            view->wlr_xdg_toplevel, usable_box->width, usable_box->height);
-        wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, false);
-        wlr_xdg_toplevel_set_maximized(view->wlr_xdg_toplevel, true);
+        view_pending_position(view, usable_box->x, usable_box->y);
+        view_pending_size(view, usable_box->width, usable_box->height);
+        view_pending_maximized(view, true);
     }
 }
 
@@ -197,6 +214,7 @@ xdg_shell_view_set_minimized(struct bsi_view* view, bool minimized)
         return;
 
     view->state = new_state;
+    transaction_view_flush(view);
 
     if (view->state == BSI_VIEW_STATE_NORMAL) {
         debug("Unimimize view '%s', restore prev",
@@ -214,6 +232,9 @@ xdg_shell_view_set_minimized(struct bsi_view* view, bool minimized)
         views_add(view->server, view);
         output_layers_arrange(view->workspace->output);
     }
+
+    /* Its inhibitors only count while it can be seen. */
+    idle_inhibitors_update(view->server);
 }
 
 static void
@@ -249,8 +270,7 @@ xdg_shell_view_set_fullscreen(struct bsi_view* view, bool fullscreen)
         debug("Fullscreen view '%s'", view->wlr_xdg_toplevel->app_id);
 
         /* Save the geometry. */
-        wlr_xdg_surface_get_geometry(view->wlr_xdg_toplevel->base, &view->geom);
-        wlr_scene_node_coords(&view->tree->node, &view->geom.x, &view->geom.y);
+        xdg_shell_view_save_geom(view);
 
         /* Add to fullscreen views. */
         wl_list_insert(&view->server->scene.views_fullscreen,
@@ -274,14 +294,12 @@ xdg_shell_view_set_fullscreen(struct bsi_view* view, bool fullscreen)
         wlr_output_layout_get_box(view->server->wlr_output_layout,
                                   view->workspace->output->output,
                                   &output_box);
-        wlr_scene_node_set_position(&view->tree->node, 0, 0);
-        wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, true);
-        wlr_xdg_toplevel_set_size(
-            view->wlr_xdg_toplevel, output_box.width, output_box.height);
-        wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, false);
-        wlr_xdg_toplevel_set_fullscreen(view->wlr_xdg_toplevel, true);
+        view_pending_position(view, 0, 0);
+        view_pending_size(view, output_box.width, output_box.height);
+        view_pending_fullscreen(view, true);
     }
 
+    output_arrange_mark(view->workspace->output, BSI_OUTPUT_DIRTY_STACKING);
     output_layers_arrange(view->workspace->output);
 }
 
@@ -303,17 +321,13 @@ xdg_shell_view_set_tiled_left(struct bsi_view* view, bool tiled)
         debug("Tile view '%s' left", view->wlr_xdg_toplevel->app_id);
 
         /* Save the geometry. */
-        wlr_xdg_surface_get_geometry(view->wlr_xdg_toplevel->base, &view->geom);
-        wlr_scene_node_coords(&view->tree->node, &view->geom.x, &view->geom.y);
+        xdg_shell_view_save_geom(view);
 
         /* Tile left. */
         struct wlr_box* usable_box = &view->workspace->output->usable;
-        wlr_scene_node_set_position(
-            &view->tree->node, usable_box->x, usable_box->y);
-        wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, true);
-        wlr_xdg_toplevel_set_size(
-            view->wlr_xdg_toplevel, usable_box->width / 2, usable_box->height);
-        wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, false);
+        view_pending_position(view, usable_box->x, usable_box->y);
+        view_pending_size(view, usable_box->width / 2, usable_box->height);
+        view_pending_tiled(view, WLR_EDGE_TOP | WLR_EDGE_BOTTOM | WLR_EDGE_LEFT);
     }
 }
 
@@ -335,17 +349,14 @@ xdg_shell_view_set_tiled_right(struct bsi_view* view, bool tiled)
         debug("Tile view '%s' right", view->wlr_xdg_toplevel->app_id);
 
         /* Save the geometry. */
-        wlr_xdg_surface_get_geometry(view->wlr_xdg_toplevel->base, &view->geom);
-        wlr_scene_node_coords(&view->tree->node, &view->geom.x, &view->geom.y);
+        xdg_shell_view_save_geom(view);
 
         /* Tile right. */
         struct wlr_box* usable_box = &view->workspace->output->usable;
-        wlr_scene_node_set_position(
-            &view->tree->node, usable_box->width / 2, usable_box->y);
-        wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, true);
-        wlr_xdg_toplevel_set_size(
-            view->wlr_xdg_toplevel, usable_box->width / 2, usable_box->height);
-        wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, false);
+        view_pending_position(view, usable_box->width / 2, usable_box->y);
+        view_pending_size(view, usable_box->width / 2, usable_box->height);
+        view_pending_tiled(view,
+                           WLR_EDGE_TOP | WLR_EDGE_BOTTOM | WLR_EDGE_RIGHT);
     }
 }
 
@@ -355,14 +366,17 @@ xdg_shell_view_restore_prev(struct bsi_view* view)
     switch (view->state) {
         case BSI_VIEW_STATE_NORMAL:
         case BSI_VIEW_STATE_MINIMIZED:
-            wlr_xdg_toplevel_set_maximized(view->wlr_xdg_toplevel, false);
-            wlr_xdg_toplevel_set_fullscreen(view->wlr_xdg_toplevel, false);
+            view_pending_maximized(view, false);
+            view_pending_fullscreen(view, false);
+            view_pending_tiled(view, WLR_EDGE_NONE);
             break;
         case BSI_VIEW_STATE_MAXIMIZED:
-            wlr_xdg_toplevel_set_fullscreen(view->wlr_xdg_toplevel, false);
+            view_pending_fullscreen(view, false);
+            view_pending_tiled(view, WLR_EDGE_NONE);
             break;
         case BSI_VIEW_STATE_FULLSCREEN:
-            wlr_xdg_toplevel_set_maximized(view->wlr_xdg_toplevel, false);
+            view_pending_maximized(view, false);
+            view_pending_tiled(view, WLR_EDGE_NONE);
             break;
         default:
             break;
@@ -371,11 +385,8 @@ xdg_shell_view_restore_prev(struct bsi_view* view)
     debug("Restoring view position to (%d, %d)", view->geom.x, view->geom.y);
     debug(
         "Restoring view size to (%d, %d)", view->geom.width, view->geom.height);
-    wlr_scene_node_set_position(&view->tree->node, view->geom.x, view->geom.y);
-    wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, true);
-    wlr_xdg_toplevel_set_size(
-        view->wlr_xdg_toplevel, view->geom.width, view->geom.height);
-    wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, false);
+    view_pending_position(view, view->geom.x, view->geom.y);
+    view_pending_size(view, view->geom.width, view->geom.height);
 }
 
 static bool
@@ -426,11 +437,8 @@ xdg_shell_view_set_correct(struct bsi_view* view, struct wlr_box* correction)
     view->geom.y += correction->y;
     view->geom.width += correction->width;
     view->geom.height += correction->height;
-    wlr_scene_node_set_position(&view->tree->node, view->geom.x, view->geom.y);
-    wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, true);
-    wlr_xdg_toplevel_set_size(
-        view->wlr_xdg_toplevel, view->geom.width, view->geom.height);
-    wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, false);
+    view_pending_position(view, view->geom.x, view->geom.y);
+    view_pending_size(view, view->geom.width, view->geom.height);
 }
 
 static void
@@ -439,6 +447,93 @@ xdg_shell_view_request_activate(struct bsi_view* view)
     view_focus(view);
 }
 
+static void
+xdg_shell_view_send_size(struct bsi_view* view)
+{
+    /* Let collected state, like resizing, ride along with this size. */
+    view_pending_flush(view);
+    view->resize.pending = false;
+    view->resize.serial = wlr_xdg_toplevel_set_size(
+        view->wlr_xdg_toplevel, view->resize.width, view->resize.height);
+    view->resize.sent_x = view->resize.x;
+    view->resize.sent_y = view->resize.y;
+    ++view->resize.sent;
+}
+
+static void
+xdg_shell_view_set_resizing(struct bsi_view* view, bool resizing)
+{
+    if (resizing) {
+        view->resize.serial = 0;
+        view->resize.pending = false;
+        view->resize.acked = false;
+        view->resize.sent = view->resize.superseded = 0;
+    } else {
+        /* The grab is over, the final size can't wait for the ack. */
+        if (view->resize.pending)
+            xdg_shell_view_send_size(view);
+        debug("Resize grab sent %ld sizes, %ld superseded before an ack",
+              view->resize.sent,
+              view->resize.superseded);
+    }
+    view_pending_resizing(view, resizing);
+}
+
+static void
+xdg_shell_view_request_size(struct bsi_view* view,
+                            int32_t x,
+                            int32_t y,
+                            int32_t width,
+                            int32_t height)
+{
+    if (view->resize.pending)
+        ++view->resize.superseded;
+
+    view->resize.x = x;
+    view->resize.y = y;
+    view->resize.width = width;
+    view->resize.height = height;
+    view->resize.pending = true;
+
+    if (view->resize.serial == 0)
+        xdg_shell_view_send_size(view);
+}
+
+static void
+xdg_shell_view_configure(struct bsi_view* view)
+{
+    struct wlr_xdg_toplevel* toplevel = view->wlr_xdg_toplevel;
+    struct wlr_xdg_toplevel_configure* scheduled = &toplevel->scheduled;
+    uint32_t fields = view->pending.fields;
+
+    if (fields & BSI_VIEW_PENDING_POSITION)
+        wlr_scene_node_set_position(
+            &view->tree->node, view->pending.x, view->pending.y);
+
+    /* Only touch state that differs from what the client was last told, each
+     * of these schedules a configure. */
+    if (fields & BSI_VIEW_PENDING_SIZE &&
+        (scheduled->width != view->pending.width ||
+         scheduled->height != view->pending.height))
+        wlr_xdg_toplevel_set_size(
+            toplevel, view->pending.width, view->pending.height);
+    if (fields & BSI_VIEW_PENDING_ACTIVATED &&
+        scheduled->activated != view->pending.activated)
+        wlr_xdg_toplevel_set_activated(toplevel, view->pending.activated);
+    if (fields & BSI_VIEW_PENDING_MAXIMIZED &&
+        scheduled->maximized != view->pending.maximized)
+        wlr_xdg_toplevel_set_maximized(toplevel, view->pending.maximized);
+    if (fields & BSI_VIEW_PENDING_FULLSCREEN &&
+        scheduled->fullscreen != view->pending.fullscreen)
+        wlr_xdg_toplevel_set_fullscreen(toplevel, view->pending.fullscreen);
+    if (fields & BSI_VIEW_PENDING_TILED &&
+        scheduled->tiled != view->pending.tiled)
+        wlr_xdg_toplevel_set_tiled(toplevel, view->pending.tiled);
+    if (fields & BSI_VIEW_PENDING_RESIZING &&
+        scheduled->resizing != view->pending.resizing)
+        wlr_xdg_toplevel_set_resizing(toplevel, view->pending.resizing);
+}
+
 static const struct bsi_view_impl view_impl = {
     .destroy = xdg_shell_view_destroy,
     .focus = xdg_shell_view_focus,
@@ -453,6 +548,9 @@ static const struct bsi_view_impl view_impl = {
     .get_correct = xdg_shell_view_get_correct,
     .set_correct = xdg_shell_view_set_correct,
     .request_activate = xdg_shell_view_request_activate,
+    .set_resizing = xdg_shell_view_set_resizing,
+    .request_size = xdg_shell_view_request_size,
+    .configure = xdg_shell_view_configure,
 };
 
 /* Handlers. */
@@ -474,6 +572,57 @@ handle_destroy(struct wl_listener* listener, void* data)
     view_destroy(view);
 }
 
+static void
+handle_ack_configure(struct wl_listener* listener, void* data)
+{
+    struct bsi_xdg_shell_view* v =
+        wl_container_of(listener, v, listen.ack_configure);
+    struct bsi_view* view = &v->view;
+    struct wlr_xdg_surface_configure* configure = data;
+
+    /* Serials increase monotonically, an ack of a later configure covers the
+     * outstanding one as well. */
+    if (view->resize.serial == 0 ||
+        (int32_t)(configure->serial - view->resize.serial) < 0)
+        return;
+
+    view->resize.serial = 0;
+    view->resize.acked = true;
+    view->resize.acked_x = view->resize.sent_x;
+    view->resize.acked_y = view->resize.sent_y;
+    if (view->resize.pending)
+        xdg_shell_view_send_size(view);
+}
+
+static void
+handle_commit(struct wl_listener* listener, void* data)
+{
+    struct bsi_xdg_shell_view* v = wl_container_of(listener, v, listen.commit);
+    struct bsi_view* view = &v->view;
+
+    /* A pause resets the cadence. */
+    uint64_t now_usec = stats_now_usec();
+    uint64_t interval = now_usec - view->commits.last_usec;
+    if (view->commits.last_usec == 0 || interval > BSI_VIEW_COMMITS_GAP_USEC)
+        view->commits.interval_usec = 0;
+    else if (view->commits.interval_usec == 0)
+        view->commits.interval_usec = interval;
+    else
+        view->commits.interval_usec =
+            (view->commits.interval_usec * 7 + interval) / 8;
+    view->commits.last_usec = now_usec;
+
+    if (!view->resize.acked)
+        return;
+
+    /* This commit draws the acked size, the node moves with it. */
+    view->resize.acked = false;
+    view->geom.x = view->resize.acked_x;
+    view->geom.y = view->resize.acked_y;
+    wlr_scene_node_set_position(&view->tree->node, view->geom.x, view->geom.y);
+    cursor_scene_invalidate(view->server);
+}
+
 static void
 handle_map(struct wl_listener* listener, void* data)
 {
@@ -519,6 +668,7 @@ handle_map(struct wl_listener* listener, void* data)
     view->mapped = true;
     views_add(server, view);
     view_focus(view);
+    cursor_scene_invalidate(server);
 }
 
 static void
@@ -531,6 +681,13 @@ handle_unmap(struct wl_listener* listener, void* data)
 
     view->mapped = false;
     views_remove(view);
+    cursor_scene_invalidate(view->server);
+
+    /* Drop an interactive grab of this view. */
+    if (view->server->cursor.grabbed_view == view) {
+        view->server->cursor.grabbed_view = NULL;
+        view->server->cursor.cursor_mode = BSI_CURSOR_NORMAL;
+    }
     views_focus_recent(view->server);
     output_layers_arrange(view->workspace->output);
 }
@@ -675,7 +832,7 @@ handle_xdg_shell_new_surface(struct wl_listener* listener, void* data)
         view_init(&view->view, BSI_VIEW_TYPE_XDG_SHELL, &view_impl, server);
         view->view.wlr_xdg_toplevel = xdg_surface->toplevel;
         view->view.tree =
-            wlr_scene_xdg_surface_create(&server->wlr_scene->tree, xdg_surface);
+            wlr_scene_xdg_surface_create(workspace->tree, xdg_surface);
         view->view.tree->node.data = &view->view;
         xdg_surface->toplevel->base->data = view->view.tree;
 
@@ -686,6 +843,12 @@ handle_xdg_shell_new_surface(struct wl_listener* listener, void* data)
             &xdg_surface->events.map, &view->listen.map, handle_map);
         util_slot_connect(
             &xdg_surface->events.unmap, &view->listen.unmap, handle_unmap);
+        util_slot_connect(&xdg_surface->events.ack_configure,
+                          &view->listen.ack_configure,
+                          handle_ack_configure);
+        util_slot_connect(&xdg_surface->surface->events.commit,
+                          &view->listen.commit,
+                          handle_commit);
 
         util_slot_connect(&xdg_surface->toplevel->events.request_maximize,
                           &view->listen.request_maximize,
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <libinput.h>
 #include <math.h>
@@ -10,8 +11,8 @@
 #include <wlr/backend.h>
 #include <wlr/backend/libinput.h>
 #include <wlr/types/wlr_cursor.h>
-#include <wlr/types/wlr_idle.h>
 #include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_keyboard_group.h>
 #include <wlr/types/wlr_pointer.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_subcompositor.h>
@@ -20,6 +21,7 @@
 #include <xkbcommon/xkbcommon.h>
 
 #include "bonsai/config/atom.h"
+#include "bonsai/desktop/idle.h"
 #include "bonsai/desktop/layers.h"
 #include "bonsai/desktop/view.h"
 #include "bonsai/events.h"
@@ -29,6 +31,7 @@
 #include "bonsai/log.h"
 #include "bonsai/server.h"
 #include "bonsai/util.h"
+#include "bonsai/worker.h"
 
 struct bsi_input_device*
 input_device_init(struct bsi_input_device* input_device,
@@ -49,6 +52,9 @@ input_device_init(struct bsi_input_device* input_device,
             input_device->type = type;
             break;
     }
+    input_device->group = NULL;
+    input_device->alone = false;
+    wl_list_init(&input_device->link_group);
 
     return input_device;
 }
@@ -73,40 +79,442 @@ input_device_destroy(struct bsi_input_device* input_device)
             wl_list_remove(&input_device->listen.hold_end.link);
             break;
         case BSI_INPUT_DEVICE_KEYBOARD:
-            wl_list_remove(&input_device->listen.key.link);
-            wl_list_remove(&input_device->listen.modifiers.link);
+            input_keyboard_group_leave(input_device);
             wl_list_remove(&input_device->listen.destroy.link);
             break;
     }
     free(input_device);
 }
 
+static void
+handle_key(struct wl_listener* listener, void* data);
+
+static void
+handle_modifiers(struct wl_listener* listener, void* data);
+
+/* Compiling a keymap reads and parses a good number of files, the workers do
+ * it. */
+struct bsi_input_keymap_job
+{
+    struct bsi_input_keymap* keymap; /* NULL once the cache is gone. */
+    char* names[5]; /* rules, model, layout, variant, options */
+    struct xkb_keymap* xkb_keymap;
+};
+
+/* The names of the default keymap. */
+static const char* const keymap_defaults[5] = { NULL };
+
+static bool
+keymap_names_match(char* const names[5], const char* const other[5])
+{
+    for (size_t i = 0; i < 5; ++i) {
+        if ((names[i] == NULL) != (other[i] == NULL) ||
+            (names[i] != NULL && strcmp(names[i], other[i]) != 0))
+            return false;
+    }
+    return true;
+}
+
+static void
+keymap_job_work(void* data)
+{
+    struct bsi_input_keymap_job* job = data;
+    struct xkb_rule_names xkb_rule_names = {
+        .rules = job->names[0],
+        .model = job->names[1],
+        .layout = job->names[2],
+        .variant = job->names[3],
+        .options = job->names[4],
+    };
+
+    struct xkb_context* xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (xkb_context == NULL)
+        return;
+    job->xkb_keymap = xkb_keymap_new_from_names(
+        xkb_context, &xkb_rule_names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    xkb_context_unref(xkb_context);
+}
+
+static void
+handle_device_key(struct wl_listener* listener, void* data);
+
+static void
+handle_device_modifiers(struct wl_listener* listener, void* data);
+
+static void
+keyboard_group_destroy(struct bsi_input_keyboard_group* group);
+
+/* A keyboard the group wouldn't take or that waits on its keymap still has
+ * to type. */
+static void
+keyboard_listen_alone(struct bsi_input_device* device)
+{
+    if (device->alone)
+        return;
+
+    struct wlr_keyboard* wlr_keyboard =
+        wlr_keyboard_from_input_device(device->device);
+    device->alone = true;
+    util_slot_connect(
+        &wlr_keyboard->events.key, &device->listen.key, handle_device_key);
+    util_slot_connect(&wlr_keyboard->events.modifiers,
+                      &device->listen.modifiers,
+                      handle_device_modifiers);
+}
+
+static void
+keyboard_listen_stop(struct bsi_input_device* device)
+{
+    if (!device->alone)
+        return;
+
+    wl_list_remove(&device->listen.key.link);
+    wl_list_remove(&device->listen.modifiers.link);
+    device->alone = false;
+}
+
+static void
+keyboard_group_keymap_ready(struct bsi_input_keyboard_group* group)
+{
+    struct wlr_keyboard* group_keyboard = &group->wlr_group->keyboard;
+    struct xkb_keymap* xkb_keymap = group->keymap->xkb_keymap;
+    if (group_keyboard->keymap == NULL)
+        wlr_keyboard_set_keymap(group_keyboard, xkb_keymap);
+
+    struct bsi_input_device *device, *device_tmp;
+    wl_list_for_each_safe(device, device_tmp, &group->waiting, link_group)
+    {
+        struct wlr_keyboard* wlr_keyboard =
+            wlr_keyboard_from_input_device(device->device);
+        wl_list_remove(&device->link_group);
+        wl_list_init(&device->link_group);
+        wlr_keyboard_set_keymap(wlr_keyboard, xkb_keymap);
+        /* The group only takes keyboards that repeat the way it does. */
+        wlr_keyboard_set_repeat_info(wlr_keyboard,
+                                     group_keyboard->repeat_info.rate,
+                                     group_keyboard->repeat_info.delay);
+        if (!wlr_keyboard_group_add_keyboard(group->wlr_group, wlr_keyboard)) {
+            error("Keyboard '%s' couldn't join its group, listening to it "
+                  "on its own",
+                  device->device->name);
+            device->group = NULL;
+            keyboard_listen_alone(device);
+        } else {
+            keyboard_listen_stop(device);
+        }
+    }
+
+    if (wl_list_empty(&group->wlr_group->devices)) {
+        keyboard_group_destroy(group);
+        return;
+    }
+    wlr_seat_set_keyboard(group->server->wlr_seat, group_keyboard);
+}
+
+/* Nothing is left waiting on a keymap that didn't compile. Its keyboards get
+ * the default keymap, the next keyboard with the same config tries again. */
+static void
+keymap_evict(struct bsi_input_keymap* keymap)
+{
+    bool fallback = !keymap_names_match(keymap->names, keymap_defaults);
+    struct xkb_rule_names xkb_rule_names = { 0 };
+
+    wl_list_remove(&keymap->link);
+    struct bsi_input_keyboard_group *group, *group_tmp;
+    wl_list_for_each_safe(
+        group, group_tmp, &keymap->server->input.keyboard_groups, link)
+    {
+        if (group->keymap != keymap)
+            continue;
+
+        struct bsi_input_device *device, *device_tmp;
+        wl_list_for_each_safe(device, device_tmp, &group->waiting, link_group)
+        {
+            wl_list_remove(&device->link_group);
+            wl_list_init(&device->link_group);
+            device->group = NULL;
+            /* Unless the default is what failed. */
+            if (fallback)
+                input_keyboard_group_join(device,
+                                          &xkb_rule_names,
+                                          group->repeat_rate,
+                                          group->repeat_delay);
+            else
+                error("Keyboard '%s' has no keymap", device->device->name);
+        }
+        keyboard_group_destroy(group);
+    }
+
+    for (size_t i = 0; i < 5; ++i)
+        free(keymap->names[i]);
+    free(keymap);
+}
+
+static void
+keymap_job_done(void* data, bool ran)
+{
+    struct bsi_input_keymap_job* job = data;
+    struct bsi_input_keymap* keymap = job->keymap;
+
+    if (keymap != NULL) {
+        keymap->job = NULL;
+        keymap->xkb_keymap = job->xkb_keymap;
+        job->xkb_keymap = NULL;
+        if (keymap->xkb_keymap != NULL) {
+            debug("Compiled keymap from xkb_rule_names { rules=%s, model=%s, "
+                  "layout=%s, variant=%s, options=%s }",
+                  job->names[0],
+                  job->names[1],
+                  job->names[2],
+                  job->names[3],
+                  job->names[4]);
+            struct bsi_input_keyboard_group *group, *group_tmp;
+            wl_list_for_each_safe(
+                group, group_tmp, &keymap->server->input.keyboard_groups, link)
+            {
+                if (group->keymap == keymap)
+                    keyboard_group_keymap_ready(group);
+            }
+        } else if (ran) {
+            error("Keymap compilation failed for xkb_rule_names { rules=%s, "
+                  "model=%s, layout=%s, variant=%s, options=%s }, falling "
+                  "back to the default",
+                  job->names[0],
+                  job->names[1],
+                  job->names[2],
+                  job->names[3],
+                  job->names[4]);
+            keymap_evict(keymap);
+        }
+    }
+
+    if (job->xkb_keymap != NULL)
+        xkb_keymap_unref(job->xkb_keymap);
+    for (size_t i = 0; i < 5; ++i)
+        free(job->names[i]);
+    free(job);
+}
+
+/* A compiled keymap to type with until the one of a keyboard is, the default
+ * one if it is cached. */
+static struct bsi_input_keymap*
+keymap_fallback(struct bsi_server* server)
+{
+    struct bsi_input_keymap *keymap, *found = NULL;
+    wl_list_for_each(keymap, &server->input.keymaps, link)
+    {
+        if (keymap->xkb_keymap == NULL)
+            continue;
+        if (keymap_names_match(keymap->names, keymap_defaults))
+            return keymap;
+        if (found == NULL)
+            found = keymap;
+    }
+    return found;
+}
+
+/* A cached keymap, or one that starts compiling. Without any compiled keymap
+ * to type with in the meantime, it is compiled right away. */
+static struct bsi_input_keymap*
+keymap_get(struct bsi_server* server,
+           const struct xkb_rule_names* xkb_rule_names)
+{
+    const char* const names[5] = {
+        xkb_rule_names->rules,  xkb_rule_names->model,
+        xkb_rule_names->layout, xkb_rule_names->variant,
+        xkb_rule_names->options,
+    };
+
+    struct bsi_input_keymap* keymap;
+    wl_list_for_each(keymap, &server->input.keymaps, link)
+    {
+        if (keymap_names_match(keymap->names, names)) {
+            ++server->input.keymap_hits;
+            return keymap;
+        }
+    }
+
+    keymap = calloc(1, sizeof(struct bsi_input_keymap));
+    struct bsi_input_keymap_job* job =
+        calloc(1, sizeof(struct bsi_input_keymap_job));
+    if (keymap == NULL || job == NULL) {
+        errn("Failed to allocate keymap");
+        free(keymap);
+        free(job);
+        return NULL;
+    }
+
+    keymap->server = server;
+    keymap->job = job;
+    job->keymap = keymap;
+    for (size_t i = 0; i < 5; ++i) {
+        keymap->names[i] = names[i] ? strdup(names[i]) : NULL;
+        job->names[i] = names[i] ? strdup(names[i]) : NULL;
+    }
+    ++server->input.keymap_compiles;
+
+    if (keymap_fallback(server) == NULL) {
+        bool is_default = keymap_names_match(keymap->names, keymap_defaults);
+        keymap_job_work(job);
+        bool compiled = job->xkb_keymap != NULL;
+        wl_list_insert(&server->input.keymaps, &keymap->link);
+        keymap_job_done(job, true);
+        if (compiled || is_default)
+            return compiled ? keymap : NULL;
+        /* It was evicted, the default takes its place. */
+        return keymap_get(server, &(struct xkb_rule_names){ 0 });
+    }
+
+    wl_list_insert(&server->input.keymaps, &keymap->link);
+    workers_submit(server->workers, keymap_job_work, keymap_job_done, job);
+    return keymap;
+}
+
+static struct bsi_input_keyboard_group*
+keyboard_group_create(struct bsi_server* server,
+                      struct bsi_input_keymap* keymap,
+                      int32_t repeat_rate,
+                      int32_t repeat_delay)
+{
+    struct bsi_input_keyboard_group* group =
+        calloc(1, sizeof(struct bsi_input_keyboard_group));
+    if (group == NULL) {
+        errn("Failed to allocate keyboard group");
+        return NULL;
+    }
+    group->wlr_group = wlr_keyboard_group_create();
+    if (group->wlr_group == NULL) {
+        error("Failed to create keyboard group");
+        free(group);
+        return NULL;
+    }
+
+    group->server = server;
+    group->keymap = keymap;
+    group->repeat_rate = repeat_rate;
+    group->repeat_delay = repeat_delay;
+    wl_list_init(&group->waiting);
+    if (repeat_rate != 0 || repeat_delay != 0) {
+        wlr_keyboard_set_repeat_info(
+            &group->wlr_group->keyboard, repeat_rate, repeat_delay);
+        debug("Set repeat info { rate=%d, delay=%d }",
+              repeat_rate,
+              repeat_delay);
+    }
+
+    util_slot_connect(&group->wlr_group->keyboard.events.key,
+                      &group->listen.key,
+                      handle_key);
+    util_slot_connect(&group->wlr_group->keyboard.events.modifiers,
+                      &group->listen.modifiers,
+                      handle_modifiers);
+    wl_list_insert(&server->input.keyboard_groups, &group->link);
+    return group;
+}
+
+static void
+keyboard_group_destroy(struct bsi_input_keyboard_group* group)
+{
+    wl_list_remove(&group->listen.key.link);
+    wl_list_remove(&group->listen.modifiers.link);
+    wl_list_remove(&group->link);
+    wlr_keyboard_group_destroy(group->wlr_group);
+    free(group);
+}
+
 void
-input_device_keymap_set(struct bsi_input_device* input_device,
-                        const struct xkb_rule_names* xkb_rule_names)
+input_keyboard_group_join(struct bsi_input_device* input_device,
+                          const struct xkb_rule_names* xkb_rule_names,
+                          int32_t repeat_rate,
+                          int32_t repeat_delay)
 {
     assert(input_device->type == BSI_INPUT_DEVICE_KEYBOARD);
 
-    struct xkb_context* xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-    struct xkb_keymap* xkb_keymap = xkb_keymap_new_from_names(
-        xkb_context, xkb_rule_names, XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-    if (xkb_keymap != NULL) {
-        wlr_keyboard_set_keymap(
-            wlr_keyboard_from_input_device(input_device->device), xkb_keymap);
-        xkb_keymap_unref(xkb_keymap);
-        debug("Set keymap from xkb_rule_names { rules=%s, model=%s, layout=%s, "
-              "variant=%s, options=%s }",
-              xkb_rule_names->rules,
-              xkb_rule_names->model,
-              xkb_rule_names->layout,
-              xkb_rule_names->variant,
-              xkb_rule_names->options);
-    } else {
-        error("Keymap compilation failed");
+    struct bsi_server* server = input_device->server;
+    struct bsi_input_keymap* keymap = keymap_get(server, xkb_rule_names);
+    if (keymap == NULL)
+        return;
+
+    struct bsi_input_keyboard_group *group, *found = NULL;
+    wl_list_for_each(group, &server->input.keyboard_groups, link)
+    {
+        if (group->keymap == keymap && group->repeat_rate == repeat_rate &&
+            group->repeat_delay == repeat_delay) {
+            found = group;
+            break;
+        }
     }
+    if (found == NULL &&
+        !(found = keyboard_group_create(
+              server, keymap, repeat_rate, repeat_delay)))
+        return;
 
-    xkb_context_unref(xkb_context);
+    input_device->group = found;
+    wl_list_insert(&found->waiting, &input_device->link_group);
+    if (keymap->xkb_keymap != NULL) {
+        keyboard_group_keymap_ready(found);
+        return;
+    }
+
+    /* Keys pressed while the keymap compiles aren't lost, the keyboard types
+     * on its own with the keymap it has, or a fallback. */
+    struct wlr_keyboard* wlr_keyboard =
+        wlr_keyboard_from_input_device(input_device->device);
+    struct bsi_input_keymap* fallback = keymap_fallback(server);
+    if (wlr_keyboard->keymap == NULL && fallback != NULL)
+        wlr_keyboard_set_keymap(wlr_keyboard, fallback->xkb_keymap);
+    if (wlr_keyboard->keymap != NULL)
+        keyboard_listen_alone(input_device);
+}
+
+void
+input_keyboard_group_leave(struct bsi_input_device* input_device)
+{
+    keyboard_listen_stop(input_device);
+
+    struct bsi_input_keyboard_group* group = input_device->group;
+    if (group == NULL)
+        return;
+
+    struct wlr_keyboard* wlr_keyboard =
+        wlr_keyboard_from_input_device(input_device->device);
+    if (wlr_keyboard->group == group->wlr_group)
+        wlr_keyboard_group_remove_keyboard(group->wlr_group, wlr_keyboard);
+    wl_list_remove(&input_device->link_group);
+    wl_list_init(&input_device->link_group);
+    input_device->group = NULL;
+
+    if (wl_list_empty(&group->waiting) &&
+        wl_list_empty(&group->wlr_group->devices))
+        keyboard_group_destroy(group);
+}
+
+void
+input_keymaps_destroy(struct bsi_server* server)
+{
+    debug("Keymap cache had %ld hits, compiled %ld keymaps",
+          server->input.keymap_hits,
+          server->input.keymap_compiles);
+
+    struct bsi_input_keyboard_group *group, *group_tmp;
+    wl_list_for_each_safe(
+        group, group_tmp, &server->input.keyboard_groups, link)
+    {
+        keyboard_group_destroy(group);
+    }
+
+    struct bsi_input_keymap *keymap, *keymap_tmp;
+    wl_list_for_each_safe(keymap, keymap_tmp, &server->input.keymaps, link)
+    {
+        if (keymap->job != NULL)
+            keymap->job->keymap = NULL;
+        if (keymap->xkb_keymap != NULL)
+            xkb_keymap_unref(keymap->xkb_keymap);
+        for (size_t i = 0; i < 5; ++i)
+            free(keymap->names[i]);
+        wl_list_remove(&keymap->link);
+        free(keymap);
+    }
 }
 
 /* Handlers */
@@ -118,17 +526,24 @@ handle_motion(struct wl_listener* listener, void* data)
     struct bsi_server* server = device->server;
     struct wlr_pointer_motion_event* event = data;
     union bsi_cursor_event cursor_event = { .motion = event };
+    ++server->input.events;
 
     /* Firstly, move the cursor and notify seat of activity. */
     wlr_cursor_move(
         device->cursor, device->device, event->delta_x, event->delta_y);
 
-    wlr_idle_notify_activity(server->wlr_idle, server->wlr_seat);
+    idle_activity_notify(server);
+    ++server->cursor.motion.received;
 
     if (server->session.locked)
         return;
 
     /* Secondly, check if we have any view stuff to do. */
+    if (server->cursor.motion.coalesce) {
+        cursor_motion_defer(
+            server, event->time_msec, event->delta_x, event->delta_y);
+        return;
+    }
     cursor_process_motion(server, cursor_event);
 }
 
@@ -140,15 +555,27 @@ handle_motion_absolute(struct wl_listener* listener, void* data)
     struct bsi_server* server = device->server;
     struct wlr_pointer_motion_absolute_event* event = data;
     union bsi_cursor_event cursor_event = { .motion_absolute = event };
+    ++server->input.events;
 
     /* Firstly, warp the absolute motion to our output layout constraints. */
+    double lx = server->wlr_cursor->x, ly = server->wlr_cursor->y;
     wlr_cursor_warp_absolute(
         server->wlr_cursor, device->device, event->x, event->y);
 
+    idle_activity_notify(server);
+    ++server->cursor.motion.received;
+
     if (server->session.locked)
         return;
 
     /* Secondly, check if we have any view stuff to do. */
+    if (server->cursor.motion.coalesce) {
+        cursor_motion_defer(server,
+                            event->time_msec,
+                            server->wlr_cursor->x - lx,
+                            server->wlr_cursor->y - ly);
+        return;
+    }
     cursor_process_motion(server, cursor_event);
 }
 
@@ -163,6 +590,7 @@ handle_button(struct wl_listener* listener, void* data)
     struct bsi_input_device* device =
         wl_container_of(listener, device, listen.button);
     struct bsi_server* server = device->server;
+    ++server->input.events;
 
     if (server->session.locked)
         return;
@@ -170,15 +598,21 @@ handle_button(struct wl_listener* listener, void* data)
     struct wlr_seat* seat = device->server->wlr_seat;
     struct wlr_pointer_button_event* event = data;
 
+    /* Pointer focus has to be up to date before the button goes out. */
+    cursor_motion_flush(server);
+
     /* Notify client that has pointer focus of the event. */
     wlr_seat_pointer_notify_button(
         seat, event->time_msec, event->button, event->state);
 
-    wlr_idle_notify_activity(server->wlr_idle, server->wlr_seat);
+    idle_activity_notify(server);
 
     switch (event->state) {
         case WLR_BUTTON_RELEASED:
             /* Exit interactive mode. */
+            if (server->cursor.cursor_mode == BSI_CURSOR_RESIZE &&
+                server->cursor.grabbed_view)
+                view_set_resizing(server->cursor.grabbed_view, false);
             server->cursor.cursor_mode = BSI_CURSOR_NORMAL;
             cursor_image_set(server, BSI_CURSOR_IMAGE_NORMAL);
             break;
@@ -230,6 +664,7 @@ handle_axis(struct wl_listener* listener, void* data)
     struct bsi_input_device* device =
         wl_container_of(listener, device, listen.axis);
     struct bsi_server* server = device->server;
+    ++server->input.events;
 
     if (server->session.locked)
         return;
@@ -237,6 +672,8 @@ handle_axis(struct wl_listener* listener, void* data)
     struct wlr_seat* wlr_seat = server->wlr_seat;
     struct wlr_pointer_axis_event* event = data;
 
+    cursor_motion_flush(server);
+
     /* Notify client that has pointer focus of the event. */
     wlr_seat_pointer_notify_axis(wlr_seat,
                                  event->time_msec,
@@ -245,7 +682,7 @@ handle_axis(struct wl_listener* listener, void* data)
                                  event->delta_discrete,
                                  event->source);
 
-    wlr_idle_notify_activity(server->wlr_idle, server->wlr_seat);
+    idle_activity_notify(server);
 }
 
 static void
@@ -268,6 +705,7 @@ handle_swipe_begin(struct wl_listener* listener, void* data)
     struct bsi_input_device* device =
         wl_container_of(listener, device, listen.swipe_begin);
     struct bsi_server* server = device->server;
+    ++server->input.events;
 
     if (server->session.locked)
         return;
@@ -282,7 +720,7 @@ handle_swipe_begin(struct wl_listener* listener, void* data)
     server->cursor.swipe_fingers = event->fingers;
     server->cursor.swipe_timest = event->time_msec;
 
-    wlr_idle_notify_activity(server->wlr_idle, server->wlr_seat);
+    idle_activity_notify(server);
 }
 
 static void
@@ -291,6 +729,7 @@ handle_swipe_update(struct wl_listener* listener, void* data)
     struct bsi_input_device* device =
         wl_container_of(listener, device, listen.swipe_update);
     struct bsi_server* server = device->server;
+    ++server->input.events;
 
     if (server->session.locked)
         return;
@@ -315,6 +754,7 @@ handle_swipe_end(struct wl_listener* listener, void* data)
     struct bsi_input_device* device =
         wl_container_of(listener, device, listen.swipe_end);
     struct bsi_server* server = device->server;
+    ++server->input.events;
 
     if (server->session.locked)
         return;
@@ -379,14 +819,12 @@ handle_pinch_begin(struct wl_listener* listener, void* data)
     struct bsi_input_device* device =
         wl_container_of(listener, device, listen.pinch_begin);
     struct bsi_server* server = device->server;
+    ++server->input.events;
 
     if (server->session.locked)
         return;
 
-    struct wlr_seat* seat = server->wlr_seat;
-    struct wlr_pointer_pinch_begin_event* event = data;
-
-    wlr_idle_notify_activity(device->server->wlr_idle, seat);
+    idle_activity_notify(server);
 }
 
 static void
@@ -395,6 +833,7 @@ handle_pinch_update(struct wl_listener* listener, void* data)
     struct bsi_input_device* device =
         wl_container_of(listener, device, listen.pinch_update);
     struct bsi_server* server = device->server;
+    ++server->input.events;
 
     if (server->session.locked)
         return;
@@ -411,6 +850,7 @@ handle_pinch_end(struct wl_listener* listener, void* data)
     struct bsi_input_device* device =
         wl_container_of(listener, device, listen.pinch_end);
     struct bsi_server* server = device->server;
+    ++server->input.events;
 
     if (server->session.locked)
         return;
@@ -427,14 +867,12 @@ handle_hold_begin(struct wl_listener* listener, void* data)
     struct bsi_input_device* device =
         wl_container_of(listener, device, listen.hold_begin);
     struct bsi_server* server = device->server;
+    ++server->input.events;
 
     if (server->session.locked)
         return;
 
-    struct wlr_seat* seat = server->wlr_seat;
-    struct wlr_pointer_hold_begin_event* event = data;
-
-    wlr_idle_notify_activity(device->server->wlr_idle, seat);
+    idle_activity_notify(server);
 }
 
 static void
@@ -445,6 +883,7 @@ handle_hold_end(struct wl_listener* listener, void* data)
     struct bsi_input_device* device =
         wl_container_of(listener, device, listen.hold_end);
     struct bsi_server* server = device->server;
+    ++server->input.events;
 
     if (server->session.locked)
         return;
@@ -454,22 +893,19 @@ handle_hold_end(struct wl_listener* listener, void* data)
 }
 
 static void
-handle_key(struct wl_listener* listener, void* data)
+keyboard_key_notify(struct bsi_server* server,
+                    struct wlr_keyboard* wlr_keyboard,
+                    struct wlr_keyboard_key_event* event)
 {
-    struct bsi_input_device* device =
-        wl_container_of(listener, device, listen.key);
-    struct bsi_server* server = device->server;
     struct wlr_seat* seat = server->wlr_seat;
-    struct wlr_keyboard_key_event* event = data;
+    ++server->input.events;
 
-    wlr_idle_notify_activity(device->server->wlr_idle, seat);
+    idle_activity_notify(server);
 
-    if (!keyboard_keybinds_process(device, event)) {
-        /* A seat can only have one keyboard, but multiple keyboards can be
-         * attached. Switch the seat to the correct underlying keyboard. Roots
-         * handles this for us :). */
-        wlr_seat_set_keyboard(seat,
-                              wlr_keyboard_from_input_device(device->device));
+    if (!keyboard_keybinds_process(server, wlr_keyboard, event)) {
+        /* A seat can only have one keyboard, but there is a group for every
+         * keyboard config. Switch the seat to the group of this key. */
+        wlr_seat_set_keyboard(seat, wlr_keyboard);
         /* The server knows not thy keybind, the client shall handle it. Notify
          * client of keys not handled by the server. */
         wlr_seat_keyboard_notify_key(
@@ -478,22 +914,52 @@ handle_key(struct wl_listener* listener, void* data)
 }
 
 static void
-handle_modifiers(struct wl_listener* listener, void* data)
+keyboard_modifiers_notify(struct bsi_server* server,
+                          struct wlr_keyboard* wlr_keyboard)
 {
-    struct bsi_input_device* device =
-        wl_container_of(listener, device, listen.modifiers);
-    struct bsi_server* server = device->server;
     struct wlr_seat* seat = server->wlr_seat;
 
-    wlr_idle_notify_activity(device->server->wlr_idle, seat);
+    idle_activity_notify(server);
 
-    /* A seat can only have one keyboard, but multiple keyboards can be
-     * attached. Switch the seat to the correct underlying keyboard. Roots
-     * handles this for us :). */
-    wlr_seat_set_keyboard(seat, wlr_keyboard_from_input_device(device->device));
+    /* A seat can only have one keyboard, but there is a group for every
+     * keyboard config. Switch the seat to the group of these modifiers. */
+    wlr_seat_set_keyboard(seat, wlr_keyboard);
     /* Notify client of keys not handled by the server. */
-    wlr_seat_keyboard_notify_modifiers(
-        seat, &wlr_keyboard_from_input_device(device->device)->modifiers);
+    wlr_seat_keyboard_notify_modifiers(seat, &wlr_keyboard->modifiers);
+}
+
+static void
+handle_key(struct wl_listener* listener, void* data)
+{
+    struct bsi_input_keyboard_group* group =
+        wl_container_of(listener, group, listen.key);
+    keyboard_key_notify(group->server, &group->wlr_group->keyboard, data);
+}
+
+static void
+handle_modifiers(struct wl_listener* listener, void* data)
+{
+    struct bsi_input_keyboard_group* group =
+        wl_container_of(listener, group, listen.modifiers);
+    keyboard_modifiers_notify(group->server, &group->wlr_group->keyboard);
+}
+
+static void
+handle_device_key(struct wl_listener* listener, void* data)
+{
+    struct bsi_input_device* device =
+        wl_container_of(listener, device, listen.key);
+    keyboard_key_notify(
+        device->server, wlr_keyboard_from_input_device(device->device), data);
+}
+
+static void
+handle_device_modifiers(struct wl_listener* listener, void* data)
+{
+    struct bsi_input_device* device =
+        wl_container_of(listener, device, listen.modifiers);
+    keyboard_modifiers_notify(device->server,
+                              wlr_keyboard_from_input_device(device->device));
 }
 
 static void
@@ -520,6 +986,183 @@ handle_destroy(struct wl_listener* listener, void* data)
     input_device_destroy(device);
 }
 
+/* Settings no config line names are set back to the libinput defaults, so a
+ * line taken out of the config takes effect too. Nothing already set is set
+ * again. */
+static void
+input_pointer_configure(struct bsi_input_device* device)
+{
+    struct bsi_server* server = device->server;
+    if (!wlr_input_device_is_libinput(device->device)) {
+        info("Device '%s' doesn't use libinput backend, skipping",
+             device->device->name);
+        return;
+    }
+
+    struct libinput_device* libinput_dev =
+        wlr_libinput_get_device_handle(device->device);
+    double speed = libinput_device_config_accel_get_default_speed(libinput_dev);
+    enum libinput_config_accel_profile profile =
+        libinput_device_config_accel_get_default_profile(libinput_dev);
+    int natural_scroll =
+        libinput_device_config_scroll_get_default_natural_scroll_enabled(
+            libinput_dev);
+    enum libinput_config_tap_state tap =
+        libinput_device_config_tap_get_default_enabled(libinput_dev);
+
+    bool has_config = false;
+    struct bsi_input_config* conf;
+    wl_list_for_each(conf, &server->config.input, link)
+    {
+        if (strcasecmp(conf->devname, device->device->name) != 0)
+            continue;
+
+        debug("Matched config for input device '%s'", device->device->name);
+        has_config = true;
+        switch (conf->type) {
+            case BSI_CONFIG_INPUT_POINTER_ACCEL_SPEED:
+                speed = (conf->ptr_accel_speed > 0.0)
+                            ? fmax(conf->ptr_accel_speed, 1.0)
+                            : fmax(conf->ptr_accel_speed, -1.0);
+                break;
+            case BSI_CONFIG_INPUT_POINTER_ACCEL_PROFILE:
+                profile = conf->ptr_accel_profile;
+                break;
+            case BSI_CONFIG_INPUT_POINTER_SCROLL_NATURAL:
+                natural_scroll = conf->ptr_natural_scroll;
+                break;
+            case BSI_CONFIG_INPUT_POINTER_TAP:
+                tap = (conf->ptr_tap) ? LIBINPUT_CONFIG_TAP_ENABLED
+                                      : LIBINPUT_CONFIG_TAP_DISABLED;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (!has_config)
+        info("No input matching config for entry '%s'", device->device->name);
+
+    /* A device without the setting reports the default, so asking it for
+     * anything else is what fails. */
+    if (libinput_device_config_accel_get_speed(libinput_dev) != speed) {
+        if (libinput_device_config_accel_set_speed(libinput_dev, speed) ==
+            LIBINPUT_CONFIG_STATUS_UNSUPPORTED)
+            error("Setting accel_speed is unsupported");
+        else
+            debug("Set accel_speed %.2f", speed);
+    }
+    if (libinput_device_config_accel_get_profile(libinput_dev) != profile) {
+        if (libinput_device_config_accel_set_profile(libinput_dev, profile) ==
+            LIBINPUT_CONFIG_STATUS_UNSUPPORTED)
+            error("Setting accel_profile is unsupported");
+        else
+            debug("Set accel_profile %d", profile);
+    }
+    if (libinput_device_config_scroll_get_natural_scroll_enabled(
+            libinput_dev) != natural_scroll) {
+        if (libinput_device_config_scroll_set_natural_scroll_enabled(
+                libinput_dev, natural_scroll) ==
+            LIBINPUT_CONFIG_STATUS_UNSUPPORTED)
+            error("Setting natural_scroll is unsupported");
+        else
+            debug("Set natural_scroll %d", natural_scroll);
+    }
+    if (libinput_device_config_tap_get_enabled(libinput_dev) != tap) {
+        if (libinput_device_config_tap_set_enabled(libinput_dev, tap) ==
+            LIBINPUT_CONFIG_STATUS_UNSUPPORTED)
+            error("Setting tap-to-click is unsupported");
+        else
+            debug("Set tap-to-click %d", tap == LIBINPUT_CONFIG_TAP_ENABLED);
+    }
+}
+
+static void
+input_keyboard_configure(struct bsi_input_device* device)
+{
+    struct bsi_server* server = device->server;
+
+    /* Default rules. */
+    struct xkb_rule_names xkb_rules = {
+        .rules = NULL,
+        .model = NULL,
+        .layout = NULL,
+        .variant = NULL,
+        .options = NULL,
+    };
+
+    int32_t repeat_rate = 0, repeat_delay = 0;
+
+    /* Apply config. */
+    bool has_config = false;
+    struct bsi_input_config* conf;
+    wl_list_for_each(conf, &server->config.input, link)
+    {
+        if (strcasecmp(conf->devname, device->device->name) == 0) {
+            debug("Matched config for input device '%s'",
+                  device->device->name);
+            has_config = true;
+            switch (conf->type) {
+                case BSI_CONFIG_INPUT_KEYBOARD_LAYOUT:
+                    xkb_rules.layout = conf->kbd_layout;
+                    break;
+                case BSI_CONFIG_INPUT_KEYBOARD_LAYOUT_TOGGLE:
+                    xkb_rules.options = conf->kbd_layout_toggle;
+                    break;
+                case BSI_CONFIG_INPUT_KEYBOARD_REPEAT_INFO:
+                    /* The group repeats for all its keyboards. */
+                    repeat_rate = conf->kbd_repeat_rate;
+                    repeat_delay = conf->kbd_repeat_delay;
+                    break;
+                case BSI_CONFIG_INPUT_KEYBOARD_MODEL:
+                    xkb_rules.model = conf->kbd_model;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    if (!has_config)
+        info("No input matching config for entry '%s'", device->device->name);
+
+    debug("Xkb keyboard rules { rules=%s, model=%s, layout=%s, variant=%s, "
+          "options=%s }",
+          xkb_rules.rules,
+          xkb_rules.model,
+          xkb_rules.layout,
+          xkb_rules.variant,
+          xkb_rules.options);
+
+    const char* const names[5] = {
+        xkb_rules.rules,   xkb_rules.model,   xkb_rules.layout,
+        xkb_rules.variant, xkb_rules.options,
+    };
+    struct bsi_input_keyboard_group* group = device->group;
+    if (group != NULL && group->repeat_rate == repeat_rate &&
+        group->repeat_delay == repeat_delay &&
+        keymap_names_match(group->keymap->names, names))
+        return;
+
+    /* Joins the seat with its group, once the keymap is there. Other repeat
+     * info is another group, sharing the cached keymap. */
+    input_keyboard_group_leave(device);
+    input_keyboard_group_join(device, &xkb_rules, repeat_rate, repeat_delay);
+}
+
+void
+input_device_configure(struct bsi_input_device* device)
+{
+    switch (device->type) {
+        case BSI_INPUT_DEVICE_POINTER:
+            input_pointer_configure(device);
+            break;
+        case BSI_INPUT_DEVICE_KEYBOARD:
+            input_keyboard_configure(device);
+            break;
+    }
+}
+
 void
 handle_new_input(struct wl_listener* listener, void* data)
 {
@@ -582,88 +1225,7 @@ handle_new_input(struct wl_listener* listener, void* data)
 
             wlr_cursor_attach_input_device(device->cursor, device->device);
 
-            if (wlr_input_device_is_libinput(device->device)) {
-                struct libinput_device* libinput_dev =
-                    wlr_libinput_get_device_handle(device->device);
-
-                /* Apply config. */
-                bool has_config = false;
-                struct bsi_input_config* conf;
-                wl_list_for_each(conf, &server->config.input, link)
-                {
-                    if (strcasecmp(conf->devname, device->device->name) == 0) {
-                        debug("Matched config for input device '%s'",
-                              device->device->name);
-                        has_config = true;
-                        switch (conf->type) {
-                            case BSI_CONFIG_INPUT_POINTER_ACCEL_SPEED: {
-                                double speed =
-                                    (conf->ptr_accel_speed > 0.0)
-                                        ? fmax(conf->ptr_accel_speed, 1.0)
-                                        : fmax(conf->ptr_accel_speed, -1.0);
-                                if (libinput_device_config_accel_set_speed(
-                                        libinput_dev, speed) ==
-                                    LIBINPUT_CONFIG_STATUS_UNSUPPORTED) {
-                                    error("Setting accel_speed is unsupported");
-                                    break;
-                                }
-                                debug("Set accel_speed %.2f", speed);
-                                break;
-                            }
-                            case BSI_CONFIG_INPUT_POINTER_ACCEL_PROFILE: {
-                                if (libinput_device_config_accel_set_profile(
-                                        libinput_dev,
-                                        conf->ptr_accel_profile) ==
-                                    LIBINPUT_CONFIG_STATUS_UNSUPPORTED) {
-                                    error(
-                                        "Setting accel_profile is unsupported");
-                                    break;
-                                }
-                                debug("Set accel_profile %d",
-                                      conf->ptr_accel_profile);
-                                break;
-                            }
-                            case BSI_CONFIG_INPUT_POINTER_SCROLL_NATURAL: {
-                                if (libinput_device_config_scroll_set_natural_scroll_enabled(
-                                        libinput_dev,
-                                        conf->ptr_natural_scroll) ==
-                                    LIBINPUT_CONFIG_STATUS_UNSUPPORTED) {
-                                    error("Setting natural_scroll is "
-                                          "unsupported");
-                                    break;
-                                }
-                                debug("Set natural_scroll %d",
-                                      conf->ptr_natural_scroll);
-                                break;
-                            }
-                            case BSI_CONFIG_INPUT_POINTER_TAP: {
-                                enum libinput_config_tap_state enable =
-                                    (conf->ptr_tap)
-                                        ? LIBINPUT_CONFIG_TAP_ENABLED
-                                        : LIBINPUT_CONFIG_TAP_DISABLED;
-                                if (libinput_device_config_tap_set_enabled(
-                                        libinput_dev, enable) ==
-                                    LIBINPUT_CONFIG_STATUS_UNSUPPORTED) {
-                                    error("Setting tap-to-click is "
-                                          "unsupported");
-                                    break;
-                                }
-                                debug("Set tap-to-click %d", conf->ptr_tap);
-                                break;
-                            }
-                            default:
-                                break;
-                        }
-                    }
-                }
-
-                if (!has_config)
-                    info("No input matching config for entry '%s'",
-                         device->device->name);
-            } else {
-                info("Device '%s' doesn't use libinput backend, skipping",
-                     device->device->name);
-            }
+            input_device_configure(device);
 
             info("Added new pointer input device '%s' (vendor %x, product %x)",
                  device->device->name,
@@ -678,78 +1240,12 @@ handle_new_input(struct wl_listener* listener, void* data)
                 device, BSI_INPUT_DEVICE_KEYBOARD, server, wlr_device);
             inputs_add(server, device);
 
-            util_slot_connect(
-                &wlr_keyboard_from_input_device(device->device)->events.key,
-                &device->listen.key,
-                handle_key);
-            util_slot_connect(&wlr_keyboard_from_input_device(device->device)
-                                   ->events.modifiers,
-                              &device->listen.modifiers,
-                              handle_modifiers);
+            /* Keys and modifiers come from the keyboard group. */
             util_slot_connect(&device->device->events.destroy,
                               &device->listen.destroy,
                               handle_destroy);
 
-            /* Default rules. */
-            struct xkb_rule_names xkb_rules = {
-                .rules = NULL,
-                .model = NULL,
-                .layout = NULL,
-                .variant = NULL,
-                .options = NULL,
-            };
-
-            /* Apply config. */
-            bool has_config = false;
-            struct bsi_input_config* conf;
-            wl_list_for_each(conf, &server->config.input, link)
-            {
-                if (strcasecmp(conf->devname, device->device->name) == 0) {
-                    debug("Matched config for input device '%s'",
-                          device->device->name);
-                    has_config = true;
-                    switch (conf->type) {
-                        case BSI_CONFIG_INPUT_KEYBOARD_LAYOUT:
-                            xkb_rules.layout = conf->kbd_layout;
-                            break;
-                        case BSI_CONFIG_INPUT_KEYBOARD_LAYOUT_TOGGLE:
-                            xkb_rules.options = conf->kbd_layout_toggle;
-                            break;
-                        case BSI_CONFIG_INPUT_KEYBOARD_REPEAT_INFO:
-                            wlr_keyboard_set_repeat_info(
-                                wlr_keyboard_from_input_device(device->device),
-                                conf->kbd_repeat_rate,
-                                conf->kbd_repeat_delay);
-                            debug("Set repeat info { rate=%d, delay=%d }",
-                                  conf->kbd_repeat_rate,
-                                  conf->kbd_repeat_delay);
-                            break;
-                        case BSI_CONFIG_INPUT_KEYBOARD_MODEL:
-                            xkb_rules.model = conf->kbd_model;
-                            break;
-                        default:
-                            break;
-                    }
-                }
-            }
-
-            if (!has_config)
-                info("No input matching config for entry '%s'",
-                     device->device->name);
-
-            debug("Xkb keyboard rules { rules=%s, model=%s, layout=%s, "
-                  "variant=%s, options=%s }",
-                  xkb_rules.rules,
-                  xkb_rules.model,
-                  xkb_rules.layout,
-                  xkb_rules.variant,
-                  xkb_rules.options);
-
-            input_device_keymap_set(device, &xkb_rules);
-
-            wlr_seat_set_keyboard(
-                server->wlr_seat,
-                wlr_keyboard_from_input_device(device->device));
+            input_device_configure(device);
 
             info("Added new keyboard input device '%s' (vendor %x, product %x)",
                  device->device->name,
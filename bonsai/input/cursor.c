@@ -1,9 +1,18 @@
+#include <errno.h>
 #include <math.h>
+#include <pixman.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_pointer.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_subcompositor.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_decoration_v1.h>
 #include <wlr/types/wlr_xdg_shell.h>
@@ -17,6 +26,7 @@
 #include "bonsai/log.h"
 #include "bonsai/output.h"
 #include "bonsai/server.h"
+#include "bonsai/util.h"
 
 static const char* bsi_cursor_image_map[] = {
     [BSI_CURSOR_IMAGE_NORMAL] = "left_ptr",
@@ -40,6 +50,333 @@ cursor_image_set(struct bsi_server* server, enum bsi_cursor_image cursor_image)
                                          server->wlr_cursor);
 }
 
+struct bsi_cursor_surface
+{
+    struct bsi_server* server;
+    struct wlr_surface* surface;
+    /* Where its subsurfaces were and in what order, as of the last commit. */
+    uint64_t subsurfaces_hash;
+    struct
+    {
+        /* wlr_surface */
+        struct wl_listener commit;
+        struct wl_listener destroy;
+    } listen;
+};
+
+/* Surface state that can only change what is drawn, not where. */
+static const uint32_t cursor_content_state =
+    WLR_SURFACE_STATE_BUFFER | WLR_SURFACE_STATE_SURFACE_DAMAGE |
+    WLR_SURFACE_STATE_BUFFER_DAMAGE | WLR_SURFACE_STATE_FRAME_CALLBACK_LIST;
+
+static void
+cursor_hit_clear(struct bsi_server* server)
+{
+    if (server->cursor.hit.scene_surface)
+        util_slot_disconnect(&server->cursor.hit.destroy);
+    server->cursor.hit.scene_surface = NULL;
+    server->cursor.hit.data = NULL;
+    pixman_region32_clear(&server->cursor.hit.region);
+}
+
+static void
+handle_hit_destroy(struct wl_listener* listener, void* data)
+{
+    struct bsi_server* server =
+        wl_container_of(listener, server, cursor.hit.destroy);
+    cursor_hit_clear(server);
+}
+
+/* Subsurfaces are placed and stacked by the commits of their parent. */
+static uint64_t
+cursor_subsurfaces_hash(struct wlr_surface* surface)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+    struct wl_list* lists[] = {
+        &surface->current.subsurfaces_below,
+        &surface->current.subsurfaces_above,
+    };
+    for (size_t i = 0; i < 2; ++i) {
+        struct wlr_subsurface* subsurface;
+        wl_list_for_each(subsurface, lists[i], current.link)
+        {
+            uint64_t values[] = {
+                (uintptr_t)subsurface,
+                (uint32_t)subsurface->current.x,
+                (uint32_t)subsurface->current.y,
+            };
+            for (size_t j = 0; j < 3; ++j)
+                hash = (hash ^ values[j]) * UINT64_C(1099511628211);
+        }
+        hash = (hash ^ i) * UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+static void
+handle_surface_commit(struct wl_listener* listener, void* data)
+{
+    struct bsi_cursor_surface* cursor_surface =
+        wl_container_of(listener, cursor_surface, listen.commit);
+    struct wlr_surface* surface = cursor_surface->surface;
+    struct wlr_surface_state* current = &surface->current;
+    struct wlr_surface_state* previous = &surface->previous;
+
+    bool invalid = current->committed & ~cursor_content_state ||
+                   current->width != previous->width ||
+                   current->height != previous->height;
+    /* Most commits of a surface with subsurfaces, say a video player, only
+     * bring a new buffer, the subsurfaces stay put. */
+    if (!wl_list_empty(&current->subsurfaces_below) ||
+        !wl_list_empty(&current->subsurfaces_above) ||
+        cursor_surface->subsurfaces_hash != 0) {
+        uint64_t hash = cursor_subsurfaces_hash(surface);
+        if (hash != cursor_surface->subsurfaces_hash) {
+            cursor_surface->subsurfaces_hash = hash;
+            invalid = true;
+        }
+    }
+    if (invalid)
+        cursor_scene_invalidate(cursor_surface->server);
+}
+
+static void
+handle_surface_destroy(struct wl_listener* listener, void* data)
+{
+    struct bsi_cursor_surface* cursor_surface =
+        wl_container_of(listener, cursor_surface, listen.destroy);
+    cursor_scene_invalidate(cursor_surface->server);
+    util_slot_disconnect(&cursor_surface->listen.commit);
+    util_slot_disconnect(&cursor_surface->listen.destroy);
+    free(cursor_surface);
+}
+
+void
+handle_compositor_new_surface(struct wl_listener* listener, void* data)
+{
+    debug("Got event new_surface from wlr_compositor");
+
+    struct bsi_server* server =
+        wl_container_of(listener, server, listen.compositor_new_surface);
+    struct wlr_surface* surface = data;
+
+    struct bsi_cursor_surface* cursor_surface =
+        calloc(1, sizeof(struct bsi_cursor_surface));
+    if (cursor_surface == NULL) {
+        /* Without a watch on this surface, the caches cannot be trusted. */
+        errn("Failed to watch new surface, hit-test caching is unreliable");
+        return;
+    }
+    cursor_surface->server = server;
+    cursor_surface->surface = surface;
+    util_slot_connect(&surface->events.commit,
+                      &cursor_surface->listen.commit,
+                      handle_surface_commit);
+    util_slot_connect(&surface->events.destroy,
+                      &cursor_surface->listen.destroy,
+                      handle_surface_destroy);
+}
+
+void
+cursor_scene_invalidate(struct bsi_server* server)
+{
+    ++server->scene.serial;
+}
+
+void
+cursor_hit_index_destroy(struct bsi_cursor_hit_index* index)
+{
+    free(index->entries);
+    index->entries = NULL;
+    index->len = index->cap = 0;
+}
+
+static void
+scene_buffer_box(struct wlr_scene_buffer* scene_buffer,
+                 int lx,
+                 int ly,
+                 struct wlr_box* box)
+{
+    box->x = lx;
+    box->y = ly;
+    box->width = scene_buffer->dst_width;
+    box->height = scene_buffer->dst_height;
+    if ((box->width == 0 || box->height == 0) && scene_buffer->buffer) {
+        box->width = scene_buffer->buffer->width;
+        box->height = scene_buffer->buffer->height;
+        if (scene_buffer->transform & WL_OUTPUT_TRANSFORM_90) {
+            int32_t tmp = box->width;
+            box->width = box->height;
+            box->height = tmp;
+        }
+    }
+}
+
+static void
+hit_index_extend_box(struct wlr_scene_buffer* scene_buffer,
+                     int lx,
+                     int ly,
+                     void* user_data)
+{
+    struct wlr_box* extents = user_data;
+    struct wlr_box box;
+    scene_buffer_box(scene_buffer, lx, ly, &box);
+    if (wlr_box_empty(&box))
+        return;
+
+    if (wlr_box_empty(extents)) {
+        *extents = box;
+        return;
+    }
+
+    int32_t x1 = extents->x < box.x ? extents->x : box.x;
+    int32_t y1 = extents->y < box.y ? extents->y : box.y;
+    int32_t x2 = extents->x + extents->width > box.x + box.width
+                     ? extents->x + extents->width
+                     : box.x + box.width;
+    int32_t y2 = extents->y + extents->height > box.y + box.height
+                     ? extents->y + extents->height
+                     : box.y + box.height;
+    *extents = (struct wlr_box){ x1, y1, x2 - x1, y2 - y1 };
+}
+
+static bool
+hit_index_add(struct bsi_server* server,
+              struct bsi_output* output,
+              struct wlr_scene_tree* tree,
+              const struct wlr_box* output_box)
+{
+    struct bsi_cursor_hit_index* index = &output->hit;
+    struct wlr_scene_node* node;
+    wl_list_for_each_reverse(node, &tree->children, link)
+    {
+        /* Debug overlays are not there for input. */
+        if (!node->enabled || node == &server->overlay.tree->node)
+            continue;
+
+        /* Output and workspace trees only group views, what is indexed is
+         * the views and layer surfaces in them. */
+        if (node->type == WLR_SCENE_NODE_TREE && node->data == NULL) {
+            struct wlr_scene_tree* subtree =
+                wl_container_of(node, subtree, node);
+            if (!hit_index_add(server, output, subtree, output_box))
+                return false;
+            continue;
+        }
+
+        struct wlr_box box = { 0 };
+        wlr_scene_node_for_each_buffer(node, hit_index_extend_box, &box);
+        if (!wlr_box_intersection(&box, &box, output_box))
+            continue;
+
+        if (index->len == index->cap) {
+            size_t cap = index->cap ? index->cap * 2 : 16;
+            struct bsi_cursor_hit_entry* entries =
+                realloc(index->entries, cap * sizeof(*entries));
+            if (entries == NULL) {
+                errn("Failed to grow hit-test index of output %s",
+                     output->output->name);
+                return false;
+            }
+            index->entries = entries;
+            index->cap = cap;
+        }
+        index->entries[index->len++] =
+            (struct bsi_cursor_hit_entry){ .node = node, .box = box };
+    }
+    return true;
+}
+
+static void
+hit_index_rebuild(struct bsi_server* server, struct bsi_output* output)
+{
+    struct bsi_cursor_hit_index* index = &output->hit;
+    struct wlr_box output_box;
+    wlr_output_layout_get_box(
+        server->wlr_output_layout, output->output, &output_box);
+
+    index->len = 0;
+    if (!hit_index_add(server, output, &server->wlr_scene->tree, &output_box)) {
+        /* Leave it stale, so the next lookup retries. */
+        index->serial = server->scene.serial - 1;
+        return;
+    }
+    index->serial = server->scene.serial;
+}
+
+struct hit_region_data
+{
+    struct wlr_scene_buffer* hit;
+    bool above;
+    pixman_region32_t* region;
+};
+
+static void
+hit_region_subtract_above(struct wlr_scene_buffer* scene_buffer,
+                          int lx,
+                          int ly,
+                          void* user_data)
+{
+    /* Buffers are iterated in rendering order, everything after the hit buffer
+     * is drawn over it. */
+    struct hit_region_data* hit_data = user_data;
+    if (scene_buffer == hit_data->hit) {
+        hit_data->above = true;
+        return;
+    }
+    if (!hit_data->above)
+        return;
+
+    struct wlr_box box;
+    pixman_region32_t above;
+    scene_buffer_box(scene_buffer, lx, ly, &box);
+    pixman_region32_init_rect(&above, box.x, box.y, box.width, box.height);
+    pixman_region32_subtract(hit_data->region, hit_data->region, &above);
+    pixman_region32_fini(&above);
+}
+
+static void
+hit_region_build(struct bsi_server* server,
+                 struct bsi_output* output,
+                 size_t entry_at,
+                 struct wlr_scene_surface* scene_surface)
+{
+    struct bsi_cursor_hit_index* index = &output->hit;
+    pixman_region32_t* region = &server->cursor.hit.region;
+    struct wlr_box output_box;
+    wlr_output_layout_get_box(
+        server->wlr_output_layout, output->output, &output_box);
+
+    /* The cached hit holds where the input region of the surface is visible:
+     * inside the output, and not covered by any buffer above it. */
+    pixman_region32_copy(region, &scene_surface->surface->input_region);
+    pixman_region32_translate(
+        region, server->cursor.hit.lx, server->cursor.hit.ly);
+    pixman_region32_intersect_rect(region,
+                                   region,
+                                   output_box.x,
+                                   output_box.y,
+                                   output_box.width,
+                                   output_box.height);
+
+    for (size_t i = 0; i < entry_at; ++i) {
+        struct wlr_box* box = &index->entries[i].box;
+        pixman_region32_t above;
+        pixman_region32_init_rect(
+            &above, box->x, box->y, box->width, box->height);
+        pixman_region32_subtract(region, region, &above);
+        pixman_region32_fini(&above);
+    }
+
+    struct hit_region_data hit_data = {
+        .hit = scene_surface->buffer,
+        .above = false,
+        .region = region,
+    };
+    wlr_scene_node_for_each_buffer(
+        index->entries[entry_at].node, hit_region_subtract_above, &hit_data);
+}
+
 void*
 cursor_scene_data_at(struct bsi_server* server,
                      struct wlr_scene_surface** scene_surface_at,
@@ -48,14 +385,51 @@ cursor_scene_data_at(struct bsi_server* server,
                      double* sx,
                      double* sy)
 {
-    /* Search the server root node for the node at the coordinates
-     * given by the cursor event. This is not necessarily the topmost node! */
-    struct wlr_scene_node* node =
-        wlr_scene_node_at(&server->wlr_scene->tree.node,
-                          server->wlr_cursor->x,
-                          server->wlr_cursor->y,
-                          sx,
-                          sy);
+    const double x = server->wlr_cursor->x, y = server->wlr_cursor->y;
+    struct wlr_scene_surface* scene_surface = server->cursor.hit.scene_surface;
+
+    /* Fast path, the cursor is still over the visible part of the last hit and
+     * nothing in the scene moved since. */
+    if (scene_surface && server->cursor.hit.serial == server->scene.serial &&
+        pixman_region32_contains_point(
+            &server->cursor.hit.region, floor(x), floor(y), NULL)) {
+        int lx, ly;
+        wlr_scene_node_coords(&scene_surface->buffer->node, &lx, &ly);
+        if (lx == server->cursor.hit.lx && ly == server->cursor.hit.ly) {
+            ++server->cursor.hit.hits;
+            *sx = x - lx;
+            *sy = y - ly;
+            *scene_surface_at = scene_surface;
+            *surface_at = scene_surface->surface;
+            *surface_role = scene_surface->surface->role->name;
+            return server->cursor.hit.data;
+        }
+    }
+
+    ++server->cursor.hit.misses;
+    cursor_hit_clear(server);
+
+    struct wlr_output* wlr_output =
+        wlr_output_layout_output_at(server->wlr_output_layout, x, y);
+    if (wlr_output == NULL)
+        return NULL;
+
+    struct bsi_output* output = wlr_output->data;
+    if (output->hit.serial != server->scene.serial)
+        hit_index_rebuild(server, output);
+
+    /* Only the topmost nodes that cover the cursor need to be searched. This is
+     * not necessarily the topmost node! */
+    struct wlr_scene_node* node = NULL;
+    size_t entry_at = 0;
+    for (; entry_at < output->hit.len; ++entry_at) {
+        struct bsi_cursor_hit_entry* entry = &output->hit.entries[entry_at];
+        if (!wlr_box_contains_point(&entry->box, x, y))
+            continue;
+        node = wlr_scene_node_at(entry->node, x, y, sx, sy);
+        if (node != NULL)
+            break;
+    }
 
     /* If this node is not a buffer node (eg. is rect, root, tree), then return
      * `NULL`. */
@@ -63,8 +437,7 @@ cursor_scene_data_at(struct bsi_server* server,
         return NULL;
 
     struct wlr_scene_buffer* scene_buffer = wlr_scene_buffer_from_node(node);
-    struct wlr_scene_surface* scene_surface =
-        wlr_scene_surface_from_buffer(scene_buffer);
+    scene_surface = wlr_scene_surface_from_buffer(scene_buffer);
 
     if (!scene_surface)
         return NULL;
@@ -75,16 +448,94 @@ cursor_scene_data_at(struct bsi_server* server,
     *surface_role = scene_surface->surface->role->name;
 
     /* Find the actual topmost node of this node tree. */
-    while (node != NULL && node->data == NULL)
+    while (node->data == NULL && node->parent != NULL)
         node = &node->parent->node;
 
+    if (node->data == NULL)
+        return NULL;
+
+    /* Remember the hit for the next motion event. */
+    int lx, ly;
+    wlr_scene_node_coords(&scene_buffer->node, &lx, &ly);
+    server->cursor.hit.serial = server->scene.serial;
+    server->cursor.hit.scene_surface = scene_surface;
+    server->cursor.hit.data = node->data;
+    server->cursor.hit.lx = lx;
+    server->cursor.hit.ly = ly;
+    hit_region_build(server, output, entry_at, scene_surface);
+    util_slot_connect(&scene_buffer->node.events.destroy,
+                      &server->cursor.hit.destroy,
+                      handle_hit_destroy);
+
     return node->data;
 }
 
+void
+cursor_motion_defer(struct bsi_server* server,
+                    uint32_t time_msec,
+                    double dx,
+                    double dy)
+{
+    struct wlr_seat* seat = server->wlr_seat;
+    struct wlr_cursor* cursor = server->wlr_cursor;
+
+    server->cursor.motion.time_msec = time_msec;
+    server->cursor.motion.dx += dx;
+    server->cursor.motion.dy += dy;
+
+    /* Clients get precise motion relative to the surface that already has
+     * pointer focus. Hit-testing for focus changes waits for the frame. */
+    struct wlr_scene_surface* scene_surface = server->cursor.hit.scene_surface;
+    if (server->cursor.cursor_mode == BSI_CURSOR_NORMAL && scene_surface &&
+        seat->pointer_state.focused_surface == scene_surface->surface) {
+        wlr_seat_pointer_notify_motion(seat,
+                                       time_msec,
+                                       cursor->x - server->cursor.hit.lx,
+                                       cursor->y - server->cursor.hit.ly);
+    }
+
+    if (server->cursor.motion.pending)
+        return;
+    server->cursor.motion.pending = true;
+
+    struct wlr_output* wlr_output = wlr_output_layout_output_at(
+        server->wlr_output_layout, cursor->x, cursor->y);
+    if (wlr_output == NULL || !wlr_output->enabled) {
+        /* No frame clock to align to. */
+        cursor_motion_flush(server);
+        return;
+    }
+
+    /* A hardware cursor doesn't damage the output, make sure a frame comes. */
+    wlr_output_schedule_frame(wlr_output);
+}
+
+void
+cursor_motion_flush(struct bsi_server* server)
+{
+    if (!server->cursor.motion.pending)
+        return;
+
+    struct wlr_pointer_motion_event event = {
+        .pointer = NULL,
+        .time_msec = server->cursor.motion.time_msec,
+        .delta_x = server->cursor.motion.dx,
+        .delta_y = server->cursor.motion.dy,
+        .unaccel_dx = server->cursor.motion.dx,
+        .unaccel_dy = server->cursor.motion.dy,
+    };
+    server->cursor.motion.pending = false;
+    server->cursor.motion.dx = server->cursor.motion.dy = 0;
+
+    cursor_process_motion(server, (union bsi_cursor_event){ .motion = &event });
+}
+
 void
 cursor_process_motion(struct bsi_server* server,
                       union bsi_cursor_event cursor_event)
 {
+    ++server->cursor.motion.processed;
+
     if (server->cursor.cursor_mode == BSI_CURSOR_MOVE) {
         cursor_process_view_move(server, cursor_event);
     } else if (server->cursor.cursor_mode == BSI_CURSOR_RESIZE) {
@@ -157,6 +608,7 @@ cursor_process_view_move(struct bsi_server* server,
           event->delta_y);
     debug("Moving view to coords (%d, %d)", view->geom.x, view->geom.y);
     wlr_scene_node_set_position(&view->tree->node, view->geom.x, view->geom.y);
+    cursor_scene_invalidate(server);
 }
 
 void
@@ -205,30 +657,26 @@ cursor_process_view_resize(struct bsi_server* server,
     struct wlr_box box;
     wlr_xdg_surface_get_geometry(view->wlr_xdg_toplevel->base, &box);
 
-    /* Set new view position. Account for possible titlebars, etc. Clients will
-     * not be limited when moving under layer surfaces above them.*/
-    view->geom.x = new_left - box.x;
-    view->geom.y = new_top - box.y;
+    /* Set new view size, paced by the client acking it. The position accounts
+     * for possible titlebars, etc. and is applied when the client draws the
+     * new size, so the opposite edges don't move in the meantime. Clients will
+     * not be limited when moving under layer surfaces above them. */
     view->geom.width = box.width;
     view->geom.height = box.height;
-    wlr_scene_node_set_position(&view->tree->node, view->geom.x, view->geom.y);
-
-    wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, true);
-
-    /* Set new view size. */
-    wlr_xdg_toplevel_set_size(
-        view->wlr_xdg_toplevel, new_right - new_left, new_bottom - new_top);
-
-    wlr_xdg_toplevel_set_resizing(view->wlr_xdg_toplevel, false);
+    view_request_size(view,
+                      new_left - box.x,
+                      new_top - box.y,
+                      new_right - new_left,
+                      new_bottom - new_top);
 
     debug("Pointer delta is { dx=%.2lf, dy=%.2lf }",
           event->delta_x,
           event->delta_y);
-    debug("New view geometry is { x=%d, y=%d, w=%d, h=%d }",
-          view->geom.x,
-          view->geom.y,
-          view->geom.width,
-          view->geom.height);
+    debug("Requested view geometry { x=%d, y=%d, w=%d, h=%d }",
+          new_left - box.x,
+          new_top - box.y,
+          new_right - new_left,
+          new_bottom - new_top);
 }
 
 void
@@ -0,0 +1,520 @@
+/* Keybindings are compiled into an open addressing table when they are loaded,
+ * the default ones first and then those from the config `bind` lines. A key
+ * press is then a single lookup of the held modifiers and the keysym, with
+ * everything the binding needs, like the exec argp, ready beforehand. */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <wlr/backend.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <xkbcommon/xkbcommon-keysyms.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "bonsai/config/config.h"
+#include "bonsai/desktop/view.h"
+#include "bonsai/desktop/workspace.h"
+#include "bonsai/input/keybinds.h"
+#include "bonsai/launcher.h"
+#include "bonsai/log.h"
+#include "bonsai/output.h"
+#include "bonsai/overlay.h"
+#include "bonsai/server.h"
+#include "bonsai/util.h"
+
+/* The longest command a formatted binding can have. */
+#define BSI_KEYBIND_CMD_MAX 256
+
+/* Loaded before the config, which can replace or unbind any of these. */
+static const char* keybinds_default[] = {
+    "bind Print screenshot all",
+    "bind Escape fullscreen off",
+    "bind F11 fullscreen on",
+    "bind Ctrl+Print screenshot output",
+    "bind Ctrl+Shift+Print screenshot selection",
+    "bind Alt+Tab views cycle",
+    "bind Super+l exec swaylock",
+    "bind Super+d exec bemenu-run -c -i",
+    "bind Super+Return exec foot",
+    "bind Super+Up maximize on",
+    "bind Super+Down maximize off",
+    "bind Super+Left tile left",
+    "bind Super+Right tile right",
+    "bind Super+x views hide",
+    "bind Super+z views show",
+    "bind Super+h toggle hud",
+    "bind Ctrl+Alt+Right workspace next",
+    "bind Ctrl+Alt+Left workspace prev",
+    "bind Ctrl+Alt+Shift+d toggle damage",
+    "bind Super+Shift+q exit",
+};
+
+static const struct
+{
+    const char* name;
+    uint32_t mod;
+} keybind_mods[] = {
+    { "super", WLR_MODIFIER_LOGO },   { "logo", WLR_MODIFIER_LOGO },
+    { "mod4", WLR_MODIFIER_LOGO },    { "ctrl", WLR_MODIFIER_CTRL },
+    { "control", WLR_MODIFIER_CTRL }, { "alt", WLR_MODIFIER_ALT },
+    { "mod1", WLR_MODIFIER_ALT },     { "shift", WLR_MODIFIER_SHIFT },
+};
+
+/* Actions that take a fixed argument, or none. */
+static const struct
+{
+    const char* name;
+    const char* arg;
+    enum bsi_keybind_action action;
+    int value;
+} keybind_actions[] = {
+    { "none", "", BSI_KEYBIND_NONE, 0 },
+    { "fullscreen", "on", BSI_KEYBIND_FULLSCREEN, true },
+    { "fullscreen", "off", BSI_KEYBIND_FULLSCREEN, false },
+    { "maximize", "on", BSI_KEYBIND_MAXIMIZE, true },
+    { "maximize", "off", BSI_KEYBIND_MAXIMIZE, false },
+    { "tile", "left", BSI_KEYBIND_TILE, false },
+    { "tile", "right", BSI_KEYBIND_TILE, true },
+    { "views", "show", BSI_KEYBIND_VIEWS_SHOW, true },
+    { "views", "hide", BSI_KEYBIND_VIEWS_SHOW, false },
+    { "views", "cycle", BSI_KEYBIND_VIEWS_CYCLE, 0 },
+    { "workspace", "next", BSI_KEYBIND_WORKSPACE, true },
+    { "workspace", "prev", BSI_KEYBIND_WORKSPACE, false },
+    { "toggle", "damage", BSI_KEYBIND_DAMAGE, 0 },
+    { "toggle", "hud", BSI_KEYBIND_HUD, 0 },
+    { "exit", "", BSI_KEYBIND_EXIT, 0 },
+};
+
+static size_t
+keybind_hash(uint32_t mods, xkb_keysym_t sym)
+{
+    uint32_t hash = sym * UINT32_C(2654435761) ^ mods * UINT32_C(40503);
+    return hash ^ (hash >> 16);
+}
+
+static void
+keybind_fini(struct bsi_keybind* keybind)
+{
+    for (size_t i = 0; keybind->argp && i < keybind->len_argp; ++i)
+        free(keybind->argp[i]);
+    free(keybind->argp);
+    keybind->argp = NULL;
+    keybind->len_argp = 0;
+}
+
+/* The slot holding the combination, or the free slot it would go in. */
+static struct bsi_keybind*
+keybinds_slot(struct bsi_keybind* slots,
+              size_t len_slots,
+              uint32_t mods,
+              xkb_keysym_t sym)
+{
+    size_t mask = len_slots - 1;
+    for (size_t i = keybind_hash(mods, sym) & mask;; i = (i + 1) & mask) {
+        struct bsi_keybind* slot = &slots[i];
+        if (slot->sym == XKB_KEY_NoSymbol ||
+            (slot->sym == sym && slot->mods == mods))
+            return slot;
+    }
+}
+
+static bool
+keybinds_grow(struct bsi_keybinds* keybinds)
+{
+    size_t len_slots = keybinds->len_slots ? keybinds->len_slots * 2
+                                           : BSI_KEYBINDS_SLOTS_MIN;
+    struct bsi_keybind* slots = calloc(len_slots, sizeof(struct bsi_keybind));
+    if (slots == NULL) {
+        errn("Failed to allocate %ld keybind slots", len_slots);
+        return false;
+    }
+
+    for (size_t i = 0; i < keybinds->len_slots; ++i) {
+        struct bsi_keybind* keybind = &keybinds->slots[i];
+        if (keybind->sym != XKB_KEY_NoSymbol)
+            *keybinds_slot(slots, len_slots, keybind->mods, keybind->sym) =
+                *keybind;
+    }
+    free(keybinds->slots);
+    keybinds->slots = slots;
+    keybinds->len_slots = len_slots;
+    return true;
+}
+
+static bool
+keybind_parse_combo(char* combo, uint32_t* mods, xkb_keysym_t* sym)
+{
+    char *save = NULL, *key = NULL;
+    *mods = 0;
+    for (char* tok = strtok_r(combo, "+", &save); tok != NULL;
+         tok = strtok_r(NULL, "+", &save)) {
+        if (key != NULL) {
+            /* Everything before the key is a modifier. */
+            uint32_t mod = 0;
+            for (size_t i = 0; i < sizeof(keybind_mods) / sizeof(*keybind_mods);
+                 ++i) {
+                if (strcasecmp(keybind_mods[i].name, key) == 0)
+                    mod = keybind_mods[i].mod;
+            }
+            if (mod == 0)
+                return false;
+            *mods |= mod;
+        }
+        key = tok;
+    }
+    if (key == NULL)
+        return false;
+
+    *sym = xkb_keysym_to_lower(
+        xkb_keysym_from_name(key, XKB_KEYSYM_CASE_INSENSITIVE));
+    return *sym != XKB_KEY_NoSymbol;
+}
+
+/* Finds the executable now, so a key press doesn't have to. One that isn't
+ * installed is looked for again on every press. */
+static void
+keybind_resolve(struct bsi_keybind* keybind)
+{
+    char path[256];
+    if (util_findexec(keybind->argp[0], path, sizeof(path))) {
+        free(keybind->argp[0]);
+        keybind->argp[0] = strdup(path);
+        keybind->resolved = true;
+    }
+}
+
+static bool
+keybind_compile_exec(struct bsi_keybind* keybind, char* args)
+{
+    size_t len_args = 0;
+    char* save = NULL;
+    char* argp[64];
+    for (char* tok = strtok_r(args, " \t", &save);
+         tok != NULL && len_args < sizeof(argp) / sizeof(*argp) - 1;
+         tok = strtok_r(NULL, " \t", &save))
+        argp[len_args++] = tok;
+    if (len_args == 0)
+        return false;
+
+    keybind->argp = calloc(len_args + 1, sizeof(char*));
+    if (keybind->argp == NULL)
+        return false;
+    keybind->len_argp = len_args + 1;
+    for (size_t i = 0; i < len_args; ++i)
+        keybind->argp[i] = strdup(argp[i]);
+    keybind_resolve(keybind);
+    return true;
+}
+
+static bool
+keybind_compile_shell(struct bsi_keybind* keybind, const char* cmd)
+{
+    if (*cmd == '\0')
+        return false;
+
+    keybind->argp = calloc(4, sizeof(char*));
+    if (keybind->argp == NULL)
+        return false;
+    keybind->len_argp = 4;
+    keybind->argp[0] = strdup("sh");
+    keybind->argp[1] = strdup("-c");
+    if (keybind->format != NULL) {
+        /* Formatted at every press, into a buffer that is always there. */
+        keybind->argp[2] = calloc(BSI_KEYBIND_CMD_MAX, sizeof(char));
+    } else {
+        keybind->argp[2] = strdup(cmd);
+    }
+    keybind_resolve(keybind);
+    return true;
+}
+
+static bool
+keybind_compile(struct bsi_keybind* keybind, const char* name, char* args)
+{
+    if (strcasecmp("exec", name) == 0) {
+        keybind->action = BSI_KEYBIND_EXEC;
+        return keybind_compile_exec(keybind, args);
+    } else if (strcasecmp("shell", name) == 0) {
+        keybind->action = BSI_KEYBIND_EXEC;
+        return keybind_compile_shell(keybind, args);
+    } else if (strcasecmp("screenshot", name) == 0) {
+        keybind->action = BSI_KEYBIND_EXEC;
+        if (strcasecmp("all", args) == 0)
+            return keybind_compile_shell(keybind, "grim - | wl-copy");
+        if (strcasecmp("selection", args) == 0)
+            return keybind_compile_shell(keybind,
+                                         "grim -g \"$(slurp)\" - | wl-copy");
+        if (strcasecmp("output", args) == 0) {
+            keybind->action = BSI_KEYBIND_EXEC_OUTPUT;
+            keybind->format = "grim -o %s - | wl-copy";
+            return keybind_compile_shell(keybind, keybind->format);
+        }
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(keybind_actions) / sizeof(*keybind_actions);
+         ++i) {
+        if (strcasecmp(keybind_actions[i].name, name) == 0 &&
+            strcasecmp(keybind_actions[i].arg, args) == 0) {
+            keybind->action = keybind_actions[i].action;
+            keybind->value = keybind_actions[i].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct bsi_keybinds*
+keybinds_init(struct bsi_keybinds* keybinds)
+{
+    keybinds->slots = NULL;
+    keybinds->len_slots = 0;
+    keybinds->len = 0;
+    for (size_t i = 0; i < sizeof(keybinds_default) / sizeof(*keybinds_default);
+         ++i)
+        keybinds_add(keybinds, keybinds_default[i]);
+    return keybinds;
+}
+
+void
+keybinds_destroy(struct bsi_keybinds* keybinds)
+{
+    for (size_t i = 0; i < keybinds->len_slots; ++i)
+        keybind_fini(&keybinds->slots[i]);
+    free(keybinds->slots);
+    keybinds->slots = NULL;
+    keybinds->len_slots = 0;
+    keybinds->len = 0;
+}
+
+bool
+keybinds_add(struct bsi_keybinds* keybinds, const char* line)
+{
+    /* Syntax: bind <mods+key> <action> [args] */
+    char* copy = strdup(line);
+    if (copy == NULL)
+        return false;
+    size_t len_copy = strlen(copy);
+
+    struct bsi_keybind keybind = { 0 };
+    char* save = NULL;
+    char* keyword = strtok_r(copy, " \t", &save);
+    char* combo = strtok_r(NULL, " \t", &save);
+    char* name = strtok_r(NULL, " \t", &save);
+    if (keyword == NULL || combo == NULL || name == NULL ||
+        strcasecmp("bind", keyword))
+        goto error;
+
+    /* The arguments are the rest of the line, as is. */
+    size_t end_name = name - copy + strlen(name);
+    char* args = end_name < len_copy ? copy + end_name + 1 : copy + len_copy;
+    args += strspn(args, " \t");
+
+    if (!keybind_parse_combo(combo, &keybind.mods, &keybind.sym))
+        goto error;
+    if (!keybind_compile(&keybind, name, args)) {
+        keybind_fini(&keybind);
+        goto error;
+    }
+
+    if ((keybinds->len + 1) * 2 > keybinds->len_slots &&
+        !keybinds_grow(keybinds)) {
+        keybind_fini(&keybind);
+        free(copy);
+        return false;
+    }
+
+    struct bsi_keybind* slot = keybinds_slot(
+        keybinds->slots, keybinds->len_slots, keybind.mods, keybind.sym);
+    if (slot->sym == XKB_KEY_NoSymbol)
+        ++keybinds->len;
+    else
+        keybind_fini(slot);
+    *slot = keybind;
+
+    free(copy);
+    return true;
+
+error:
+    free(copy);
+    error("Invalid keybind '%s', syntax is 'bind <mods+key> <action> [args]'",
+          line);
+    return false;
+}
+
+/* The combination of a binding line, without compiling the action. */
+static bool
+keybind_line_combo(const char* line, uint32_t* mods, xkb_keysym_t* sym)
+{
+    char* copy = strdup(line);
+    if (copy == NULL)
+        return false;
+
+    char* save = NULL;
+    char* keyword = strtok_r(copy, " \t", &save);
+    char* combo = strtok_r(NULL, " \t", &save);
+    bool valid = keyword != NULL && combo != NULL &&
+                 strcasecmp("bind", keyword) == 0 &&
+                 keybind_parse_combo(combo, mods, sym);
+    free(copy);
+    return valid;
+}
+
+void
+keybinds_remove(struct bsi_keybinds* keybinds, const char* line)
+{
+    uint32_t mods, default_mods;
+    xkb_keysym_t sym, default_sym;
+    if (!keybind_line_combo(line, &mods, &sym) || keybinds->len_slots == 0)
+        return;
+
+    for (size_t i = 0; i < sizeof(keybinds_default) / sizeof(*keybinds_default);
+         ++i) {
+        if (keybind_line_combo(
+                keybinds_default[i], &default_mods, &default_sym) &&
+            default_mods == mods && default_sym == sym) {
+            keybinds_add(keybinds, keybinds_default[i]);
+            return;
+        }
+    }
+
+    /* Bound to nothing instead of taken out, so the probe chains of the
+     * other bindings stay intact. */
+    struct bsi_keybind* slot =
+        keybinds_slot(keybinds->slots, keybinds->len_slots, mods, sym);
+    if (slot->sym == XKB_KEY_NoSymbol)
+        return;
+    keybind_fini(slot);
+    slot->action = BSI_KEYBIND_NONE;
+    slot->resolved = false;
+    slot->format = NULL;
+}
+
+static struct bsi_output*
+keybind_output_at_cursor(struct bsi_server* server)
+{
+    struct wlr_output* output =
+        wlr_output_layout_output_at(server->wlr_output_layout,
+                                    server->wlr_cursor->x,
+                                    server->wlr_cursor->y);
+    return output ? outputs_find(server, output) : NULL;
+}
+
+static bool
+keybind_run(struct bsi_server* server, struct bsi_keybind* keybind)
+{
+    switch (keybind->action) {
+        case BSI_KEYBIND_NONE:
+            return false;
+        case BSI_KEYBIND_EXEC_OUTPUT: {
+            struct bsi_output* output = keybind_output_at_cursor(server);
+            if (output == NULL)
+                return true;
+            snprintf(keybind->argp[2],
+                     BSI_KEYBIND_CMD_MAX,
+                     keybind->format,
+                     output->output->name);
+        }
+            /* fallthrough */
+        case BSI_KEYBIND_EXEC:
+            if (keybind->resolved)
+                return launcher_exec(
+                    server->launcher, keybind->argp, keybind->len_argp, NULL);
+            return util_tryexec(
+                server->launcher, keybind->argp, keybind->len_argp);
+        case BSI_KEYBIND_FULLSCREEN: {
+            /* Only taken when it changes something, Escape is a common key. */
+            struct bsi_view* focused = views_get_focused(server);
+            if (focused == NULL ||
+                (focused->state == BSI_VIEW_STATE_FULLSCREEN) ==
+                    keybind->value)
+                return false;
+            view_set_fullscreen(focused, keybind->value);
+            return true;
+        }
+        case BSI_KEYBIND_MAXIMIZE: {
+            struct bsi_view* focused = views_get_focused(server);
+            if (focused)
+                view_set_maximized(focused, keybind->value);
+            return true;
+        }
+        case BSI_KEYBIND_TILE: {
+            /* Towards the other side untiles first. */
+            struct bsi_view* focused = views_get_focused(server);
+            if (focused == NULL)
+                return true;
+            bool right = keybind->value;
+            if (focused->state == BSI_VIEW_STATE_NORMAL) {
+                if (right)
+                    view_set_tiled_right(focused, true);
+                else
+                    view_set_tiled_left(focused, true);
+            } else if (right && focused->state == BSI_VIEW_STATE_TILED_LEFT) {
+                view_set_tiled_left(focused, false);
+            } else if (!right &&
+                       focused->state == BSI_VIEW_STATE_TILED_RIGHT) {
+                view_set_tiled_right(focused, false);
+            }
+            return true;
+        }
+        case BSI_KEYBIND_VIEWS_SHOW:
+            workspace_views_show_all(server->active_workspace, keybind->value);
+            return true;
+        case BSI_KEYBIND_VIEWS_CYCLE:
+            views_focus_recent(server);
+            return true;
+        case BSI_KEYBIND_WORKSPACE: {
+            struct bsi_output* output = keybind_output_at_cursor(server);
+            if (output == NULL)
+                return true;
+            if (keybind->value)
+                workspaces_next(output);
+            else
+                workspaces_prev(output);
+            return true;
+        }
+        case BSI_KEYBIND_DAMAGE:
+            overlays_damage_set(server, !server->overlay.damage);
+            return true;
+        case BSI_KEYBIND_HUD:
+            overlays_hud_set(server, !server->overlay.hud.enabled);
+            return true;
+        case BSI_KEYBIND_EXIT:
+            info("Exit keybind pressed, exiting");
+            wlr_backend_destroy(server->wlr_backend);
+            config_destroy(server->config.config);
+            server_destroy(server);
+            exit(EXIT_SUCCESS);
+    }
+    return false;
+}
+
+bool
+keybinds_dispatch(struct bsi_server* server,
+                  uint32_t mods,
+                  const xkb_keysym_t* syms,
+                  size_t len_syms)
+{
+    struct bsi_keybinds* keybinds = &server->input.keybinds;
+    if (keybinds->len == 0)
+        return false;
+
+    mods &= BSI_KEYBINDS_MODS;
+    for (size_t i = 0; i < len_syms; ++i) {
+        struct bsi_keybind* keybind =
+            keybinds_slot(keybinds->slots,
+                          keybinds->len_slots,
+                          mods,
+                          xkb_keysym_to_lower(syms[i]));
+        if (keybind->sym != XKB_KEY_NoSymbol)
+            return keybind_run(server, keybind);
+    }
+    return false;
+}
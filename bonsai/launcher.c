@@ -0,0 +1,649 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+
+#include "bonsai/launcher.h"
+#include "bonsai/log.h"
+#include "bonsai/stats.h"
+#include "bonsai/util.h"
+
+/* Requests are a header and then the arguments and the environment, every
+ * string NUL terminated. */
+struct launcher_request_header
+{
+    uint32_t argc;
+    uint32_t envc;
+};
+
+enum launcher_reply_kind
+{
+    LAUNCHER_REPLY_EXEC, /* Answers a request, in order. */
+    LAUNCHER_REPLY_EXIT, /* A started program was reaped. */
+};
+
+/* Exec replies come with the pidfd of the program, if it was started. */
+struct launcher_reply
+{
+    int32_t kind;
+    int32_t pid;
+    int32_t err;    /* errno of the failed exec or fork, 0 if it started. */
+    int32_t status; /* The waitpid(2) status of a reaped program. */
+};
+
+/* Helper */
+static size_t
+helper_strings(char* buf, size_t len, char** out, size_t count)
+{
+    size_t at = 0;
+    for (size_t i = 0; i < count; ++i) {
+        char* end = memchr(buf + at, '\0', len - at);
+        if (end == NULL)
+            return 0;
+        out[i] = buf + at;
+        at = end - buf + 1;
+    }
+    out[count] = NULL;
+    return at;
+}
+
+static void
+helper_reply(int fd, struct launcher_reply* reply, int pidfd)
+{
+    struct iovec iov = { .iov_base = reply, .iov_len = sizeof(*reply) };
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+    if (pidfd >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pidfd, sizeof(int));
+    }
+
+    while (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0 && errno == EINTR)
+        ;
+}
+
+static void
+helper_reap(int fd)
+{
+    pid_t pid;
+    int status;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        /* Programs that failed to exec were never announced, the compositor
+         * ignores pids it doesn't know. */
+        struct launcher_reply reply = {
+            .kind = LAUNCHER_REPLY_EXIT,
+            .pid = pid,
+            .status = status,
+        };
+        helper_reply(fd, &reply, -1);
+    }
+}
+
+static void
+helper_spawn(int fd, char* buf, size_t len, bool truncated)
+{
+    struct launcher_reply reply = { .kind = LAUNCHER_REPLY_EXEC, .pid = -1 };
+    struct launcher_request_header header;
+    char** argv = NULL;
+    char** envp = NULL;
+
+    if (truncated || len < sizeof(header)) {
+        reply.err = E2BIG;
+        goto reply;
+    }
+    memcpy(&header, buf, sizeof(header));
+    if (header.argc == 0 || header.argc > len || header.envc > len) {
+        reply.err = EINVAL;
+        goto reply;
+    }
+
+    argv = calloc(header.argc + 1, sizeof(char*));
+    envp = calloc(header.envc + 1, sizeof(char*));
+    if (argv == NULL || envp == NULL) {
+        reply.err = ENOMEM;
+        goto reply;
+    }
+    size_t at = sizeof(header);
+    size_t used = helper_strings(buf + at, len - at, argv, header.argc);
+    if (used == 0) {
+        reply.err = EINVAL;
+        goto reply;
+    }
+    at += used;
+    if (header.envc > 0 &&
+        helper_strings(buf + at, len - at, envp, header.envc) == 0) {
+        reply.err = EINVAL;
+        goto reply;
+    }
+
+    /* The write end closes on a successful exec, otherwise errno comes
+     * through it. */
+    int exec_pipe[2];
+    if (pipe2(exec_pipe, O_CLOEXEC) < 0) {
+        reply.err = errno;
+        goto reply;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(exec_pipe[0]);
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigprocmask(SIG_SETMASK, &signals, NULL);
+
+        execve(argv[0], argv, envp);
+
+        int err = errno;
+        ssize_t written = write(exec_pipe[1], &err, sizeof(err));
+        (void)written;
+        _exit(EXIT_FAILURE);
+    }
+    close(exec_pipe[1]);
+    if (pid < 0) {
+        reply.err = errno;
+        close(exec_pipe[0]);
+        goto reply;
+    }
+
+    /* The child is not reaped before SIGCHLD is read, so the pid can't be
+     * reused under the pidfd. */
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd < 0)
+        errn("Failed to open a pidfd for process %d", pid);
+
+    int err = 0;
+    ssize_t got;
+    while ((got = read(exec_pipe[0], &err, sizeof(err))) < 0 && errno == EINTR)
+        ;
+    close(exec_pipe[0]);
+
+    reply.pid = pid;
+    if (got == sizeof(err)) {
+        reply.err = err;
+        if (pidfd >= 0)
+            close(pidfd);
+        pidfd = -1;
+    }
+
+    free(argv);
+    free(envp);
+    helper_reply(fd, &reply, pidfd);
+    if (pidfd >= 0)
+        close(pidfd);
+    return;
+
+reply:
+    free(argv);
+    free(envp);
+    helper_reply(fd, &reply, -1);
+}
+
+static int
+helper_main(int fd)
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        errn("Launcher helper failed to create a signalfd");
+        return EXIT_FAILURE;
+    }
+
+    static char buf[BSI_LAUNCHER_MSG_MAX];
+    struct pollfd fds[] = {
+        { .fd = fd, .events = POLLIN },
+        { .fd = signal_fd, .events = POLLIN },
+    };
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            errn("Launcher helper poll failed");
+            return EXIT_FAILURE;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            ssize_t got = read(signal_fd, &info, sizeof(info));
+            (void)got;
+            helper_reap(fd);
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+            struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+            ssize_t len = recvmsg(fd, &msg, 0);
+            if (len < 0 && errno == EINTR)
+                continue;
+            /* The compositor is gone. */
+            if (len <= 0)
+                break;
+            helper_spawn(fd, buf, len, msg.msg_flags & MSG_TRUNC);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* Compositor */
+static void
+launcher_child_destroy(struct bsi_launcher_child* child)
+{
+    wl_list_remove(&child->link);
+    if (child->event_source != NULL)
+        wl_event_source_remove(child->event_source);
+    if (child->pidfd >= 0)
+        close(child->pidfd);
+    free(child);
+}
+
+/* Done once the pidfd saw the exit and the helper sent the status, in
+ * whichever order they come. */
+static void
+launcher_child_finish(struct bsi_launcher_child* child)
+{
+    if (!child->exited || !child->reaped)
+        return;
+
+    if (WIFEXITED(child->status))
+        debug("Launched '%s' (%d) exited with %d",
+              child->name,
+              child->pid,
+              WEXITSTATUS(child->status));
+    else if (WIFSIGNALED(child->status))
+        debug("Launched '%s' (%d) killed by signal %d",
+              child->name,
+              child->pid,
+              WTERMSIG(child->status));
+
+    struct bsi_launcher_watch* watch = child->watch;
+    int status = child->status;
+    launcher_child_destroy(child);
+    if (watch != NULL)
+        watch->exited(watch, status);
+}
+
+static int
+handle_child_exit(int fd, uint32_t mask, void* data)
+{
+    struct bsi_launcher_child* child = data;
+    wl_event_source_remove(child->event_source);
+    child->event_source = NULL;
+    child->exited = true;
+    launcher_child_finish(child);
+    return 0;
+}
+
+static void
+launcher_exit_handle(struct bsi_launcher* launcher,
+                     const struct launcher_reply* reply)
+{
+    struct bsi_launcher_child* child;
+    wl_list_for_each(child, &launcher->children, link)
+    {
+        if (child->pid == reply->pid && !child->reaped) {
+            child->reaped = true;
+            child->status = reply->status;
+            launcher_child_finish(child);
+            return;
+        }
+    }
+}
+
+static void
+launcher_exec_handle(struct bsi_launcher* launcher,
+                     const struct launcher_reply* reply,
+                     int pidfd)
+{
+    if (wl_list_empty(&launcher->requests)) {
+        error("Launcher helper replied to nothing");
+        if (pidfd >= 0)
+            close(pidfd);
+        return;
+    }
+
+    struct bsi_launcher_request* request =
+        wl_container_of(launcher->requests.next, request, link);
+    uint64_t latency_usec = stats_now_usec() - request->sent_usec;
+    histogram_record(&launcher->latency, latency_usec);
+    wl_list_remove(&request->link);
+
+    struct bsi_launcher_watch* watch = request->watch;
+    struct bsi_launcher_child* child = NULL;
+    if (reply->err != 0) {
+        ++launcher->failed;
+        error("Exec '%s' failed: %s", request->name, strerror(reply->err));
+    } else {
+        ++launcher->launched;
+        debug("Launched '%s' (%d) in %lu us",
+              request->name,
+              reply->pid,
+              latency_usec);
+        child = calloc(1, sizeof(struct bsi_launcher_child));
+    }
+
+    if (child != NULL) {
+        child->launcher = launcher;
+        snprintf(child->name, sizeof(child->name), "%s", request->name);
+        child->pid = reply->pid;
+        child->watch = watch;
+        child->pidfd = pidfd;
+        child->event_source = NULL;
+        /* Without a pidfd, the status from the helper has to do. */
+        child->exited = pidfd < 0;
+        child->reaped = false;
+        if (pidfd >= 0)
+            child->event_source = wl_event_loop_add_fd(launcher->loop,
+                                                       pidfd,
+                                                       WL_EVENT_READABLE,
+                                                       handle_child_exit,
+                                                       child);
+        wl_list_insert(&launcher->children, &child->link);
+    } else if (pidfd >= 0) {
+        close(pidfd);
+    }
+    free(request);
+
+    if (watch == NULL)
+        return;
+    if (child != NULL)
+        watch->started(watch, reply->pid);
+    else
+        watch->exited(watch, -1);
+}
+
+static void
+launcher_helper_lost(struct bsi_launcher* launcher)
+{
+    error("Launcher helper exited, programs are forked from the compositor "
+          "from now on");
+
+    wl_event_source_remove(launcher->event_source);
+    launcher->event_source = NULL;
+    close(launcher->fd);
+    launcher->fd = -1;
+    if (waitpid(launcher->pid, NULL, WNOHANG) == launcher->pid)
+        launcher->pid = -1;
+
+    /* Nobody reaps the programs now, their pidfds still tell when they
+     * exit. */
+    struct bsi_launcher_child *child, *child_tmp;
+    wl_list_for_each_safe(child, child_tmp, &launcher->children, link)
+    {
+        if (!child->reaped) {
+            child->reaped = true;
+            child->status = -1;
+            launcher_child_finish(child);
+        }
+    }
+
+    struct bsi_launcher_request *request, *request_tmp;
+    wl_list_for_each_safe(request, request_tmp, &launcher->requests, link)
+    {
+        error("Exec '%s' lost with the launcher helper", request->name);
+        ++launcher->failed;
+        struct bsi_launcher_watch* watch = request->watch;
+        wl_list_remove(&request->link);
+        free(request);
+        if (watch != NULL)
+            watch->exited(watch, -1);
+    }
+}
+
+static int
+handle_helper_reply(int fd, uint32_t mask, void* data)
+{
+    struct bsi_launcher* launcher = data;
+
+    while (true) {
+        struct launcher_reply reply;
+        struct iovec iov = { .iov_base = &reply, .iov_len = sizeof(reply) };
+        union
+        {
+            char buf[CMSG_SPACE(sizeof(int))];
+            struct cmsghdr align;
+        } control;
+        struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.buf,
+            .msg_controllen = sizeof(control.buf),
+        };
+
+        ssize_t len = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0 && errno == EAGAIN)
+            break;
+        if (len <= 0) {
+            launcher_helper_lost(launcher);
+            return 0;
+        }
+
+        int pidfd = -1;
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(&pidfd, CMSG_DATA(cmsg), sizeof(int));
+
+        if (len != sizeof(reply)) {
+            error("Launcher helper sent a short reply");
+            if (pidfd >= 0)
+                close(pidfd);
+            continue;
+        }
+        if (reply.kind == LAUNCHER_REPLY_EXIT)
+            launcher_exit_handle(launcher, &reply);
+        else
+            launcher_exec_handle(launcher, &reply, pidfd);
+    }
+
+    if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))
+        launcher_helper_lost(launcher);
+    return 0;
+}
+
+struct bsi_launcher*
+launcher_create(void)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+        errn("Failed to create the launcher socketpair");
+        return NULL;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        errn("Failed to fork the launcher helper");
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        _exit(helper_main(fds[1]));
+    }
+    close(fds[1]);
+
+    struct bsi_launcher* launcher = calloc(1, sizeof(struct bsi_launcher));
+    if (launcher == NULL) {
+        errn("Failed to allocate the launcher");
+        close(fds[0]);
+        waitpid(pid, NULL, 0);
+        return NULL;
+    }
+    launcher->pid = pid;
+    launcher->fd = fds[0];
+    fcntl(launcher->fd, F_SETFL, fcntl(launcher->fd, F_GETFL) | O_NONBLOCK);
+    launcher->event_source = NULL;
+    launcher->loop = NULL;
+    wl_list_init(&launcher->requests);
+    wl_list_init(&launcher->children);
+    launcher->launched = launcher->failed = 0;
+
+    info("Started launcher helper %d", pid);
+    return launcher;
+}
+
+void
+launcher_attach(struct bsi_launcher* launcher, struct wl_event_loop* loop)
+{
+    launcher->loop = loop;
+    launcher->event_source = wl_event_loop_add_fd(
+        loop, launcher->fd, WL_EVENT_READABLE, handle_helper_reply, launcher);
+}
+
+void
+launcher_destroy(struct bsi_launcher* launcher)
+{
+    launcher_stats_dump(launcher);
+
+    struct bsi_launcher_child *child, *child_tmp;
+    wl_list_for_each_safe(child, child_tmp, &launcher->children, link)
+    {
+        launcher_child_destroy(child);
+    }
+    struct bsi_launcher_request *request, *request_tmp;
+    wl_list_for_each_safe(request, request_tmp, &launcher->requests, link)
+    {
+        wl_list_remove(&request->link);
+        free(request);
+    }
+
+    if (launcher->event_source != NULL)
+        wl_event_source_remove(launcher->event_source);
+    /* The helper exits when its end of the socket hangs up. */
+    if (launcher->fd >= 0)
+        close(launcher->fd);
+    if (launcher->pid > 0)
+        waitpid(launcher->pid, NULL, 0);
+    free(launcher);
+}
+
+bool
+launcher_exec(struct bsi_launcher* launcher,
+              char* const* argp,
+              const size_t len_argp,
+              struct bsi_launcher_watch* watch)
+{
+    if (len_argp < 1 || argp[0] == NULL)
+        return false;
+    if (launcher == NULL || launcher->event_source == NULL)
+        return util_forkexec(argp, len_argp);
+
+    uint64_t sent_usec = stats_now_usec();
+    /* Only ever filled on the event loop. */
+    static char buf[BSI_LAUNCHER_MSG_MAX];
+    extern char** environ;
+    struct launcher_request_header header = { 0 };
+    size_t len = sizeof(header);
+    bool fits = true;
+
+    for (size_t i = 0; i < len_argp && argp[i] != NULL && fits; ++i) {
+        size_t len_arg = strlen(argp[i]) + 1;
+        fits = len + len_arg <= sizeof(buf);
+        if (fits) {
+            memcpy(buf + len, argp[i], len_arg);
+            len += len_arg;
+            ++header.argc;
+        }
+    }
+    for (char** env = environ; *env != NULL && fits; ++env) {
+        size_t len_env = strlen(*env) + 1;
+        fits = len + len_env <= sizeof(buf);
+        if (fits) {
+            memcpy(buf + len, *env, len_env);
+            len += len_env;
+            ++header.envc;
+        }
+    }
+    if (!fits) {
+        error("Exec request for '%s' is too large for the launcher", argp[0]);
+        return util_forkexec(argp, len_argp);
+    }
+    memcpy(buf, &header, sizeof(header));
+
+    struct bsi_launcher_request* request =
+        calloc(1, sizeof(struct bsi_launcher_request));
+    if (request == NULL) {
+        errn("Failed to allocate a launcher request");
+        return false;
+    }
+
+    ssize_t sent;
+    while ((sent = send(launcher->fd, buf, len, MSG_NOSIGNAL)) < 0 &&
+           errno == EINTR)
+        ;
+    if (sent < 0) {
+        errn("Failed to send an exec request for '%s'", argp[0]);
+        free(request);
+        return util_forkexec(argp, len_argp);
+    }
+
+    snprintf(request->name, sizeof(request->name), "%s", argp[0]);
+    request->sent_usec = sent_usec;
+    request->watch = watch;
+    wl_list_insert(launcher->requests.prev, &request->link);
+    return true;
+}
+
+void
+launcher_unwatch(struct bsi_launcher* launcher,
+                 struct bsi_launcher_watch* watch)
+{
+    if (launcher == NULL)
+        return;
+
+    struct bsi_launcher_request* request;
+    wl_list_for_each(request, &launcher->requests, link)
+    {
+        if (request->watch == watch)
+            request->watch = NULL;
+    }
+    struct bsi_launcher_child* child;
+    wl_list_for_each(child, &launcher->children, link)
+    {
+        if (child->watch == watch)
+            child->watch = NULL;
+    }
+}
+
+void
+launcher_stats_dump(struct bsi_launcher* launcher)
+{
+    const struct bsi_histogram* latency = &launcher->latency;
+    info("Launcher started %lu programs, %lu failed, exec latency p50 %lu us, "
+         "p99 %lu us, max %lu us",
+         launcher->launched,
+         launcher->failed,
+         histogram_quantile(latency, 0.5),
+         histogram_quantile(latency, 0.99),
+         latency->max);
+}
@@ -23,14 +23,18 @@
 #include <wlr/util/log.h>
 
 #include "bonsai/config/config.h"
+#include "bonsai/config/watch.h"
 #include "bonsai/desktop/view.h"
 #include "bonsai/events.h"
 #include "bonsai/input.h"
 #include "bonsai/input/cursor.h"
+#include "bonsai/launcher.h"
 #include "bonsai/log.h"
 #include "bonsai/output.h"
 #include "bonsai/server.h"
+#include "bonsai/supervisor.h"
 #include "bonsai/util.h"
+#include "bonsai/worker.h"
 
 // TODO: Implement xwayland support.
 // TODO: Implement input inhibitor - right now, it's faked.
@@ -48,6 +52,9 @@ main(void)
     wlr_log_init(WLR_INFO, NULL);
 #endif
 
+    /* Forked before anything is mapped, so it stays small. */
+    struct bsi_launcher* launcher = launcher_create();
+
     struct bsi_config config;
     struct bsi_server server;
 
@@ -55,9 +62,32 @@ main(void)
     config_parse(&config);
 
     server_init(&server, &config);
+    if (launcher != NULL) {
+        launcher_attach(launcher,
+                        wl_display_get_event_loop(server.wl_display));
+        server.launcher = launcher;
+    }
     server_setup(&server);
     server_run(&server);
 
+    /* Jobs still finishing complete on the event loop, which goes away with
+     * the display. */
+    if (server.config.watch != NULL) {
+        config_watch_destroy(server.config.watch);
+        server.config.watch = NULL;
+    }
+    if (server.supervisor != NULL) {
+        supervisor_destroy(server.supervisor);
+        server.supervisor = NULL;
+    }
+    if (server.workers != NULL) {
+        workers_destroy(server.workers);
+        server.workers = NULL;
+    }
+    if (server.launcher != NULL) {
+        launcher_destroy(server.launcher);
+        server.launcher = NULL;
+    }
     wl_display_destroy_clients(server.wl_display);
     wl_display_destroy(server.wl_display);
 
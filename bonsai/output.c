@@ -12,9 +12,15 @@
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output_management_v1.h>
+#include <wlr/types/wlr_output_power_management_v1.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_session_lock_v1.h>
+#include <wlr/types/wlr_xdg_shell.h>
 
+#include "bonsai/desktop/content_type.h"
 #include "bonsai/desktop/decoration.h"
 #include "bonsai/desktop/layers.h"
+#include "bonsai/desktop/lock.h"
 #include "bonsai/desktop/view.h"
 #include "bonsai/desktop/workspace.h"
 #include "bonsai/log.h"
@@ -38,10 +44,12 @@ output_init(struct bsi_output* output,
     struct wlr_box box = { 0 };
     wlr_output_effective_resolution(wlr_output, &box.width, &box.height);
     output_set_usable_box(output, &box);
-    /* Initialize damage. Initialize output configuration. */
-    output->damage = wlr_output_damage_create(wlr_output);
     /* Initialize workspaces. */
     wl_list_init(&output->workspaces);
+    output->tree = wlr_scene_tree_create(&server->wlr_scene->tree);
+    /* Hidden with the rest of the session, until it's unlocked. */
+    if (server->session.locked)
+        wlr_scene_node_set_enabled(&output->tree->node, false);
     /* Initialize layer shell. */
     for (size_t i = 0; i < 4; ++i) {
         wl_list_init(&output->layers[i]);
@@ -52,6 +60,39 @@ output_init(struct bsi_output* output,
     struct timespec now = util_timespec_get();
     output->last_frame = now;
 
+    /* Nothing has been arranged yet. */
+    output->arrange.dirty = BSI_OUTPUT_DIRTY_MODE;
+    output->arrange.layers = 0;
+    output->arrange.performed = 0;
+    output->arrange.skipped = 0;
+
+    output->throttle.sent = output->throttle.skipped = 0;
+
+    output->power.idle_off = false;
+    output->power.offs = 0;
+
+    output->schedule.timer = NULL;
+    output->schedule.pending = false;
+    output->schedule.policy = BSI_OUTPUT_POLICY_DEFAULT;
+    output->schedule.frame_usec = 0;
+    output->schedule.len_cost = output->schedule.next_cost = 0;
+
+    output->stats = NULL;
+    if (server->stats.enabled)
+        output->stats =
+            output_stats_init(malloc(sizeof(struct bsi_output_stats)));
+
+    output->overlay_damage = NULL;
+    if (server->overlay.damage)
+        output->overlay_damage = overlay_damage_create(output);
+    output->overlay_hud = NULL;
+    if (server->overlay.hud.enabled)
+        output->overlay_hud = overlay_hud_create(output);
+
+    output->hit.serial = server->scene.serial - 1;
+    output->hit.entries = NULL;
+    output->hit.len = output->hit.cap = 0;
+
     return output;
 }
 
@@ -69,20 +110,6 @@ output_set_usable_box(struct bsi_output* output, struct wlr_box* box)
     output->usable.height = box->height;
 }
 
-void
-output_surface_damage(struct bsi_output* output,
-                      struct wlr_surface* wlr_surface,
-                      bool entire_output)
-{
-    if (entire_output) {
-        wlr_output_damage_add_whole(output->damage);
-    } else {
-        struct wlr_box box;
-        wlr_surface_get_extends(wlr_surface, &box);
-        wlr_output_damage_add_box(output->damage, &box);
-    }
-}
-
 struct bsi_workspace*
 output_get_next_workspace(struct bsi_output* output)
 {
@@ -107,10 +134,17 @@ output_get_prev_workspace(struct bsi_output* output)
     return output->active_workspace;
 }
 
+void
+output_arrange_mark(struct bsi_output* output, uint32_t dirty)
+{
+    output->arrange.dirty |= dirty;
+}
+
 static void
 output_layer_arrange(struct bsi_output* output,
                      struct wl_list* shell_layer,
                      struct wlr_box* usable_box,
+                     struct wlr_box* layout_box,
                      bool exclusive)
 {
     struct wlr_box full_box = { 0 }; /* Full output area. */
@@ -120,6 +154,10 @@ output_layer_arrange(struct bsi_output* output,
     struct bsi_layer_surface_toplevel* layer_toplevel;
     wl_list_for_each(layer_toplevel, shell_layer, link_output)
     {
+        /* Nothing changed for this surface, its configuration still holds. */
+        if (layer_toplevel->dirty == BSI_LAYER_DIRTY_NONE)
+            continue;
+
         const char* layer_level =
             (layer_toplevel->at_layer == ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND)
                 ? "ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND"
@@ -239,87 +277,57 @@ output_layer_arrange(struct bsi_output* output,
             layer_surf, wants_box.width, wants_box.height);
         wlr_scene_layer_surface_v1_configure(
             layer_toplevel->scene_node, &maxbounds_box, &wants_box);
-    }
-}
 
-void
-output_layers_arrange(struct bsi_output* output)
-{
-    struct wlr_box usable_box = { 0 }; /* Output usable area. */
-    wlr_output_effective_resolution(
-        output->output, &usable_box.width, &usable_box.height);
+        /* Position the layer in global layout coordinates of its output. */
+        wlr_scene_node_set_position(&layer_toplevel->scene_node->tree->node,
+                                    wants_box.x + layout_box->x,
+                                    wants_box.y + layout_box->y);
 
-    /* Firstly, arrange exclusive layers. */
-    for (size_t i = 0; i < 4; ++i) {
-        if (!wl_list_empty(&output->layers[i]))
-            output_layer_arrange(output, &output->layers[i], &usable_box, true);
-    }
-
-    /* Secondly, arrange non-exclusive layers. */
-    for (size_t i = 0; i < 4; ++i) {
-        if (!wl_list_empty(&output->layers[i]))
-            output_layer_arrange(
-                output, &output->layers[i], &usable_box, false);
-    }
-
-    /* Arrange layer positioning in global layout coordintes of its output. */
-    for (size_t i = 0; i < 4; ++i) {
-        struct bsi_layer_surface_toplevel* toplevel;
-        if (!wl_list_empty(&output->layers[i])) {
-            wl_list_for_each(toplevel, &output->layers[i], link_output)
-            {
-                struct wlr_box layout_box;
-                wlr_output_layout_get_box(output->server->wlr_output_layout,
-                                          output->output,
-                                          &layout_box);
-                int32_t lx, ly;
-                wlr_scene_node_coords(
-                    &toplevel->scene_node->tree->node, &lx, &ly);
-                wlr_scene_node_set_position(&toplevel->scene_node->tree->node,
-                                            lx + layout_box.x,
-                                            ly + layout_box.y);
-            }
-        }
+        layer_toplevel->arranged = *state;
+        layer_toplevel->dirty = BSI_LAYER_DIRTY_NONE;
     }
+}
 
+static void
+output_layers_restack(struct bsi_output* output)
+{
     /* Arrange layers under & above windows. */
     for (size_t i = 0; i < 4; ++i) {
         struct bsi_layer_surface_toplevel* toplevel;
-        if (!wl_list_empty(&output->layers[i])) {
-            wl_list_for_each(toplevel, &output->layers[i], link_output)
-            {
-                if (toplevel->at_layer < ZWLR_LAYER_SHELL_V1_LAYER_TOP) {
-                    /* These are background layers, arrange the views
-                     * appropriately.*/
-                    debug("Lower layer with namespace '%s' to bottom",
-                          toplevel->layer_surface->namespace);
-                    wlr_scene_node_lower_to_bottom(
-                        &toplevel->scene_node->tree->node);
-                } else if (toplevel->at_layer >
-                           ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM) {
-                    /* These are foreground layers, arrange the views
-                     * appropriately. */
-                    debug("Raise layer with namespace '%s' to top",
-                          toplevel->layer_surface->namespace);
-                    wlr_scene_node_raise_to_top(
-                        &toplevel->scene_node->tree->node);
-                }
+        wl_list_for_each(toplevel, &output->layers[i], link_output)
+        {
+            if (toplevel->at_layer < ZWLR_LAYER_SHELL_V1_LAYER_TOP) {
+                /* These are background layers, arrange the views
+                 * appropriately.*/
+                wlr_scene_node_lower_to_bottom(
+                    &toplevel->scene_node->tree->node);
+            } else if (toplevel->at_layer > ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM) {
+                /* These are foreground layers, arrange the views
+                 * appropriately. */
+                wlr_scene_node_raise_to_top(&toplevel->scene_node->tree->node);
             }
         }
     }
 
-    /* Arrange fullscreen views. */
+    /* Arrange fullscreen views of this output. The view is raised within its
+     * workspace, the output tree has to go above the foreground layers. */
+    struct bsi_server* server = output->server;
     struct bsi_view* view;
-    wl_list_for_each(
-        view, &output->server->scene.views_fullscreen, link_fullscreen)
+    wl_list_for_each(view, &server->scene.views_fullscreen, link_fullscreen)
     {
-        wlr_scene_node_raise_to_top(&view->tree->node);
+        if (view->workspace && view->workspace->output == output &&
+            view->workspace->active) {
+            wlr_scene_node_raise_to_top(&view->tree->node);
+            wlr_scene_node_raise_to_top(&output->tree->node);
+        }
     }
 
     /* If locked lock node should always be topmost. */
-    struct bsi_server* server = output->server;
-    if (server->session.locked && server->session.lock) {
-        wlr_scene_node_raise_to_top(&server->session.lock->tree->node);
+    if (server->session.locked) {
+        if (server->session.lock)
+            wlr_scene_node_raise_to_top(&server->session.lock->tree->node);
+        else if (server->session.blank)
+            wlr_scene_node_raise_to_top(&server->session.blank->node);
         return;
     }
 
@@ -346,13 +354,328 @@ output_layers_arrange(struct bsi_output* output)
     }
 }
 
+void
+output_layers_arrange(struct bsi_output* output)
+{
+    if (output->arrange.dirty == BSI_OUTPUT_DIRTY_NONE) {
+        ++output->arrange.skipped;
+        return;
+    }
+    ++output->arrange.performed;
+
+    struct wlr_box usable_box = { 0 }; /* Output usable area. */
+    wlr_output_effective_resolution(
+        output->output, &usable_box.width, &usable_box.height);
+
+    if (output->arrange.dirty &
+        (BSI_OUTPUT_DIRTY_MODE | BSI_OUTPUT_DIRTY_EXCLUSIVE)) {
+        /* The usable area may change, so every surface has to be redone. Reset
+         * the state of the layers, with regards to output box exclusive
+         * configuration. */
+        output_set_usable_box(output, &usable_box);
+        for (size_t i = 0; i < 4; ++i) {
+            struct bsi_layer_surface_toplevel* toplevel;
+            wl_list_for_each(toplevel, &output->layers[i], link_output)
+            {
+                toplevel->exclusive_configured = false;
+                toplevel->dirty |= BSI_LAYER_DIRTY_ALL;
+            }
+        }
+        output->arrange.layers = (1 << 4) - 1;
+    }
+
+    if (output->arrange.dirty &
+        (BSI_OUTPUT_DIRTY_MODE | BSI_OUTPUT_DIRTY_EXCLUSIVE |
+         BSI_OUTPUT_DIRTY_LAYERS)) {
+        struct wlr_box layout_box;
+        wlr_output_layout_get_box(
+            output->server->wlr_output_layout, output->output, &layout_box);
+
+        /* Firstly, arrange exclusive layers. */
+        for (size_t i = 0; i < 4; ++i) {
+            if (output->arrange.layers & (1 << i))
+                output_layer_arrange(output,
+                                     &output->layers[i],
+                                     &usable_box,
+                                     &layout_box,
+                                     true);
+        }
+
+        /* Secondly, arrange non-exclusive layers. */
+        for (size_t i = 0; i < 4; ++i) {
+            if (output->arrange.layers & (1 << i))
+                output_layer_arrange(output,
+                                     &output->layers[i],
+                                     &usable_box,
+                                     &layout_box,
+                                     false);
+        }
+    }
+
+    if (output->arrange.dirty &
+        (BSI_OUTPUT_DIRTY_MODE | BSI_OUTPUT_DIRTY_STACKING))
+        output_layers_restack(output);
+
+    cursor_scene_invalidate(output->server);
+
+    debug("Arranged output %ld/%s, dirty %x, layers %x (%ld performed, %ld "
+          "skipped)",
+          output->id,
+          output->output->name,
+          output->arrange.dirty,
+          output->arrange.layers,
+          output->arrange.performed,
+          output->arrange.skipped);
+
+    output->arrange.dirty = BSI_OUTPUT_DIRTY_NONE;
+    output->arrange.layers = 0;
+}
+
+static void
+send_frame_done_iterator(struct wlr_surface* surface,
+                         int sx,
+                         int sy,
+                         void* user_data)
+{
+    wlr_surface_send_frame_done(surface, user_data);
+}
+
+static enum wp_content_type_v1_type
+output_view_content_type(struct bsi_view* view)
+{
+    return content_type_get(view->server->content_type_manager,
+                            view->wlr_xdg_toplevel->base->surface);
+}
+
+static struct bsi_view*
+output_fullscreen_view(struct bsi_output* output)
+{
+    struct bsi_server* server = output->server;
+    struct bsi_view* view;
+    wl_list_for_each(view, &server->scene.views_fullscreen, link_fullscreen)
+    {
+        if (view->workspace && view->workspace->output == output &&
+            view->workspace->active &&
+            view->state == BSI_VIEW_STATE_FULLSCREEN)
+            return view;
+    }
+    return NULL;
+}
+
+/* The view the user is looking at on the output, if any. */
+static struct bsi_view*
+output_foreground_view(struct bsi_output* output, struct bsi_view* fullscreen)
+{
+    if (output->server->session.locked)
+        return NULL;
+    if (fullscreen)
+        return fullscreen;
+
+    struct bsi_view* focused = views_get_focused(output->server);
+    if (focused && focused->mapped && focused->workspace &&
+        focused->workspace->output == output && focused->workspace->active &&
+        focused->state != BSI_VIEW_STATE_MINIMIZED)
+        return focused;
+    return NULL;
+}
+
+static bool
+output_view_throttled(struct bsi_view* view,
+                      struct bsi_view* fullscreen,
+                      struct bsi_view* foreground)
+{
+    /* Hidden views, views covered by a fullscreen view or the lock, and
+     * still pictures in the background. */
+    return !view->workspace->active ||
+           view->state == BSI_VIEW_STATE_MINIMIZED ||
+           (fullscreen && fullscreen != view) ||
+           view->server->session.locked ||
+           (view != foreground &&
+            output_view_content_type(view) == WP_CONTENT_TYPE_V1_TYPE_PHOTO);
+}
+
+static void
+output_content_update(struct bsi_output* output, struct bsi_view* view)
+{
+    uint64_t interval = view->commits.interval_usec;
+    if (interval == 0 ||
+        stats_now_usec() - view->commits.last_usec > BSI_VIEW_COMMITS_GAP_USEC)
+        return;
+    output->schedule.content_usec = view->commits.last_usec + interval;
+}
+
+static struct bsi_view*
+output_policy_update(struct bsi_output* output)
+{
+    struct bsi_view* fullscreen = output_fullscreen_view(output);
+    struct bsi_view* foreground = output_foreground_view(output, fullscreen);
+
+    /* A game in front gets the lowest latency, any video that can be seen
+     * gets composed in step with its frames. */
+    enum bsi_output_policy policy = BSI_OUTPUT_POLICY_DEFAULT;
+    output->schedule.content_usec = 0;
+    if (foreground &&
+        output_view_content_type(foreground) == WP_CONTENT_TYPE_V1_TYPE_GAME) {
+        policy = BSI_OUTPUT_POLICY_GAME;
+    } else if (output->active_workspace) {
+        struct bsi_view* view;
+        wl_list_for_each(view, &output->active_workspace->views, link_workspace)
+        {
+            if (view->mapped && view->state != BSI_VIEW_STATE_MINIMIZED &&
+                (!fullscreen || fullscreen == view) &&
+                output_view_content_type(view) ==
+                    WP_CONTENT_TYPE_V1_TYPE_VIDEO) {
+                policy = BSI_OUTPUT_POLICY_VIDEO;
+                output_content_update(output, view);
+                break;
+            }
+        }
+    }
+
+    if (policy != output->schedule.policy) {
+        debug("Output %ld/%s frame policy is now %d",
+              output->id,
+              output->output->name,
+              policy);
+        output->schedule.policy = policy;
+    }
+
+    return foreground;
+}
+
+static enum bsi_output_schedule
+output_schedule_mode(struct bsi_output* output)
+{
+    switch (output->schedule.policy) {
+        case BSI_OUTPUT_POLICY_GAME:
+            return BSI_OUTPUT_SCHEDULE_ADAPTIVE;
+        case BSI_OUTPUT_POLICY_VIDEO:
+            return BSI_OUTPUT_SCHEDULE_CONTENT;
+        default:
+            return output->server->frame.schedule;
+    }
+}
+
+void
+output_send_frame_done(struct bsi_output* output,
+                       struct timespec* now,
+                       bool throttled)
+{
+    struct bsi_server* server = output->server;
+
+    /* Nothing is shown, clients wait until the output is back on. */
+    if (!output->output->enabled)
+        return;
+
+    /* Layer surfaces are visible unless the session is locked. */
+    if (throttled == server->session.locked) {
+        for (size_t i = 0; i < 4; ++i) {
+            struct bsi_layer_surface_toplevel* toplevel;
+            wl_list_for_each(toplevel, &output->layers[i], link_output)
+            {
+                wlr_layer_surface_v1_for_each_surface(
+                    toplevel->layer_surface, send_frame_done_iterator, now);
+            }
+        }
+    }
+
+    /* The lock always is. */
+    if (!throttled && server->session.lock) {
+        struct bsi_session_lock_surface* lock_surface;
+        wl_list_for_each(
+            lock_surface, &server->session.lock->surfaces, link_session_lock)
+        {
+            if (lock_surface->lock_surface->output == output->output)
+                wlr_surface_for_each_surface(
+                    lock_surface->surface, send_frame_done_iterator, now);
+        }
+    }
+
+    struct bsi_view* fullscreen = output_fullscreen_view(output);
+    struct bsi_view* foreground = output_foreground_view(output, fullscreen);
+
+    size_t sent = 0, skipped = 0;
+    struct bsi_view* view;
+    struct bsi_workspace* workspace;
+    wl_list_for_each(workspace, &output->workspaces, link_output)
+    {
+        wl_list_for_each(view, &workspace->views, link_workspace)
+        {
+            if (!view->mapped)
+                continue;
+            if (!throttled && view->frame_early) {
+                view->frame_early = false;
+                continue;
+            }
+            if (output_view_throttled(view, fullscreen, foreground) !=
+                throttled) {
+                ++skipped;
+                continue;
+            }
+            wlr_xdg_surface_for_each_surface(
+                view->wlr_xdg_toplevel->base, send_frame_done_iterator, now);
+            ++sent;
+        }
+    }
+
+    if (throttled) {
+        output->throttle.sent += sent;
+    } else {
+        output->throttle.skipped += skipped;
+    }
+}
+
+bool
+output_power_set(struct bsi_output* output, bool on)
+{
+    struct wlr_output* wlr_output = output->output;
+    if (wlr_output->enabled == on)
+        return true;
+
+    info("Turning output %ld/%s %s",
+         output->id,
+         wlr_output->name,
+         on ? "on" : "off");
+
+    /* A frame waiting on the timer would commit the disabled output. */
+    if (!on && output->schedule.pending) {
+        output->schedule.pending = false;
+        wl_event_source_timer_update(output->schedule.timer, 0);
+    }
+
+    wlr_output_enable(wlr_output, on);
+    if (!wlr_output_commit(wlr_output)) {
+        error("Failed to turn output '%s' %s",
+              wlr_output->name,
+              on ? "on" : "off");
+        return false;
+    }
+
+    if (on) {
+        /* The scene kept collecting damage, but the buffers are gone. */
+        struct wlr_scene_output* wlr_scene_output =
+            wlr_scene_get_scene_output(output->server->wlr_scene, wlr_output);
+        if (wlr_scene_output)
+            wlr_output_damage_add_whole(wlr_scene_output->damage);
+    } else {
+        ++output->power.offs;
+    }
+    return true;
+}
+
 void
 output_destroy(struct bsi_output* output)
 {
     info("Destroying output %ld/%s", output->id, output->output->name);
+    debug("Output throttled %ld view frames, sent %ld at the throttled rate",
+          output->throttle.skipped,
+          output->throttle.sent);
+    debug("Output was turned off %ld times", output->power.offs);
 
     wl_list_remove(&output->listen.frame.link);
     wl_list_remove(&output->listen.destroy.link);
+    if (output->schedule.timer)
+        wl_event_source_remove(output->schedule.timer);
 
     struct bsi_server* server = output->server;
     if (wl_list_length(&server->output.outputs) > 0) {
@@ -366,17 +689,25 @@ output_destroy(struct bsi_output* output)
         struct bsi_workspace* next_ws =
             wl_container_of(next_output->workspaces.next, next_ws, link_output);
 
+        /* Migrated views are laid out for the next output and settle there
+         * together. */
+        transaction_begin(server);
+
         struct wl_list* curr_wss = &output->workspaces;
         struct bsi_workspace *ws, *ws_tmp;
         wl_list_for_each_safe(ws, ws_tmp, curr_wss, link_output)
         {
-            struct bsi_view* view;
-            wl_list_for_each(view, &ws->views, link_server)
+            struct bsi_view *view, *view_tmp;
+            wl_list_for_each_safe(view, view_tmp, &ws->views, link_workspace)
             {
                 workspace_view_move(ws, next_ws, view);
+                if (view->mapped)
+                    view_relayout(view);
             }
             workspace_destroy(ws);
         }
+
+        transaction_end(server);
     } else {
         /* Destroy everything, there are no more outputs. */
 
@@ -415,22 +746,175 @@ output_destroy(struct bsi_output* output)
         }
     }
 
+    wlr_scene_node_destroy(&output->tree->node);
+    cursor_scene_invalidate(server);
+    cursor_hit_index_destroy(&output->hit);
+    output_stats_dump(output);
+    free(output->stats);
+    if (output->overlay_damage)
+        overlay_damage_destroy(output->overlay_damage);
+    if (output->overlay_hud)
+        overlay_hud_destroy(output->overlay_hud);
     free(output);
 }
 
-/* Handlers */
+static uint64_t
+output_schedule_delay(struct bsi_output* output)
+{
+    struct bsi_server* server = output->server;
+    int32_t refresh = output->output->refresh;
+
+    enum bsi_output_schedule mode = output_schedule_mode(output);
+    if (mode == BSI_OUTPUT_SCHEDULE_OFF || refresh <= 0)
+        return 0;
+
+    uint64_t period = UINT64_C(1000000000) / refresh;
+    if (period <= BSI_OUTPUT_SCHEDULE_MARGIN_USEC)
+        return 0;
+    uint64_t delay_max = period - BSI_OUTPUT_SCHEDULE_MARGIN_USEC;
+
+    if (mode == BSI_OUTPUT_SCHEDULE_FIXED) {
+        return (server->frame.schedule_delay_usec < delay_max)
+                   ? server->frame.schedule_delay_usec
+                   : delay_max;
+    }
+
+    /* Wait for the next video frame if it is due before the vblank, so it is
+     * shown right away instead of a period late. A frame that isn't due
+     * leaves nothing to wait for. */
+    if (mode == BSI_OUTPUT_SCHEDULE_CONTENT) {
+        uint64_t due = output->schedule.content_usec;
+        if (due <= output->schedule.frame_usec)
+            return 0;
+        uint64_t delay = due - output->schedule.frame_usec +
+                         BSI_OUTPUT_SCHEDULE_CONTENT_SLACK_USEC;
+        return (delay < delay_max) ? delay : 0;
+    }
+
+    /* Budget for the slowest recent frame and then some, until there is
+     * nothing to go by compose right away. */
+    if (output->schedule.len_cost == 0)
+        return 0;
+    uint64_t cost = 0;
+    for (size_t i = 0; i < output->schedule.len_cost; ++i) {
+        if (output->schedule.cost[i] > cost)
+            cost = output->schedule.cost[i];
+    }
+    cost += cost / 2;
+    return (cost < delay_max) ? delay_max - cost : 0;
+}
+
 static void
-handle_frame(struct wl_listener* listener, void* data)
+output_schedule_record(struct bsi_output* output, uint64_t cost)
 {
-    struct bsi_output* output = wl_container_of(listener, output, listen.frame);
-    struct wlr_scene* wlr_scene = output->server->wlr_scene;
+    output->schedule.cost[output->schedule.next_cost] = cost;
+    output->schedule.next_cost =
+        (output->schedule.next_cost + 1) % BSI_OUTPUT_SCHEDULE_HISTORY;
+    if (output->schedule.len_cost < BSI_OUTPUT_SCHEDULE_HISTORY)
+        ++output->schedule.len_cost;
+}
+
+static void
+output_render(struct bsi_output* output)
+{
+    struct bsi_server* server = output->server;
+    bool adaptive =
+        output_schedule_mode(output) == BSI_OUTPUT_SCHEDULE_ADAPTIVE;
+
+    output->schedule.pending = false;
+
+    uint64_t begin_usec = 0, begin_cpu_usec = 0;
+    uint32_t commit_seq = output->output->commit_seq;
+    bool timed = output->stats || output->overlay_hud || adaptive;
+    if (timed)
+        begin_usec = stats_now_usec();
+    if (output->stats)
+        begin_cpu_usec = stats_cpu_usec();
+
+    /* Let coalesced pointer motion land in this frame. */
+    cursor_motion_flush(server);
 
     struct wlr_scene_output* wlr_scene_output =
-        wlr_scene_get_scene_output(wlr_scene, output->output);
+        wlr_scene_get_scene_output(server->wlr_scene, output->output);
+    if (output->overlay_damage)
+        overlay_damage_begin(output->overlay_damage, wlr_scene_output);
     wlr_scene_output_commit(wlr_scene_output);
 
+    uint64_t end_usec = 0;
+    if (timed)
+        end_usec = stats_now_usec();
+    if (adaptive)
+        output_schedule_record(output, end_usec - begin_usec);
+
+    /* The scene doesn't commit the output when nothing is damaged. */
+    if (output->stats)
+        output_stats_frame(output->stats,
+                           output->output->refresh,
+                           output->schedule.frame_usec,
+                           begin_usec,
+                           end_usec,
+                           stats_cpu_usec() - begin_cpu_usec,
+                           output->output->commit_seq != commit_seq);
+
+    if (output->overlay_hud)
+        overlay_hud_frame(output->overlay_hud,
+                          output->output->commit_seq != commit_seq,
+                          end_usec - begin_usec);
+    if (output->overlay_damage)
+        overlay_damage_end(
+            output->overlay_damage, wlr_scene_output, stats_now_usec());
+
+    /* Clients start their next frame now, with the same head start the
+     * composition had. Views that can't be seen get their frame callbacks
+     * from the throttle timer instead. */
     struct timespec now = util_timespec_get();
-    wlr_scene_output_send_frame_done(wlr_scene_output, &now);
+    output_send_frame_done(output, &now, false);
+}
+
+/* Handlers */
+static int
+handle_schedule_timer(void* data)
+{
+    struct bsi_output* output = data;
+    output_render(output);
+    return 0;
+}
+
+static void
+handle_frame(struct wl_listener* listener, void* data)
+{
+    struct bsi_output* output = wl_container_of(listener, output, listen.frame);
+
+    /* Composition for the last frame event hasn't happened yet. A scheduled
+     * frame can still come in after the output is turned off. */
+    if (output->schedule.pending || !output->output->enabled)
+        return;
+
+    struct bsi_view* foreground = output_policy_update(output);
+
+    if (output->stats ||
+        output_schedule_mode(output) != BSI_OUTPUT_SCHEDULE_OFF)
+        output->schedule.frame_usec = stats_now_usec();
+
+    /* The timer has millisecond resolution, round the delay down. */
+    uint64_t delay_ms = output_schedule_delay(output) / 1000;
+    if (delay_ms == 0) {
+        output_render(output);
+        return;
+    }
+
+    /* The game starts on its next frame right away, so composition picks it
+     * up late in this period. */
+    if (output->schedule.policy == BSI_OUTPUT_POLICY_GAME) {
+        struct timespec now = util_timespec_get();
+        wlr_xdg_surface_for_each_surface(foreground->wlr_xdg_toplevel->base,
+                                         send_frame_done_iterator,
+                                         &now);
+        foreground->frame_early = true;
+    }
+
+    output->schedule.pending = true;
+    wl_event_source_timer_update(output->schedule.timer, delay_ms);
 }
 
 static void
@@ -459,44 +943,6 @@ handle_destroy(struct wl_listener* listener, void* data)
     }
 }
 
-static void
-handle_damage_frame(struct wl_listener* listener, void* data)
-{
-    struct bsi_output* output =
-        wl_container_of(listener, output, listen.damage_frame);
-
-    // TODO: How the fuck do you render stuff compositor side?
-
-    // struct bsi_server* server = output->server;
-
-    // wlr_renderer_begin(
-    //     server->wlr_renderer, output->output->width, output->output->height);
-
-    // bool needs_frame;
-    // pixman_region32_t damage;
-    // pixman_region32_init(&damage);
-    // if (!wlr_output_damage_attach_render(output->damage, &needs_frame,
-    // &damage))
-    //     return;
-
-    // if (needs_frame) {
-    //     struct bsi_decoration* deco;
-    //     wl_list_for_each(deco, &server->scene.decorations, link_server)
-    //     {
-    //         float matrix[9];
-    //         struct wlr_texture* texture;
-    //         struct wlr_fbox source_box;
-    //         bsi_decoration_draw(deco, &texture, matrix, &source_box);
-    //         wlr_render_texture_with_matrix(
-    //             output->output->renderer, texture, matrix, 1.0f);
-    //     }
-    // } else {
-    //     wlr_output_rollback(output->output);
-    // }
-
-    // pixman_region32_fini(&damage);
-}
-
 /* Global server handlers. */
 void
 handle_new_output(struct wl_listener* listener, void* data)
@@ -566,12 +1012,13 @@ handle_new_output(struct wl_listener* listener, void* data)
 
     util_slot_connect(
         &output->output->events.frame, &output->listen.frame, handle_frame);
+    output->schedule.timer =
+        wl_event_loop_add_timer(wl_display_get_event_loop(server->wl_display),
+                                handle_schedule_timer,
+                                output);
     util_slot_connect(&output->output->events.destroy,
                       &output->listen.destroy,
                       handle_destroy);
-    util_slot_connect(&output->damage->events.frame,
-                      &output->listen.damage_frame,
-                      handle_damage_frame);
 
     struct wlr_output_configuration_v1* config =
         wlr_output_configuration_v1_create();
@@ -616,26 +1063,14 @@ handle_output_layout_change(struct wl_listener* listener, void* data)
             config_head->state.y = output_box.y;
         }
 
-        /* Reset the usable box. */
-        struct wlr_box usable_box = { 0 };
-        wlr_output_effective_resolution(
-            output->output, &usable_box.width, &usable_box.height);
-        output_set_usable_box(output, &usable_box);
-
-        /* Reset the state of the layer shell layers, with regards to output box
-         * exclusive configuration. */
-        for (size_t i = 0; i < 4; ++i) {
-            struct bsi_layer_surface_toplevel* toplevel;
-            wl_list_for_each(toplevel, &output->layers[i], link_output)
-            {
-                toplevel->exclusive_configured = false;
-            }
-        }
-
+        /* The usable box and all layer surfaces have to be redone. */
+        output_arrange_mark(output, BSI_OUTPUT_DIRTY_MODE);
         output_layers_arrange(output);
-        output_surface_damage(output, NULL, true);
     }
 
+    if (server->session.locked)
+        session_lock_blank_update(server);
+
     wlr_output_manager_v1_set_configuration(server->wlr_output_manager, config);
 }
 
@@ -692,3 +1127,18 @@ handle_output_manager_test(struct wl_listener* listener, void* data)
     else
         wlr_output_configuration_v1_send_failed(config);
 }
+
+void
+handle_output_power_manager_set_mode(struct wl_listener* listener, void* data)
+{
+    debug("Got event set_mode from wlr_output_power_manager");
+
+    struct wlr_output_power_v1_set_mode_event* event = data;
+    struct bsi_output* output = event->output->data;
+    if (output == NULL)
+        return;
+
+    /* The client turns it back on, not input. */
+    output->power.idle_off = false;
+    output_power_set(output, event->mode == ZWLR_OUTPUT_POWER_V1_MODE_ON);
+}
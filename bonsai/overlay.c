@@ -0,0 +1,605 @@
+#include <cairo/cairo.h>
+#include <drm_fourcc.h>
+#include <math.h>
+#include <pixman.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-util.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/box.h>
+#include <wlr/util/region.h>
+
+#include "bonsai/log.h"
+#include "bonsai/output.h"
+#include "bonsai/overlay.h"
+#include "bonsai/server.h"
+#include "bonsai/stats.h"
+#include "bonsai/supervisor.h"
+#include "bonsai/worker.h"
+
+#define OVERLAY_TEXT_SIZE 14.0
+#define OVERLAY_TEXT_PAD 4
+#define OVERLAY_TEXT_LINE_MAX 256
+/* Opacity of fresh damage, it fades out from here. */
+#define OVERLAY_DAMAGE_ALPHA 0.4f
+
+/* Overlay text */
+static void
+text_destroy(struct wlr_buffer* wlr_buffer)
+{
+    struct bsi_overlay_text* text = wl_container_of(wlr_buffer, text, base);
+    cairo_surface_destroy(text->surface);
+    free(text);
+}
+
+static bool
+text_begin_data_ptr_access(struct wlr_buffer* wlr_buffer,
+                           uint32_t flags,
+                           void** data,
+                           uint32_t* format,
+                           size_t* stride)
+{
+    struct bsi_overlay_text* text = wl_container_of(wlr_buffer, text, base);
+    if (flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE)
+        return false;
+
+    *data = cairo_image_surface_get_data(text->surface);
+    *format = DRM_FORMAT_ARGB8888;
+    *stride = cairo_image_surface_get_stride(text->surface);
+    return true;
+}
+
+static void
+text_end_data_ptr_access(struct wlr_buffer* wlr_buffer)
+{
+}
+
+static const struct wlr_buffer_impl text_impl = {
+    .destroy = text_destroy,
+    .begin_data_ptr_access = text_begin_data_ptr_access,
+    .end_data_ptr_access = text_end_data_ptr_access,
+};
+
+static void
+text_lines(cairo_t* cr, const char* text, bool draw, double* width, int* lines)
+{
+    cairo_font_extents_t fe;
+    cairo_font_extents(cr, &fe);
+
+    char line[OVERLAY_TEXT_LINE_MAX];
+    *width = 0.0;
+    *lines = 0;
+    for (const char* at = text; *at != '\0';) {
+        size_t len = strcspn(at, "\n");
+        size_t len_line = len < sizeof(line) - 1 ? len : sizeof(line) - 1;
+        memcpy(line, at, len_line);
+        line[len_line] = '\0';
+
+        cairo_text_extents_t te;
+        cairo_text_extents(cr, line, &te);
+        if (te.x_advance > *width)
+            *width = te.x_advance;
+        if (draw) {
+            cairo_move_to(cr,
+                          OVERLAY_TEXT_PAD,
+                          OVERLAY_TEXT_PAD + fe.ascent + *lines * fe.height);
+            cairo_show_text(cr, line);
+        }
+
+        ++*lines;
+        at += len;
+        if (*at == '\n')
+            ++at;
+    }
+}
+
+static void
+text_font(cairo_t* cr)
+{
+    cairo_select_font_face(
+        cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, OVERLAY_TEXT_SIZE);
+}
+
+struct wlr_buffer*
+overlay_text_create(const char* text)
+{
+    /* Measure first, the buffer is just large enough for the text. */
+    cairo_surface_t* scratch =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+    cairo_t* cr = cairo_create(scratch);
+    text_font(cr);
+    double text_width;
+    int lines;
+    text_lines(cr, text, false, &text_width, &lines);
+    cairo_font_extents_t fe;
+    cairo_font_extents(cr, &fe);
+    cairo_destroy(cr);
+    cairo_surface_destroy(scratch);
+
+    int width = (int)ceil(text_width) + 2 * OVERLAY_TEXT_PAD;
+    int height = (int)ceil(lines * fe.height) + 2 * OVERLAY_TEXT_PAD;
+
+    struct bsi_overlay_text* buffer = calloc(1, sizeof(*buffer));
+    if (buffer == NULL) {
+        errn("Failed to allocate overlay text");
+        return NULL;
+    }
+    buffer->surface =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    if (cairo_surface_status(buffer->surface) != CAIRO_STATUS_SUCCESS) {
+        error("Failed to create overlay text surface %dx%d", width, height);
+        cairo_surface_destroy(buffer->surface);
+        free(buffer);
+        return NULL;
+    }
+
+    cr = cairo_create(buffer->surface);
+    cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.6);
+    cairo_paint(cr);
+    cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 1.0);
+    text_font(cr);
+    text_lines(cr, text, true, &text_width, &lines);
+    cairo_destroy(cr);
+    cairo_surface_flush(buffer->surface);
+
+    wlr_buffer_init(&buffer->base, &text_impl, width, height);
+    return &buffer->base;
+}
+
+static void
+text_job_work(void* data)
+{
+    struct bsi_overlay_text_job* job = data;
+    job->buffer = overlay_text_create(job->text);
+}
+
+static void
+text_job_done(void* data, bool ran)
+{
+    struct bsi_overlay_text_job* job = data;
+    if (job->owner != NULL)
+        job->apply(job->owner, ran ? job->buffer : NULL);
+    if (job->buffer != NULL)
+        wlr_buffer_drop(job->buffer);
+    free(job);
+}
+
+/* Cairo is slow enough to show up in frame times, the workers draw the text.
+ * `apply` has to clear `*pending`, it gets a NULL buffer on failure. */
+static void
+overlay_text_submit(struct bsi_server* server,
+                    struct bsi_overlay_text_job** pending,
+                    void* owner,
+                    void (*apply)(void* owner, struct wlr_buffer* buffer),
+                    const char* text)
+{
+    struct bsi_overlay_text_job* job =
+        calloc(1, sizeof(struct bsi_overlay_text_job));
+    if (job == NULL) {
+        errn("Failed to allocate overlay text job");
+        return;
+    }
+    job->owner = owner;
+    job->apply = apply;
+    job->buffer = NULL;
+    snprintf(job->text, sizeof(job->text), "%s", text);
+
+    /* Set before submitting, without workers it is done right away. */
+    *pending = job;
+    workers_submit(server->workers, text_job_work, text_job_done, job);
+}
+
+static void
+overlay_raise(struct bsi_server* server)
+{
+    /* Anything created after the overlays would be drawn over them. */
+    struct wlr_scene_node* node = &server->overlay.tree->node;
+    if (node->link.next != &server->wlr_scene->tree.children)
+        wlr_scene_node_raise_to_top(node);
+}
+
+/* Damage overlay */
+static void
+overlay_damage_own(struct bsi_overlay_damage* overlay, struct wlr_box* box)
+{
+    /* Children of the overlay tree are positioned in output local
+     * coordinates, the scene damages them in buffer pixels. */
+    pixman_region32_t damage;
+    pixman_region32_init_rect(&damage, box->x, box->y, box->width, box->height);
+    wlr_region_scale(&damage, &damage, overlay->output->output->scale);
+    pixman_region32_union(&overlay->own, &overlay->own, &damage);
+    pixman_region32_fini(&damage);
+}
+
+static void
+overlay_damage_rect_box(struct wlr_scene_rect* rect, struct wlr_box* box)
+{
+    *box = (struct wlr_box){
+        .x = rect->node.x,
+        .y = rect->node.y,
+        .width = rect->width,
+        .height = rect->height,
+    };
+}
+
+static void
+overlay_damage_rect_add(struct bsi_overlay_damage* overlay,
+                        pixman_box32_t* damage,
+                        uint64_t now_usec)
+{
+    float scale = overlay->output->output->scale;
+    struct wlr_box box = {
+        .x = floor(damage->x1 / scale),
+        .y = floor(damage->y1 / scale),
+        .width = ceil(damage->x2 / scale) - floor(damage->x1 / scale),
+        .height = ceil(damage->y2 / scale) - floor(damage->y1 / scale),
+    };
+
+    struct bsi_overlay_damage_rect* slot = &overlay->rects[overlay->next_rect];
+    overlay->next_rect = (overlay->next_rect + 1) % BSI_OVERLAY_DAMAGE_RECTS;
+    if (slot->rect != NULL) {
+        struct wlr_box old;
+        overlay_damage_rect_box(slot->rect, &old);
+        overlay_damage_own(overlay, &old);
+        wlr_scene_node_destroy(&slot->rect->node);
+    }
+
+    const float color[4] = {
+        OVERLAY_DAMAGE_ALPHA, 0.0f, 0.0f, OVERLAY_DAMAGE_ALPHA
+    };
+    slot->rect =
+        wlr_scene_rect_create(overlay->shown, box.width, box.height, color);
+    slot->born_usec = now_usec;
+    /* New nodes start out at the origin of their parent. */
+    struct wlr_box origin = { 0, 0, box.width, box.height };
+    overlay_damage_own(overlay, &origin);
+    wlr_scene_node_set_position(&slot->rect->node, box.x, box.y);
+    overlay_damage_own(overlay, &box);
+}
+
+static void
+overlay_damage_counter_apply(void* owner, struct wlr_buffer* buffer)
+{
+    struct bsi_overlay_damage* overlay = owner;
+    overlay->counter_job = NULL;
+    if (buffer == NULL) {
+        overlay->counter_stale = true;
+        return;
+    }
+
+    /* This comes in between frames, the damage still counts as the overlay's
+     * own in the next one. */
+    struct wlr_box box = { .x = 8, .y = 8 };
+    if (overlay->counter == NULL) {
+        overlay->counter = wlr_scene_buffer_create(overlay->tree, buffer);
+        struct wlr_box origin = { 0, 0, buffer->width, buffer->height };
+        overlay_damage_own(overlay, &origin);
+        wlr_scene_node_set_position(&overlay->counter->node, box.x, box.y);
+    } else {
+        box.width = overlay->counter->buffer->width;
+        box.height = overlay->counter->buffer->height;
+        overlay_damage_own(overlay, &box);
+        wlr_scene_buffer_set_buffer(overlay->counter, buffer);
+    }
+    box.width = buffer->width;
+    box.height = buffer->height;
+    overlay_damage_own(overlay, &box);
+}
+
+struct bsi_overlay_damage*
+overlay_damage_create(struct bsi_output* output)
+{
+    struct bsi_overlay_damage* overlay =
+        calloc(1, sizeof(struct bsi_overlay_damage));
+    overlay->output = output;
+    overlay->tree = wlr_scene_tree_create(output->server->overlay.tree);
+    /* Created first, so the counter always goes above the rectangles. */
+    overlay->shown = wlr_scene_tree_create(overlay->tree);
+    overlay->counter = NULL;
+    overlay->counter_job = NULL;
+    overlay->next_rect = 0;
+    pixman_region32_init(&overlay->frame);
+    pixman_region32_init(&overlay->own);
+    overlay->pixels = 0;
+    overlay->counter_stale = true;
+    return overlay;
+}
+
+void
+overlay_damage_destroy(struct bsi_overlay_damage* overlay)
+{
+    if (overlay->counter_job != NULL)
+        overlay->counter_job->owner = NULL;
+    wlr_scene_node_destroy(&overlay->tree->node);
+    pixman_region32_fini(&overlay->frame);
+    pixman_region32_fini(&overlay->own);
+    free(overlay);
+}
+
+void
+overlay_damage_begin(struct bsi_overlay_damage* overlay,
+                     struct wlr_scene_output* scene_output)
+{
+    /* Drawing the damage damages too, leave that out or the overlay only
+     * ever shows itself. Real damage under the overlay gets lost with it. */
+    pixman_region32_subtract(
+        &overlay->frame, &scene_output->damage->current, &overlay->own);
+    pixman_region32_clear(&overlay->own);
+}
+
+void
+overlay_damage_end(struct bsi_overlay_damage* overlay,
+                   struct wlr_scene_output* scene_output,
+                   uint64_t now_usec)
+{
+    struct bsi_server* server = overlay->output->server;
+
+    overlay_raise(server);
+    wlr_scene_node_set_position(
+        &overlay->tree->node, scene_output->x, scene_output->y);
+
+    /* Fade out what is already on screen. */
+    for (size_t i = 0; i < BSI_OVERLAY_DAMAGE_RECTS; ++i) {
+        struct bsi_overlay_damage_rect* slot = &overlay->rects[i];
+        if (slot->rect == NULL)
+            continue;
+
+        struct wlr_box box;
+        overlay_damage_rect_box(slot->rect, &box);
+        overlay_damage_own(overlay, &box);
+
+        uint64_t age_usec = now_usec - slot->born_usec;
+        if (age_usec >= BSI_OVERLAY_DAMAGE_FADE_USEC) {
+            wlr_scene_node_destroy(&slot->rect->node);
+            slot->rect = NULL;
+            continue;
+        }
+
+        float alpha = OVERLAY_DAMAGE_ALPHA *
+                      (1.0f - (float)age_usec / BSI_OVERLAY_DAMAGE_FADE_USEC);
+        const float color[4] = { alpha, 0.0f, 0.0f, alpha };
+        wlr_scene_rect_set_color(slot->rect, color);
+    }
+
+    /* Then put the damage of this frame on top. */
+    int len_rects;
+    pixman_box32_t* rects =
+        pixman_region32_rectangles(&overlay->frame, &len_rects);
+    uint64_t pixels = 0;
+    for (int i = 0; i < len_rects; ++i)
+        pixels += (uint64_t)(rects[i].x2 - rects[i].x1) *
+                  (rects[i].y2 - rects[i].y1);
+    if (len_rects > BSI_OVERLAY_DAMAGE_FRAME_RECTS) {
+        rects = pixman_region32_extents(&overlay->frame);
+        len_rects = 1;
+    }
+    for (int i = 0; i < len_rects; ++i)
+        overlay_damage_rect_add(overlay, &rects[i], now_usec);
+    pixman_region32_clear(&overlay->frame);
+
+    if (pixels != overlay->pixels) {
+        overlay->pixels = pixels;
+        overlay->counter_stale = true;
+    }
+
+    /* One counter redraw in flight at a time, a stale one gets redrawn
+     * after it. */
+    if (!overlay->counter_stale || overlay->counter_job != NULL)
+        return;
+
+    char text[64];
+    snprintf(text, sizeof(text), "damage %lu px", overlay->pixels);
+    overlay->counter_stale = false;
+    overlay_text_submit(server,
+                        &overlay->counter_job,
+                        overlay,
+                        overlay_damage_counter_apply,
+                        text);
+}
+
+void
+overlays_damage_set(struct bsi_server* server, bool enabled)
+{
+    server->overlay.damage = enabled;
+    info("Damage overlay is %s", enabled ? "on" : "off");
+
+    struct bsi_output* output;
+    wl_list_for_each(output, &server->output.outputs, link_server)
+    {
+        if (enabled && output->overlay_damage == NULL) {
+            output->overlay_damage = overlay_damage_create(output);
+        } else if (!enabled && output->overlay_damage != NULL) {
+            overlay_damage_destroy(output->overlay_damage);
+            output->overlay_damage = NULL;
+        }
+    }
+}
+
+/* HUD */
+static void
+overlay_hud_apply(void* owner, struct wlr_buffer* buffer)
+{
+    struct bsi_overlay_hud* hud = owner;
+    hud->text_job = NULL;
+    if (buffer == NULL) {
+        /* Drawn again next period. */
+        hud->text[0] = '\0';
+        return;
+    }
+
+    if (hud->buffer == NULL)
+        hud->buffer =
+            wlr_scene_buffer_create(hud->output->server->overlay.tree, buffer);
+    else
+        wlr_scene_buffer_set_buffer(hud->buffer, buffer);
+
+    /* Top right corner, the damage counter is in the top left one. */
+    struct wlr_box output_box;
+    wlr_output_layout_get_box(hud->output->server->wlr_output_layout,
+                              hud->output->output,
+                              &output_box);
+    wlr_scene_node_set_position(&hud->buffer->node,
+                                output_box.x + output_box.width -
+                                    hud->buffer->buffer->width - 8,
+                                output_box.y + 8);
+}
+
+static void
+overlay_hud_update(struct bsi_overlay_hud* hud, const char* text)
+{
+    /* Numbers that didn't change don't get drawn again, and a period that
+     * ends before the last text got drawn is skipped. */
+    if (hud->text_job != NULL || strcmp(hud->text, text) == 0)
+        return;
+
+    snprintf(hud->text, sizeof(hud->text), "%s", text);
+    overlay_text_submit(
+        hud->output->server, &hud->text_job, hud, overlay_hud_apply, text);
+}
+
+static int
+handle_hud_timer(void* data)
+{
+    struct bsi_server* server = data;
+    uint64_t now_usec = stats_now_usec();
+    double period = (now_usec - server->overlay.hud.sampled_usec) / 1e6;
+    if (period <= 0.0)
+        period = BSI_OVERLAY_HUD_PERIOD_MSEC / 1e3;
+
+    /* The commit rate is of whatever view has focus at the end of the
+     * period, it starts over when focus moves. */
+    struct bsi_view* focused = views_get_focused(server);
+    uint32_t focused_seq = 0;
+    if (focused != NULL && focused->type == BSI_VIEW_TYPE_XDG_SHELL)
+        focused_seq = focused->wlr_xdg_toplevel->base->surface->current.seq;
+    double focused_rate = 0.0;
+    if (focused != NULL && focused == server->overlay.hud.focused)
+        focused_rate =
+            (uint32_t)(focused_seq - server->overlay.hud.focused_seq) / period;
+    server->overlay.hud.focused = focused;
+    server->overlay.hud.focused_seq = focused_seq;
+
+    size_t mapped = 0;
+    struct bsi_view* view;
+    wl_list_for_each(view, &server->scene.views, link_server)
+    {
+        if (view->mapped)
+            ++mapped;
+    }
+
+    double input_rate =
+        (server->input.events - server->overlay.hud.input_events) / period;
+    /* Sampled less often than the HUD, a bar burning CPU still shows. */
+    double helpers_cpu = server->supervisor != NULL
+                             ? supervisor_cpu_percent(server->supervisor)
+                             : 0.0;
+    server->overlay.hud.input_events = server->input.events;
+    server->overlay.hud.sampled_usec = now_usec;
+
+    overlay_raise(server);
+    struct bsi_output* output;
+    wl_list_for_each(output, &server->output.outputs, link_server)
+    {
+        struct bsi_overlay_hud* hud = output->overlay_hud;
+        if (hud == NULL)
+            continue;
+
+        char text[BSI_OVERLAY_HUD_TEXT_MAX];
+        snprintf(text,
+                 sizeof(text),
+                 "%s\n"
+                 "fps      %5.1f\n"
+                 "compose  %5.2f ms\n"
+                 "focused  %5.1f commits/s\n"
+                 "views    %5ld mapped\n"
+                 "input    %5.1f events/s\n"
+                 "helpers  %5.1f %% cpu",
+                 output->output->name,
+                 hud->frames / period,
+                 hud->frames ? hud->compose_usec / 1e3 / hud->frames : 0.0,
+                 focused_rate,
+                 mapped,
+                 input_rate,
+                 helpers_cpu);
+        hud->frames = hud->compose_usec = 0;
+        overlay_hud_update(hud, text);
+    }
+
+    wl_event_source_timer_update(server->overlay.hud.timer,
+                                 BSI_OVERLAY_HUD_PERIOD_MSEC);
+    return 0;
+}
+
+struct bsi_overlay_hud*
+overlay_hud_create(struct bsi_output* output)
+{
+    struct bsi_overlay_hud* hud = calloc(1, sizeof(struct bsi_overlay_hud));
+    hud->output = output;
+    hud->buffer = NULL;
+    hud->text[0] = '\0';
+    hud->text_job = NULL;
+    hud->frames = hud->compose_usec = 0;
+    return hud;
+}
+
+void
+overlay_hud_destroy(struct bsi_overlay_hud* hud)
+{
+    if (hud->text_job != NULL)
+        hud->text_job->owner = NULL;
+    if (hud->buffer != NULL)
+        wlr_scene_node_destroy(&hud->buffer->node);
+    free(hud);
+}
+
+void
+overlay_hud_frame(struct bsi_overlay_hud* hud,
+                  bool committed,
+                  uint64_t compose_usec)
+{
+    if (!committed)
+        return;
+    ++hud->frames;
+    hud->compose_usec += compose_usec;
+}
+
+void
+overlays_hud_set(struct bsi_server* server, bool enabled)
+{
+    server->overlay.hud.enabled = enabled;
+    info("HUD is %s", enabled ? "on" : "off");
+
+    if (enabled && server->overlay.hud.timer == NULL) {
+        server->overlay.hud.timer = wl_event_loop_add_timer(
+            wl_display_get_event_loop(server->wl_display),
+            handle_hud_timer,
+            server);
+        server->overlay.hud.sampled_usec = stats_now_usec();
+        server->overlay.hud.input_events = server->input.events;
+        server->overlay.hud.focused = NULL;
+        wl_event_source_timer_update(server->overlay.hud.timer,
+                                     BSI_OVERLAY_HUD_PERIOD_MSEC);
+    } else if (!enabled && server->overlay.hud.timer != NULL) {
+        wl_event_source_remove(server->overlay.hud.timer);
+        server->overlay.hud.timer = NULL;
+    }
+
+    struct bsi_output* output;
+    wl_list_for_each(output, &server->output.outputs, link_server)
+    {
+        if (enabled && output->overlay_hud == NULL) {
+            output->overlay_hud = overlay_hud_create(output);
+        } else if (!enabled && output->overlay_hud != NULL) {
+            overlay_hud_destroy(output->overlay_hud);
+            output->overlay_hud = NULL;
+        }
+    }
+}
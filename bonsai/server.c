@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <libinput.h>
 #include <math.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -26,9 +27,10 @@
 #include <wlr/types/wlr_idle_inhibit_v1.h>
 #include <wlr/types/wlr_input_inhibitor.h>
 #include <wlr/types/wlr_output.h>
-#include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_output_management_v1.h>
+#include <wlr/types/wlr_output_power_management_v1.h>
+#include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_primary_selection.h>
 #include <wlr/types/wlr_primary_selection_v1.h>
 #include <wlr/types/wlr_scene.h>
@@ -47,6 +49,7 @@
 
 #include "bonsai/config/atom.h"
 #include "bonsai/config/config.h"
+#include "bonsai/config/watch.h"
 #include "bonsai/desktop/decoration.h"
 #include "bonsai/desktop/idle.h"
 #include "bonsai/desktop/layers.h"
@@ -58,20 +61,76 @@
 #include "bonsai/log.h"
 #include "bonsai/output.h"
 #include "bonsai/server.h"
+#include "bonsai/stats.h"
+#include "bonsai/supervisor.h"
 #include "bonsai/util.h"
+#include "bonsai/worker.h"
+
+static int
+handle_frame_throttle_timer(void* data)
+{
+    struct bsi_server* server = data;
+
+    struct timespec now = util_timespec_get();
+    struct bsi_output* output;
+    wl_list_for_each(output, &server->output.outputs, link_server)
+    {
+        output_send_frame_done(output, &now, true);
+    }
+
+    wl_event_source_timer_update(server->frame.throttle_timer,
+                                 1000 / server->frame.throttle_hz);
+    return 0;
+}
+
+static int
+handle_stats_dump_signal(int signal_number, void* data)
+{
+    struct bsi_server* server = data;
+
+    struct bsi_output* output;
+    wl_list_for_each(output, &server->output.outputs, link_server)
+    {
+        output_stats_dump(output);
+    }
+    if (server->workers != NULL)
+        workers_stats_dump(server->workers);
+    if (server->launcher != NULL)
+        launcher_stats_dump(server->launcher);
+    if (server->supervisor != NULL)
+        supervisor_stats_dump(server->supervisor);
+
+    return 0;
+}
 
 struct bsi_server*
 server_init(struct bsi_server* server, struct bsi_config* config)
 {
     server->config.config = config;
+    server->launcher = NULL;
     server->config.wallpaper = NULL;
     server->config.workspaces = 0;
+    server->config.watch = NULL;
     wl_list_init(&server->config.input);
+    server->cursor.motion.coalesce = false;
+    server->frame.throttle_hz = 1;
+    server->frame.schedule = BSI_OUTPUT_SCHEDULE_OFF;
+    server->frame.schedule_delay_usec = 0;
+    server->stats.enabled = false;
+    server->overlay.damage = false;
+    server->overlay.hud.enabled = false;
+    server->overlay.hud.timer = NULL;
+    server->idle.granularity_msec = BSI_IDLE_GRANULARITY_MSEC;
+    server->idle.power_off_sec = 0;
+    keybinds_init(&server->input.keybinds);
     config_apply(config);
 
     wl_list_init(&server->output.outputs);
 
     server->wl_display = wl_display_create();
+    server->workers =
+        workers_create(wl_display_get_event_loop(server->wl_display));
+    server->supervisor = supervisor_create(server);
 
     server->wlr_backend = wlr_backend_autocreate(server->wl_display);
     util_slot_connect(&server->wlr_backend->events.new_output,
@@ -93,7 +152,11 @@ server_init(struct bsi_server* server, struct bsi_config* config)
     server->wlr_allocator =
         wlr_allocator_autocreate(server->wlr_backend, server->wlr_renderer);
 
-    wlr_compositor_create(server->wl_display, server->wlr_renderer);
+    server->wlr_compositor =
+        wlr_compositor_create(server->wl_display, server->wlr_renderer);
+    util_slot_connect(&server->wlr_compositor->events.new_surface,
+                      &server->listen.compositor_new_surface,
+                      handle_compositor_new_surface);
     wlr_subcompositor_create(server->wl_display);
     wlr_data_device_manager_create(server->wl_display);
     wlr_gamma_control_manager_v1_create(server->wl_display);
@@ -111,6 +174,11 @@ server_init(struct bsi_server* server, struct bsi_config* config)
     util_slot_connect(&server->wlr_output_manager->events.test,
                       &server->listen.output_manager_test,
                       handle_output_manager_test);
+    server->wlr_output_power_manager =
+        wlr_output_power_manager_v1_create(server->wl_display);
+    util_slot_connect(&server->wlr_output_power_manager->events.set_mode,
+                      &server->listen.output_power_set_mode,
+                      handle_output_power_manager_set_mode);
 
     wlr_xdg_output_manager_v1_create(server->wl_display,
                                      server->wlr_output_layout);
@@ -118,6 +186,16 @@ server_init(struct bsi_server* server, struct bsi_config* config)
     server->wlr_scene = wlr_scene_create();
     wlr_scene_attach_output_layout(server->wlr_scene,
                                    server->wlr_output_layout);
+    server->overlay.tree = wlr_scene_tree_create(&server->wlr_scene->tree);
+
+    /* The scene sends presented feedback for surfaces on the output it
+     * commits, wlroots discards the feedback of replaced commits. */
+    server->wlr_presentation =
+        wlr_presentation_create(server->wl_display, server->wlr_backend);
+    wlr_scene_set_presentation(server->wlr_scene, server->wlr_presentation);
+
+    /* Content type hints pick the frame policy of each output. */
+    server->content_type_manager = content_type_manager_create(server);
 
     server->wlr_xdg_shell = wlr_xdg_shell_create(server->wl_display, 2);
     util_slot_connect(&server->wlr_xdg_shell->events.new_surface,
@@ -161,9 +239,14 @@ server_init(struct bsi_server* server, struct bsi_config* config)
                       handle_xdg_request_activate);
 
     server->wlr_idle = wlr_idle_create(server->wl_display);
-    util_slot_connect(&server->wlr_idle->events.activity_notify,
-                      &server->listen.activity_notify,
-                      handle_idle_activity_notify);
+    server->idle.notifier = idle_notifier_create(server);
+    server->idle.inhibited = false;
+    server->idle.activity_msec = stats_now_usec() / 1000;
+    server->idle.reset_msec = 0;
+    server->idle.reset_interval_msec = 0;
+    server->idle.idled = 0;
+    server->idle.activity = server->idle.resets = 0;
+    idle_power_init(server);
     server->wlr_idle_inhibit_manager =
         wlr_idle_inhibit_v1_create(server->wl_display);
     util_slot_connect(&server->wlr_idle_inhibit_manager->events.new_inhibitor,
@@ -178,6 +261,7 @@ server_init(struct bsi_server* server, struct bsi_config* config)
                       handle_session_lock_manager_new_lock);
     server->session.locked = false;
     server->session.lock = NULL;
+    server->session.blank = NULL;
 
     server->cursor.cursor_mode = BSI_CURSOR_NORMAL;
     server->cursor.cursor_image = BSI_CURSOR_IMAGE_NORMAL;
@@ -202,6 +286,10 @@ server_init(struct bsi_server* server, struct bsi_config* config)
         wlr_input_inhibit_manager_create(server->wl_display);
 
     wl_list_init(&server->input.inputs);
+    server->input.events = 0;
+    wl_list_init(&server->input.keymaps);
+    wl_list_init(&server->input.keyboard_groups);
+    server->input.keymap_hits = server->input.keymap_compiles = 0;
 
     util_slot_connect(&server->wlr_seat->events.pointer_grab_begin,
                       &server->listen.pointer_grab_begin,
@@ -228,9 +316,37 @@ server_init(struct bsi_server* server, struct bsi_config* config)
     wl_list_init(&server->scene.views);
     wl_list_init(&server->scene.views_fullscreen);
     wl_list_init(&server->scene.xdg_decorations);
+    server->scene.serial = 0;
+    server->scene.transaction.open = NULL;
+    server->scene.transaction.depth = 0;
+    wl_list_init(&server->scene.transaction.running);
+    server->scene.transaction.committed = 0;
+    server->scene.transaction.timed_out = 0;
+    server->cursor.hit.serial = 0;
+    server->cursor.hit.scene_surface = NULL;
+    server->cursor.hit.data = NULL;
+    server->cursor.hit.hits = server->cursor.hit.misses = 0;
+    pixman_region32_init(&server->cursor.hit.region);
+    server->cursor.motion.pending = false;
+    server->cursor.motion.dx = server->cursor.motion.dy = 0;
+    server->cursor.motion.received = server->cursor.motion.processed = 0;
 
     wl_list_init(&server->listen.workspace);
 
+    server->frame.throttle_timer = NULL;
+    server_frame_throttle_update(server);
+
+    server->stats.dump_signal = NULL;
+    if (server->stats.enabled)
+        server->stats.dump_signal = wl_event_loop_add_signal(
+            wl_display_get_event_loop(server->wl_display),
+            SIGUSR1,
+            handle_stats_dump_signal,
+            server);
+
+    if (server->overlay.hud.enabled)
+        overlays_hud_set(server, true);
+
     server->active_workspace = NULL;
     server->session.shutting_down = false;
     for (size_t i = 0; i < BSI_SERVER_EXTERN_PROG_MAX; ++i) {
@@ -242,9 +358,32 @@ server_init(struct bsi_server* server, struct bsi_config* config)
     if (!server->config.workspaces)
         server->config.workspaces = 5;
 
+    if (config->found)
+        server->config.watch = config_watch_create(config);
+
     return server;
 }
 
+void
+server_frame_throttle_update(struct bsi_server* server)
+{
+    if (server->frame.throttle_hz == 0) {
+        if (server->frame.throttle_timer != NULL) {
+            wl_event_source_remove(server->frame.throttle_timer);
+            server->frame.throttle_timer = NULL;
+        }
+        return;
+    }
+
+    if (server->frame.throttle_timer == NULL)
+        server->frame.throttle_timer = wl_event_loop_add_timer(
+            wl_display_get_event_loop(server->wl_display),
+            handle_frame_throttle_timer,
+            server);
+    wl_event_source_timer_update(server->frame.throttle_timer,
+                                 1000 / server->frame.throttle_hz);
+}
+
 void
 server_setup(struct bsi_server* server)
 {
@@ -302,7 +441,7 @@ server_setup(struct bsi_server* server)
                            "WAYLAND_DISPLAY",
                            "XDG_CURRENT_DESKTOP",
                            NULL };
-    if (!util_tryexec(argp, 5)) {
+    if (!util_tryexec(server->launcher, argp, 5)) {
         error("Failed to update dbus activation environment");
     }
 }
@@ -337,6 +476,35 @@ server_destroy(struct bsi_server* server)
     wl_list_remove(&server->listen.request_set_selection.link);
     wl_list_remove(&server->listen.request_set_primary_selection.link);
     wl_list_remove(&server->listen.xdg_new_surface.link);
+    wl_list_remove(&server->listen.compositor_new_surface.link);
+
+    debug("Cursor hit-test cache had %ld hits, %ld misses",
+          server->cursor.hit.hits,
+          server->cursor.hit.misses);
+    debug("Committed %ld transactions, %ld timed out",
+          server->scene.transaction.committed,
+          server->scene.transaction.timed_out);
+    debug("Cursor received %ld motion events, processed %ld",
+          server->cursor.motion.received,
+          server->cursor.motion.processed);
+    debug("Idle saw %ld activity events, reset the legacy timers %ld times, "
+          "turned the outputs off %ld times",
+          server->idle.activity,
+          server->idle.resets,
+          server->idle.power_offs);
+    if (server->cursor.hit.scene_surface)
+        wl_list_remove(&server->cursor.hit.destroy.link);
+    pixman_region32_fini(&server->cursor.hit.region);
+    if (server->frame.throttle_timer)
+        wl_event_source_remove(server->frame.throttle_timer);
+    if (server->stats.dump_signal)
+        wl_event_source_remove(server->stats.dump_signal);
+    if (server->overlay.hud.timer)
+        wl_event_source_remove(server->overlay.hud.timer);
+    if (server->idle.power_timer)
+        wl_event_source_remove(server->idle.power_timer);
+    keybinds_destroy(&server->input.keybinds);
+    input_keymaps_destroy(server);
 }
 
 /* Outputs */
@@ -406,7 +574,11 @@ outputs_setup_extern(struct bsi_server* server)
             }
             char** argp = NULL;
             size_t len_argp = util_split_argsp((char*)exep, argsp, " ", &argp);
-            util_tryexec(argp, len_argp);
+            /* Restarted when they crash. */
+            if (server->supervisor != NULL)
+                supervisor_add(server->supervisor, argp, len_argp);
+            else
+                util_tryexec(server->launcher, argp, len_argp);
             util_split_free(&argp);
             server->output.setup[i] = true;
         }
@@ -551,10 +723,11 @@ void
 views_add(struct bsi_server* server, struct bsi_view* view)
 {
     wl_list_insert(&server->scene.views, &view->link_server);
-    /* Initialize geometry state and arrange output. */
+    /* Initialize geometry state. The view stacking changed, so the output
+     * needs to be restacked on the next arrangement. */
     wlr_xdg_surface_get_geometry(view->wlr_xdg_toplevel->base, &view->geom);
     wlr_scene_node_coords(&view->tree->node, &view->geom.x, &view->geom.y);
-    output_layers_arrange(view->workspace->output);
+    output_arrange_mark(view->workspace->output, BSI_OUTPUT_DIRTY_STACKING);
 }
 
 void
@@ -624,9 +797,6 @@ idle_inhibitors_remove(struct bsi_idle_inhibitor* inhibitor)
 void
 idle_inhibitors_update(struct bsi_server* server)
 {
-    if (wl_list_empty(&server->idle.inhibitors))
-        return;
-
     bool inhibit = false;
     struct bsi_idle_inhibitor* idle;
     wl_list_for_each(idle, &server->idle.inhibitors, link_server)
@@ -635,7 +805,7 @@ idle_inhibitors_update(struct bsi_server* server)
             break;
     }
 
-    wlr_idle_set_enabled(server->wlr_idle, NULL, !inhibit);
+    idle_set_inhibited(server, inhibit);
 }
 
 /* Decorations */
@@ -0,0 +1,186 @@
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <wlr/types/wlr_output.h>
+
+#include "bonsai/log.h"
+#include "bonsai/output.h"
+#include "bonsai/stats.h"
+
+uint64_t
+stats_now_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t
+stats_cpu_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t
+histogram_bucket(uint64_t value)
+{
+    if (value < (1 << BSI_HISTOGRAM_SUB_BITS))
+        return value;
+    if (value >= (UINT64_C(1) << BSI_HISTOGRAM_MAX_BITS))
+        return BSI_HISTOGRAM_BUCKETS - 1;
+
+    size_t msb = 63 - __builtin_clzll(value);
+    size_t shift = msb - BSI_HISTOGRAM_SUB_BITS;
+    size_t sub = (value >> shift) - (1 << BSI_HISTOGRAM_SUB_BITS);
+    return ((shift + 1) << BSI_HISTOGRAM_SUB_BITS) + sub;
+}
+
+static uint64_t
+histogram_bucket_upper(size_t bucket)
+{
+    size_t magnitude = bucket >> BSI_HISTOGRAM_SUB_BITS;
+    size_t sub = bucket & ((1 << BSI_HISTOGRAM_SUB_BITS) - 1);
+    if (magnitude == 0)
+        return sub;
+
+    size_t shift = magnitude - 1;
+    uint64_t lower = (uint64_t)((1 << BSI_HISTOGRAM_SUB_BITS) + sub) << shift;
+    return lower + (UINT64_C(1) << shift) - 1;
+}
+
+void
+histogram_record(struct bsi_histogram* histogram, uint64_t value)
+{
+    if (histogram->count == 0 || value < histogram->min)
+        histogram->min = value;
+    if (value > histogram->max)
+        histogram->max = value;
+    histogram->sum += value;
+    ++histogram->count;
+    ++histogram->buckets[histogram_bucket(value)];
+}
+
+void
+histogram_merge(struct bsi_histogram* dst, const struct bsi_histogram* src)
+{
+    if (src->count == 0)
+        return;
+
+    if (dst->count == 0 || src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+    dst->sum += src->sum;
+    dst->count += src->count;
+    for (size_t i = 0; i < BSI_HISTOGRAM_BUCKETS; ++i)
+        dst->buckets[i] += src->buckets[i];
+}
+
+uint64_t
+histogram_quantile(const struct bsi_histogram* histogram, double quantile)
+{
+    if (histogram->count == 0)
+        return 0;
+
+    uint64_t target = ceil(quantile * histogram->count);
+    if (target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BSI_HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+        if (seen >= target) {
+            uint64_t upper = histogram_bucket_upper(i);
+            return (upper < histogram->max) ? upper : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+struct bsi_output_stats*
+output_stats_init(struct bsi_output_stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    return stats;
+}
+
+void
+output_stats_frame(struct bsi_output_stats* stats,
+                   int32_t refresh,
+                   uint64_t frame_usec,
+                   uint64_t begin_usec,
+                   uint64_t end_usec,
+                   uint64_t cpu_usec,
+                   bool committed)
+{
+    ++stats->frames;
+    histogram_record(&stats->commit, end_usec - begin_usec);
+    histogram_record(&stats->cpu, cpu_usec);
+    histogram_record(&stats->delay, begin_usec - frame_usec);
+
+    /* Frame events only keep coming while we commit, the interval after an
+     * idle stretch says nothing about the output. */
+    if (stats->last_committed) {
+        uint64_t interval = frame_usec - stats->last_frame_usec;
+        histogram_record(&stats->interval, interval);
+
+        /* A commit that made the next vblank has its frame one period later. */
+        if (refresh > 0) {
+            uint64_t period = UINT64_C(1000000000) / refresh;
+            if (interval > period + period / 2)
+                stats->missed += (interval + period / 2) / period - 1;
+        }
+    }
+
+    if (!committed)
+        ++stats->skipped;
+    stats->last_committed = committed;
+    stats->last_frame_usec = frame_usec;
+}
+
+static void
+histogram_dump(const char* name, const struct bsi_histogram* histogram)
+{
+    if (histogram->count == 0) {
+        info("  %s: no samples", name);
+        return;
+    }
+
+    info("  %s (us): n=%lu mean=%lu min=%lu p50=%lu p90=%lu p99=%lu "
+         "p99.9=%lu max=%lu",
+         name,
+         histogram->count,
+         histogram->sum / histogram->count,
+         histogram->min,
+         histogram_quantile(histogram, 0.5),
+         histogram_quantile(histogram, 0.9),
+         histogram_quantile(histogram, 0.99),
+         histogram_quantile(histogram, 0.999),
+         histogram->max);
+}
+
+void
+output_stats_dump(struct bsi_output* output)
+{
+    struct bsi_output_stats* stats = output->stats;
+    if (stats == NULL)
+        return;
+
+    info("Frame stats for output %ld/%s: %lu frames, %lu without damage, %lu "
+         "missed vblanks",
+         output->id,
+         output->output->name,
+         stats->frames,
+         stats->skipped,
+         stats->missed);
+    histogram_dump("commit", &stats->commit);
+    histogram_dump("cpu", &stats->cpu);
+    histogram_dump("interval", &stats->interval);
+    histogram_dump("delay", &stats->delay);
+}
@@ -0,0 +1,335 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+
+#include "bonsai/launcher.h"
+#include "bonsai/log.h"
+#include "bonsai/server.h"
+#include "bonsai/stats.h"
+#include "bonsai/supervisor.h"
+#include "bonsai/util.h"
+
+static const char*
+supervised_name(struct bsi_supervised* supervised)
+{
+    const char* slash = strrchr(supervised->argp[0], '/');
+    return slash ? slash + 1 : supervised->argp[0];
+}
+
+/* Fields 14 and 15 of /proc/<pid>/stat, after the parenthesized name that can
+ * have spaces in it. */
+static bool
+supervised_read_cpu(pid_t pid, uint64_t* cpu_usec)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    char* name_end = strrchr(buf, ')');
+    unsigned long utime, stime;
+    if (name_end == NULL ||
+        sscanf(name_end + 2,
+               "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime,
+               &stime) != 2)
+        return false;
+
+    long ticks = sysconf(_SC_CLK_TCK);
+    *cpu_usec = (uint64_t)(utime + stime) * 1000000 / ticks;
+    return true;
+}
+
+static long
+supervised_read_rss_kb(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+
+    long pages_total, pages_resident;
+    if (fscanf(f, "%ld %ld", &pages_total, &pages_resident) != 2)
+        pages_resident = -1;
+    fclose(f);
+    if (pages_resident < 0)
+        return -1;
+    return pages_resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void
+supervised_start(struct bsi_supervised* supervised)
+{
+    struct bsi_launcher* launcher = supervised->supervisor->server->launcher;
+    if (launcher == NULL || launcher->event_source == NULL) {
+        /* A fallback fork can't be watched. */
+        error("Starting '%s' unsupervised, there is no launcher helper",
+              supervised_name(supervised));
+        supervised->state = BSI_SUPERVISED_STOPPED;
+        util_forkexec(supervised->argp, supervised->len_argp);
+        return;
+    }
+
+    supervised->state = BSI_SUPERVISED_STARTING;
+    launcher_exec(
+        launcher, supervised->argp, supervised->len_argp, &supervised->watch);
+}
+
+static int
+handle_restart_timer(void* data)
+{
+    struct bsi_supervised* supervised = data;
+    info("Restarting '%s', restart %u",
+         supervised_name(supervised),
+         supervised->restarts);
+    supervised_start(supervised);
+    return 0;
+}
+
+static void
+handle_started(struct bsi_launcher_watch* watch, pid_t pid)
+{
+    struct bsi_supervised* supervised =
+        wl_container_of(watch, supervised, watch);
+    supervised->state = BSI_SUPERVISED_RUNNING;
+    supervised->pid = pid;
+    supervised->started_usec = stats_now_usec();
+    supervised->cpu_usec = 0;
+    supervised->cpu_percent = 0.0;
+    supervised->rss_kb = -1;
+}
+
+static void
+handle_exited(struct bsi_launcher_watch* watch, int status)
+{
+    struct bsi_supervised* supervised =
+        wl_container_of(watch, supervised, watch);
+    struct bsi_supervisor* supervisor = supervised->supervisor;
+    const char* name = supervised_name(supervised);
+
+    uint64_t ran_msec = 0;
+    if (supervised->state == BSI_SUPERVISED_RUNNING)
+        ran_msec = (stats_now_usec() - supervised->started_usec) / 1000;
+    supervised->pid = -1;
+    supervised->last_status = status;
+    supervised->cpu_total_usec += supervised->cpu_usec;
+    supervised->cpu_usec = 0;
+    supervised->cpu_percent = 0.0;
+
+    if (supervisor->server->session.shutting_down) {
+        supervised->state = BSI_SUPERVISED_STOPPED;
+        return;
+    }
+    if (status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        info("'%s' exited after %lu ms, not restarting it", name, ran_msec);
+        supervised->state = BSI_SUPERVISED_STOPPED;
+        return;
+    }
+
+    if (ran_msec >= BSI_SUPERVISOR_STABLE_MSEC)
+        supervised->backoff_msec = BSI_SUPERVISOR_BACKOFF_MIN_MSEC;
+    if (status == -1)
+        error("'%s' failed to start, retrying in %u ms",
+              name,
+              supervised->backoff_msec);
+    else if (WIFSIGNALED(status))
+        error("'%s' killed by signal %d after %lu ms, restarting in %u ms",
+              name,
+              WTERMSIG(status),
+              ran_msec,
+              supervised->backoff_msec);
+    else
+        error("'%s' exited with %d after %lu ms, restarting in %u ms",
+              name,
+              WEXITSTATUS(status),
+              ran_msec,
+              supervised->backoff_msec);
+
+    supervised->state = BSI_SUPERVISED_BACKOFF;
+    ++supervised->restarts;
+    wl_event_source_timer_update(supervised->restart_timer,
+                                 supervised->backoff_msec);
+    supervised->backoff_msec *= 2;
+    if (supervised->backoff_msec > BSI_SUPERVISOR_BACKOFF_MAX_MSEC)
+        supervised->backoff_msec = BSI_SUPERVISOR_BACKOFF_MAX_MSEC;
+}
+
+static int
+handle_sample_timer(void* data)
+{
+    struct bsi_supervisor* supervisor = data;
+    uint64_t now_usec = stats_now_usec();
+    uint64_t period_usec = now_usec - supervisor->sampled_usec;
+    supervisor->sampled_usec = now_usec;
+
+    struct bsi_supervised* supervised;
+    wl_list_for_each(supervised, &supervisor->supervised, link)
+    {
+        if (supervised->state != BSI_SUPERVISED_RUNNING)
+            continue;
+
+        uint64_t cpu_usec;
+        if (!supervised_read_cpu(supervised->pid, &cpu_usec))
+            continue;
+        /* The first sample of a run can cover less than the period. */
+        uint64_t since_usec = now_usec - supervised->started_usec;
+        if (since_usec > period_usec)
+            since_usec = period_usec;
+        supervised->cpu_percent =
+            since_usec ? (cpu_usec - supervised->cpu_usec) * 100.0 / since_usec
+                       : 0.0;
+        supervised->cpu_usec = cpu_usec;
+        supervised->rss_kb = supervised_read_rss_kb(supervised->pid);
+
+        if (supervised->cpu_percent > BSI_SUPERVISOR_CPU_WARN_PERCENT)
+            error("'%s' (%d) used %.1f%% CPU in the last %lu ms",
+                  supervised_name(supervised),
+                  supervised->pid,
+                  supervised->cpu_percent,
+                  period_usec / 1000);
+    }
+
+    wl_event_source_timer_update(supervisor->sample_timer,
+                                 BSI_SUPERVISOR_SAMPLE_MSEC);
+    return 0;
+}
+
+struct bsi_supervisor*
+supervisor_create(struct bsi_server* server)
+{
+    struct bsi_supervisor* supervisor =
+        calloc(1, sizeof(struct bsi_supervisor));
+    if (supervisor == NULL) {
+        errn("Failed to allocate the supervisor");
+        return NULL;
+    }
+    supervisor->server = server;
+    wl_list_init(&supervisor->supervised);
+    supervisor->sampled_usec = stats_now_usec();
+    supervisor->sample_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(server->wl_display),
+        handle_sample_timer,
+        supervisor);
+    wl_event_source_timer_update(supervisor->sample_timer,
+                                 BSI_SUPERVISOR_SAMPLE_MSEC);
+    return supervisor;
+}
+
+void
+supervisor_destroy(struct bsi_supervisor* supervisor)
+{
+    struct bsi_launcher* launcher = supervisor->server->launcher;
+    struct bsi_supervised *supervised, *supervised_tmp;
+    wl_list_for_each_safe(
+        supervised, supervised_tmp, &supervisor->supervised, link)
+    {
+        launcher_unwatch(launcher, &supervised->watch);
+        wl_event_source_remove(supervised->restart_timer);
+        wl_list_remove(&supervised->link);
+        for (size_t i = 0; i < supervised->len_argp; ++i)
+            free(supervised->argp[i]);
+        free(supervised->argp);
+        free(supervised);
+    }
+    wl_event_source_remove(supervisor->sample_timer);
+    free(supervisor);
+}
+
+bool
+supervisor_add(struct bsi_supervisor* supervisor,
+               char* const* argp,
+               const size_t len_argp)
+{
+    char path[256];
+    if (!util_findexec(argp[0], path, sizeof(path)))
+        return false;
+
+    struct bsi_supervised* supervised =
+        calloc(1, sizeof(struct bsi_supervised));
+    char** argp_copy = calloc(len_argp, sizeof(char*));
+    if (supervised == NULL || argp_copy == NULL) {
+        errn("Failed to allocate a supervised helper");
+        free(supervised);
+        free(argp_copy);
+        return false;
+    }
+    argp_copy[0] = strdup(path);
+    for (size_t i = 1; i < len_argp; ++i)
+        argp_copy[i] = argp[i] ? strdup(argp[i]) : NULL;
+
+    supervised->supervisor = supervisor;
+    supervised->watch.started = handle_started;
+    supervised->watch.exited = handle_exited;
+    supervised->argp = argp_copy;
+    supervised->len_argp = len_argp;
+    supervised->pid = -1;
+    supervised->last_status = -1;
+    supervised->restarts = 0;
+    supervised->backoff_msec = BSI_SUPERVISOR_BACKOFF_MIN_MSEC;
+    supervised->restart_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(supervisor->server->wl_display),
+        handle_restart_timer,
+        supervised);
+    supervised->cpu_usec = supervised->cpu_total_usec = 0;
+    supervised->cpu_percent = 0.0;
+    supervised->rss_kb = -1;
+    wl_list_insert(supervisor->supervised.prev, &supervised->link);
+
+    supervised_start(supervised);
+    return true;
+}
+
+double
+supervisor_cpu_percent(struct bsi_supervisor* supervisor)
+{
+    double cpu_percent = 0.0;
+    struct bsi_supervised* supervised;
+    wl_list_for_each(supervised, &supervisor->supervised, link)
+    {
+        if (supervised->state == BSI_SUPERVISED_RUNNING)
+            cpu_percent += supervised->cpu_percent;
+    }
+    return cpu_percent;
+}
+
+void
+supervisor_stats_dump(struct bsi_supervisor* supervisor)
+{
+    static const char* states[] = {
+        [BSI_SUPERVISED_STARTING] = "starting",
+        [BSI_SUPERVISED_RUNNING] = "running",
+        [BSI_SUPERVISED_BACKOFF] = "waiting to restart",
+        [BSI_SUPERVISED_STOPPED] = "stopped",
+    };
+
+    struct bsi_supervised* supervised;
+    wl_list_for_each(supervised, &supervisor->supervised, link)
+    {
+        info("Helper '%s' (%d) %s, %u restarts, last status %d, cpu %lu ms "
+             "(%.1f%% recently), rss %ld kB",
+             supervised_name(supervised),
+             supervised->pid,
+             states[supervised->state],
+             supervised->restarts,
+             supervised->last_status,
+             (supervised->cpu_total_usec + supervised->cpu_usec) / 1000,
+             supervised->cpu_percent,
+             supervised->rss_kb);
+    }
+}
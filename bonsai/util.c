@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <ctype.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -13,6 +14,7 @@
 
 struct bsi_server;
 
+#include "bonsai/launcher.h"
 #include "bonsai/log.h"
 #include "bonsai/server.h"
 #include "bonsai/util.h"
@@ -21,7 +23,7 @@ struct timespec
 util_timespec_get()
 {
     struct timespec ts;
-    timespec_get(&ts, TIME_UTC);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
     return ts;
 }
 
@@ -41,28 +43,38 @@ util_slot_disconnect(struct wl_listener* listener_memb)
 }
 
 bool
-util_tryexec(char* const* argp, const size_t len_argp)
+util_findexec(const char* name, char* path, const size_t len_path)
 {
     const char* binpaths[] = { "/usr/bin/", "/usr/local/bin/" };
-    char fargp[50] = { 0 };
-    char* aargp[len_argp]; // NOLINT
     for (size_t i = 0; i < 2; ++i) {
-        snprintf(fargp, 50, "%s%s", binpaths[i], argp[0]);
-        aargp[0] = fargp;
-        for (size_t i = 1; i < len_argp; ++i) {
-            aargp[i] = argp[i];
-        }
-        info("Trying to exec '%s'", fargp);
-        if (access(fargp, F_OK | X_OK) == 0) {
-            return util_forkexec(aargp, len_argp);
+        snprintf(path, len_path, "%s%s", binpaths[i], name);
+        info("Trying to exec '%s'", path);
+        if (access(path, F_OK | X_OK) == 0) {
+            return true;
         } else {
-            error("File '%s' F_OK | X_OK != 0", fargp);
+            error("File '%s' F_OK | X_OK != 0", path);
         }
-        memset(fargp, 0, 50);
     }
     return false;
 }
 
+bool
+util_tryexec(struct bsi_launcher* launcher,
+             char* const* argp,
+             const size_t len_argp)
+{
+    char fargp[50] = { 0 };
+    char* aargp[len_argp]; // NOLINT
+    if (!util_findexec(argp[0], fargp, sizeof(fargp)))
+        return false;
+
+    aargp[0] = fargp;
+    for (size_t i = 1; i < len_argp; ++i) {
+        aargp[i] = argp[i];
+    }
+    return launcher_exec(launcher, aargp, len_argp, NULL);
+}
+
 bool
 util_forkexec(char* const* argp, const size_t len_argp)
 {
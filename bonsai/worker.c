@@ -0,0 +1,202 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+
+#include "bonsai/log.h"
+#include "bonsai/stats.h"
+#include "bonsai/worker.h"
+
+static void*
+worker_main(void* data)
+{
+    struct bsi_workers* workers = data;
+
+    /* Signals are for the event loop, which handles them through signalfd. */
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    pthread_mutex_lock(&workers->lock);
+    while (true) {
+        while (!workers->stopping && wl_list_empty(&workers->queued))
+            pthread_cond_wait(&workers->cond, &workers->lock);
+        if (workers->stopping)
+            break;
+
+        struct bsi_worker_job* job =
+            wl_container_of(workers->queued.next, job, link);
+        wl_list_remove(&job->link);
+        pthread_mutex_unlock(&workers->lock);
+
+        uint64_t begin_usec = stats_now_usec();
+        job->work(job->data);
+        uint64_t work_usec = stats_now_usec() - begin_usec;
+
+        pthread_mutex_lock(&workers->lock);
+        ++workers->jobs;
+        workers->work_usec += work_usec;
+        if (work_usec > workers->max_usec)
+            workers->max_usec = work_usec;
+        wl_list_insert(workers->finished.prev, &job->link);
+
+        /* The event loop picks up every finished job on one wakeup. */
+        uint64_t one = 1;
+        if (write(workers->event_fd, &one, sizeof(one)) < 0 &&
+            errno != EAGAIN)
+            errn("Failed to wake the event loop for a finished job");
+    }
+    pthread_mutex_unlock(&workers->lock);
+
+    return NULL;
+}
+
+static void
+workers_complete(struct wl_list* jobs, bool ran)
+{
+    struct bsi_worker_job *job, *job_tmp;
+    wl_list_for_each_safe(job, job_tmp, jobs, link)
+    {
+        wl_list_remove(&job->link);
+        job->done(job->data, ran);
+        free(job);
+    }
+}
+
+static int
+handle_event_fd(int fd, uint32_t mask, void* data)
+{
+    struct bsi_workers* workers = data;
+
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        errn("Failed to read the worker eventfd");
+
+    /* Take the finished jobs out first, `done` may well queue new ones. */
+    struct wl_list finished;
+    wl_list_init(&finished);
+    pthread_mutex_lock(&workers->lock);
+    wl_list_insert_list(&finished, &workers->finished);
+    wl_list_init(&workers->finished);
+    pthread_mutex_unlock(&workers->lock);
+
+    workers_complete(&finished, true);
+    return 0;
+}
+
+struct bsi_workers*
+workers_create(struct wl_event_loop* loop)
+{
+    struct bsi_workers* workers = calloc(1, sizeof(struct bsi_workers));
+    if (workers == NULL) {
+        errn("Failed to allocate workers");
+        return NULL;
+    }
+
+    workers->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (workers->event_fd < 0) {
+        errn("Failed to create the worker eventfd");
+        free(workers);
+        return NULL;
+    }
+    workers->event_source = wl_event_loop_add_fd(loop,
+                                                 workers->event_fd,
+                                                 WL_EVENT_READABLE,
+                                                 handle_event_fd,
+                                                 workers);
+
+    pthread_mutex_init(&workers->lock, NULL);
+    pthread_cond_init(&workers->cond, NULL);
+    workers->stopping = false;
+    wl_list_init(&workers->queued);
+    wl_list_init(&workers->finished);
+    workers->jobs = workers->work_usec = workers->max_usec = 0;
+
+    workers->len_threads = 0;
+    for (size_t i = 0; i < BSI_WORKERS_THREADS; ++i) {
+        int err = pthread_create(
+            &workers->threads[i], NULL, worker_main, workers);
+        if (err != 0) {
+            error("Failed to start worker thread %ld: %s", i, strerror(err));
+            break;
+        }
+        ++workers->len_threads;
+    }
+
+    if (workers->len_threads == 0) {
+        workers_destroy(workers);
+        return NULL;
+    }
+
+    info("Started %ld worker threads", workers->len_threads);
+    return workers;
+}
+
+void
+workers_destroy(struct bsi_workers* workers)
+{
+    pthread_mutex_lock(&workers->lock);
+    workers->stopping = true;
+    pthread_cond_broadcast(&workers->cond);
+    pthread_mutex_unlock(&workers->lock);
+
+    /* Threads finish the job they are on, the rest never runs. */
+    for (size_t i = 0; i < workers->len_threads; ++i)
+        pthread_join(workers->threads[i], NULL);
+
+    workers_stats_dump(workers);
+    workers_complete(&workers->finished, true);
+    workers_complete(&workers->queued, false);
+
+    wl_event_source_remove(workers->event_source);
+    close(workers->event_fd);
+    pthread_cond_destroy(&workers->cond);
+    pthread_mutex_destroy(&workers->lock);
+    free(workers);
+}
+
+void
+workers_submit(struct bsi_workers* workers,
+               void (*work)(void* data),
+               void (*done)(void* data, bool ran),
+               void* data)
+{
+    struct bsi_worker_job* job = NULL;
+    if (workers != NULL)
+        job = calloc(1, sizeof(struct bsi_worker_job));
+
+    if (job == NULL) {
+        /* No pool, it blocks like it used to. */
+        work(data);
+        done(data, true);
+        return;
+    }
+
+    job->work = work;
+    job->done = done;
+    job->data = data;
+
+    pthread_mutex_lock(&workers->lock);
+    wl_list_insert(workers->queued.prev, &job->link);
+    pthread_cond_signal(&workers->cond);
+    pthread_mutex_unlock(&workers->lock);
+}
+
+void
+workers_stats_dump(struct bsi_workers* workers)
+{
+    pthread_mutex_lock(&workers->lock);
+    info("Workers ran %lu jobs, %lu us off the event loop, longest %lu us",
+         workers->jobs,
+         workers->work_usec,
+         workers->max_usec);
+    pthread_mutex_unlock(&workers->lock);
+}
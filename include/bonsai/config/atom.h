@@ -13,6 +13,10 @@ enum bsi_config_atom_type
     BSI_CONFIG_ATOM_INPUT,
     BSI_CONFIG_ATOM_WORKSPACE,
     BSI_CONFIG_ATOM_WALLPAPER,
+    BSI_CONFIG_ATOM_CURSOR,
+    BSI_CONFIG_ATOM_FRAME,
+    BSI_CONFIG_ATOM_BIND,
+    BSI_CONFIG_ATOM_IDLE,
 };
 
 enum bsi_input_config_type
@@ -48,19 +52,23 @@ struct bsi_input_config
     uint32_t kbd_repeat_rate;
     uint32_t kbd_repeat_delay;
 
+    struct bsi_config_atom* atom; /* The line it comes from. */
     struct wl_list link;
 };
 
 struct bsi_config_atom_impl
 {
     bool (*apply)(struct bsi_config_atom* atom, struct bsi_server* server);
+    /* Undoes the line, when it's taken out of the config. */
+    void (*reset)(struct bsi_config_atom* atom, struct bsi_server* server);
 };
 
 struct bsi_config_atom
 {
     enum bsi_config_atom_type type;
     const struct bsi_config_atom_impl* impl;
-    char* cmd;
+    char* cmd;  /* Split in place when applied. */
+    char* line; /* As written, to tell lines apart on reload. */
     struct wl_list link;
 };
 
@@ -79,27 +87,87 @@ config_input_destroy(struct bsi_input_config* conf);
 bool
 config_output_apply(struct bsi_config_atom* atom, struct bsi_server* server);
 
+void
+config_output_reset(struct bsi_config_atom* atom, struct bsi_server* server);
+
 bool
 config_input_apply(struct bsi_config_atom* atom, struct bsi_server* server);
 
+void
+config_input_reset(struct bsi_config_atom* atom, struct bsi_server* server);
+
 bool
 config_workspace_apply(struct bsi_config_atom* atom, struct bsi_server* server);
 
+void
+config_workspace_reset(struct bsi_config_atom* atom, struct bsi_server* server);
+
 bool
 config_wallpaper_apply(struct bsi_config_atom* atom, struct bsi_server* server);
 
+void
+config_wallpaper_reset(struct bsi_config_atom* atom, struct bsi_server* server);
+
+bool
+config_cursor_apply(struct bsi_config_atom* atom, struct bsi_server* server);
+
+void
+config_cursor_reset(struct bsi_config_atom* atom, struct bsi_server* server);
+
+bool
+config_frame_apply(struct bsi_config_atom* atom, struct bsi_server* server);
+
+void
+config_frame_reset(struct bsi_config_atom* atom, struct bsi_server* server);
+
+bool
+config_bind_apply(struct bsi_config_atom* atom, struct bsi_server* server);
+
+void
+config_bind_reset(struct bsi_config_atom* atom, struct bsi_server* server);
+
+bool
+config_idle_apply(struct bsi_config_atom* atom, struct bsi_server* server);
+
+void
+config_idle_reset(struct bsi_config_atom* atom, struct bsi_server* server);
+
 static const struct bsi_config_atom_impl output_impl = {
     .apply = config_output_apply,
+    .reset = config_output_reset,
 };
 
 static const struct bsi_config_atom_impl input_impl = {
     .apply = config_input_apply,
+    .reset = config_input_reset,
 };
 
 static const struct bsi_config_atom_impl workspace_impl = {
     .apply = config_workspace_apply,
+    .reset = config_workspace_reset,
 };
 
 static const struct bsi_config_atom_impl wallpaper_impl = {
     .apply = config_wallpaper_apply,
+    .reset = config_wallpaper_reset,
+};
+
+static const struct bsi_config_atom_impl cursor_impl = {
+    .apply = config_cursor_apply,
+    .reset = config_cursor_reset,
+};
+
+static const struct bsi_config_atom_impl frame_impl = {
+    .apply = config_frame_apply,
+    .reset = config_frame_reset,
+};
+
+static const struct bsi_config_atom_impl bind_impl = {
+    .apply = config_bind_apply,
+    .reset = config_bind_reset,
+};
+
+static const struct bsi_config_atom_impl idle_impl = {
+    .apply = config_idle_apply,
+    .reset = config_idle_reset,
 };
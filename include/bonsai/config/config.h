@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,8 +26,41 @@ config_destroy(struct bsi_config* config);
 void
 config_find(struct bsi_config* config);
 
+/**
+ * @brief Adds a single config line, as it would appear in the config file.
+ *
+ * @param config The config.
+ * @param line The config line.
+ * @return Whether the line starts with a known keyword.
+ */
+bool
+config_add(struct bsi_config* config, const char* line);
+
 void
 config_parse(struct bsi_config* config);
 
+/**
+ * @brief Adds the lines of a config file, without applying them. Doesn't
+ * touch the server, so it can run off the main thread.
+ *
+ * @param config The config to add the lines to.
+ * @param path The config file.
+ * @return Whether the file could be read.
+ */
+bool
+config_read(struct bsi_config* config, const char* path);
+
 void
 config_apply(struct bsi_config* config);
+
+/**
+ * @brief Replaces the config with a newly read one. Lines in both are left
+ * alone, lines that are gone are reverted and new lines are applied, so only
+ * the devices, outputs and timers they are about change.
+ *
+ * @param config The running config.
+ * @param next The newly read config, its atoms are taken over or freed.
+ * @return size_t The number of lines applied or reverted.
+ */
+size_t
+config_reload(struct bsi_config* config, struct bsi_config* next);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <wayland-server-core.h>
+
+struct bsi_config;
+
+/* Editors write a file in a few steps, the reload waits for them to settle. */
+#define BSI_CONFIG_WATCH_SETTLE_MSEC 100
+
+struct bsi_config_watch_job;
+
+/**
+ * @brief Reloads the config file when it changes. The directory is watched
+ * rather than the file, so editors that save by renaming a new file over it
+ * don't lose the watch.
+ *
+ */
+struct bsi_config_watch
+{
+    struct bsi_config* config;
+
+    int fd; /* inotify */
+    struct wl_event_source* event_source;
+    struct wl_event_source* settle_timer;
+
+    char dir[255];
+    const char* name; /* The file name, points into the config path. */
+
+    /* A reload being read by the workers, NULL if there is none. */
+    struct bsi_config_watch_job* job;
+    bool again; /* The file changed while it was being read. */
+
+    size_t reloads;
+};
+
+/**
+ * @brief Starts watching the file the config was read from.
+ *
+ * @param config The config, it has to have been found.
+ * @return struct bsi_config_watch* The watch, NULL on failure.
+ */
+struct bsi_config_watch*
+config_watch_create(struct bsi_config* config);
+
+/**
+ * @brief Stops watching, a reload still being read is dropped.
+ *
+ * @param watch The watch.
+ */
+void
+config_watch_destroy(struct bsi_config_watch* watch);
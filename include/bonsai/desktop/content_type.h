@@ -0,0 +1,67 @@
+#pragma once
+
+#include <wayland-server-core.h>
+#include <wlr/util/addon.h>
+
+#include "content-type-v1-protocol.h"
+
+struct bsi_server;
+struct wlr_surface;
+
+/**
+ * @brief The wp_content_type_manager_v1 global. wlroots doesn't implement the
+ * protocol yet, so this does.
+ *
+ */
+struct bsi_content_type_manager
+{
+    struct bsi_server* server;
+    struct wl_global* global;
+
+    struct
+    {
+        /* wl_display */
+        struct wl_listener display_destroy;
+    } listen;
+};
+
+/**
+ * @brief The content type of a single surface, attached to the surface as an
+ * addon.
+ *
+ */
+struct bsi_content_type
+{
+    struct bsi_content_type_manager* manager;
+    struct wl_resource* resource;
+    struct wlr_surface* surface;
+    enum wp_content_type_v1_type pending, current;
+    struct wlr_addon addon; // wlr_surface::addons
+
+    struct
+    {
+        /* wlr_surface */
+        struct wl_listener commit;
+    } listen;
+};
+
+/**
+ * @brief Creates the content type manager global.
+ *
+ * @param server The server.
+ * @return struct bsi_content_type_manager* The manager.
+ */
+struct bsi_content_type_manager*
+content_type_manager_create(struct bsi_server* server);
+
+/**
+ * @brief Returns the committed content type of a surface, `none` for surfaces
+ * that never set one.
+ *
+ * @param manager The content type manager.
+ * @param surface The surface.
+ * @return enum wp_content_type_v1_type The content type.
+ */
+enum wp_content_type_v1_type
+content_type_get(struct bsi_content_type_manager* manager,
+                 struct wlr_surface* surface);
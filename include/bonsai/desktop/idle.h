@@ -1,7 +1,15 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 
+struct bsi_server;
+
+/* The legacy idle timers are reset at most this often by input, config
+ * `idle granularity <ms>`. */
+#define BSI_IDLE_GRANULARITY_MSEC 500
+
 enum bsi_idle_inhibit_mode
 {
     BSI_IDLE_INHIBIT_APPLICATION, // Application set inhbitor
@@ -38,3 +46,85 @@ idle_inhibitor_destroy(struct bsi_idle_inhibitor* inhibitor);
 
 bool
 idle_inhibitor_active(struct bsi_idle_inhibitor* inhibitor);
+
+/**
+ * @brief The ext_idle_notifier_v1 global. wlroots doesn't implement the
+ * protocol yet, so this does.
+ *
+ */
+struct bsi_idle_notifier
+{
+    struct bsi_server* server;
+    struct wl_global* global;
+    struct wl_list notifications; // bsi_idle_notification::link
+
+    struct
+    {
+        /* wl_display */
+        struct wl_listener display_destroy;
+    } listen;
+};
+
+/**
+ * @brief A client waiting for the seat to be idle for `timeout_msec`. Input
+ * doesn't touch the timer, it checks the last activity when it fires.
+ *
+ */
+struct bsi_idle_notification
+{
+    struct bsi_idle_notifier* notifier;
+    struct wl_resource* resource;
+    uint32_t timeout_msec;
+    bool idle;
+    struct wl_event_source* timer;
+
+    struct wl_list link; // bsi_idle_notifier::notifications
+};
+
+/**
+ * @brief Creates the idle notifier global.
+ *
+ * @param server The server.
+ * @return struct bsi_idle_notifier* The notifier.
+ */
+struct bsi_idle_notifier*
+idle_notifier_create(struct bsi_server* server);
+
+/**
+ * @brief Starts the timer that turns the outputs off after `idle power-off`
+ * seconds without input, if it is configured.
+ *
+ * @param server The server.
+ */
+void
+idle_power_init(struct bsi_server* server);
+
+/**
+ * @brief Starts, rearms or stops the output power timer after `idle power-off`
+ * changed.
+ *
+ * @param server The server.
+ */
+void
+idle_power_configure(struct bsi_server* server);
+
+/**
+ * @brief Records user activity. Cheap enough for every input event, the
+ * legacy idle timers are reset only once per granularity, notifications
+ * that went idle are resumed and outputs the idle timeout turned off come
+ * back on.
+ *
+ * @param server The server.
+ */
+void
+idle_activity_notify(struct bsi_server* server);
+
+/**
+ * @brief Stops or restarts the idle timers, when an inhibitor became active
+ * or the last one went away.
+ *
+ * @param server The server.
+ * @param inhibited Whether idle is inhibited.
+ */
+void
+idle_set_inhibited(struct bsi_server* server, bool inhibited);
@@ -21,6 +21,19 @@ enum bsi_layer_surface_type
     BSI_LAYER_SURFACE_SUBSURFACE,
 };
 
+enum bsi_layer_dirty
+{
+    BSI_LAYER_DIRTY_NONE = 0,
+    BSI_LAYER_DIRTY_SIZE = 1 << 0,
+    BSI_LAYER_DIRTY_ANCHOR = 1 << 1,
+    BSI_LAYER_DIRTY_MARGIN = 1 << 2,
+    BSI_LAYER_DIRTY_EXCLUSIVE = 1 << 3,
+    BSI_LAYER_DIRTY_LAYER = 1 << 4, /* Moved to another layer. */
+    BSI_LAYER_DIRTY_KEYBOARD = 1 << 5,
+    BSI_LAYER_DIRTY_MAP = 1 << 6,
+    BSI_LAYER_DIRTY_ALL = (1 << 7) - 1,
+};
+
 union bsi_layer_surface
 {
     struct bsi_layer_surface_toplevel* toplevel;
@@ -39,6 +52,10 @@ struct bsi_layer_surface_toplevel
     bool mapped;
     struct wlr_box box, extent;
 
+    /* The state this surface was last arranged with, and what changed since. */
+    struct wlr_layer_surface_v1_state arranged;
+    uint32_t dirty; /* Bitmask of `enum bsi_layer_dirty`. */
+
     /* Am member of this type of layer. This will be passed in
      * wlr_layer_surface::pending when a client is configuring. This is the type
      * of `wlr_layer_surface`. */
@@ -73,8 +90,6 @@ struct bsi_layer_surface_popup
         struct wl_listener unmap;
         struct wl_listener destroy;
         struct wl_listener new_popup;
-        /* wlr_surface -> popup::base::surface */
-        struct wl_listener commit;
     } listen;
 };
 
@@ -91,8 +106,6 @@ struct bsi_layer_surface_subsurface
         struct wl_listener map;
         struct wl_listener unmap;
         struct wl_listener destroy;
-        /* wlr_surface -> subsurface::surface */
-        struct wl_listener commit;
     } listen;
 
     struct wl_list link;
@@ -121,6 +134,27 @@ layer_surface_get_toplevel_parent(union bsi_layer_surface layer_surface,
 void
 layer_surface_focus(struct bsi_layer_surface_toplevel* toplevel);
 
+/**
+ * @brief Compares the current state of the layer surface with the state it was
+ * last arranged with.
+ *
+ * @param toplevel The layer surface.
+ * @return uint32_t Bitmask of `enum bsi_layer_dirty`.
+ */
+uint32_t
+layer_surface_state_diff(struct bsi_layer_surface_toplevel* toplevel);
+
+/**
+ * @brief Marks the layer surface dirty and propagates what needs to be redone
+ * to its output.
+ *
+ * @param toplevel The layer surface.
+ * @param dirty Bitmask of `enum bsi_layer_dirty`.
+ */
+void
+layer_surface_mark_dirty(struct bsi_layer_surface_toplevel* toplevel,
+                         uint32_t dirty);
+
 void
 layer_surface_destroy(union bsi_layer_surface layer_surface,
                       enum bsi_layer_surface_type type);
@@ -10,6 +10,7 @@ struct bsi_session_lock
     struct bsi_server* server;
     struct wlr_session_lock_v1* lock;
     struct wlr_scene_tree* tree;
+    struct wlr_scene_tree* blank; /* Covers the outputs, under the surfaces. */
     struct wl_list surfaces; // struct bsi_session_lock_surface
 
     struct
@@ -33,8 +34,6 @@ struct bsi_session_lock_surface
         /* wlr_session_lock_surface_v1 */
         struct wl_listener map;
         struct wl_listener destroy;
-        /* wlr_surface */
-        struct wl_listener surface_commit;
         /* wlr_output */
         struct wl_listener mode;
         struct wl_listener output_commit;
@@ -51,6 +50,27 @@ session_lock_init(struct bsi_session_lock* lock,
 void
 session_lock_destroy(struct bsi_session_lock* lock);
 
+/**
+ * @brief Covers every output with a solid rect, so nothing of the session
+ * shows before the lock client maps its surfaces, or after it died while
+ * locked. Redone when the outputs change.
+ *
+ * @param server The server.
+ */
+void
+session_lock_blank_update(struct bsi_server* server);
+
+/**
+ * @brief Hides the output trees with the views, the layer surfaces and the
+ * overlays, or shows them again. Hidden nodes aren't composed and their
+ * clients only get throttled frame callbacks.
+ *
+ * @param server The server.
+ * @param hidden Whether to hide them.
+ */
+void
+session_lock_scene_hide(struct bsi_server* server, bool hidden);
+
 struct bsi_session_lock_surface*
 session_lock_surface_init(struct bsi_session_lock_surface* surface,
                           struct bsi_session_lock* lock,
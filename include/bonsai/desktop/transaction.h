@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdbool.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+#include <wlr/types/wlr_scene.h>
+
+struct bsi_server;
+struct bsi_view;
+
+/* Longest a transaction waits for its clients, before applying anyway. */
+#define BSI_TRANSACTION_TIMEOUT_MS 200
+
+/**
+ * @brief A transaction groups the configures of several views, so their new
+ * geometry appears in a single frame. Until every client has acked and
+ * committed, the scene shows a snapshot of the old buffers of each view.
+ *
+ */
+struct bsi_transaction
+{
+    struct bsi_server* server;
+    struct wl_list views; // struct bsi_transaction_view
+    size_t waiting;       /* Views that haven't committed the new state. */
+    bool committed;       /* Configures went out, waiting on clients. */
+    struct wl_event_source* timeout;
+
+    struct wl_list link_server; // bsi_server::scene::transaction::running
+};
+
+struct bsi_transaction_view
+{
+    struct bsi_transaction* transaction;
+    struct bsi_view* view;
+    struct wlr_scene_tree* snapshot; /* Old buffers, shown while waiting. */
+    bool has_position;
+    int32_t x, y; /* Position applied with the transaction. */
+    uint32_t serial;
+    bool acked, ready;
+
+    struct
+    {
+        /* wlr_xdg_surface */
+        struct wl_listener ack_configure;
+        /* wlr_surface */
+        struct wl_listener commit;
+    } listen;
+
+    struct wl_list link; // bsi_transaction::views
+};
+
+/**
+ * @brief Opens a transaction on the server, or nests into the open one. Any
+ * view that gets pending state until the matching `transaction_end` becomes
+ * part of it.
+ *
+ * @param server The server.
+ */
+void
+transaction_begin(struct bsi_server* server);
+
+/**
+ * @brief Closes the outermost open transaction and commits it: snapshots the
+ * views, sends their configures and waits for the clients.
+ *
+ * @param server The server.
+ */
+void
+transaction_end(struct bsi_server* server);
+
+/**
+ * @brief Adds a view to the open transaction of the server, if there is one.
+ * A view that is still waiting in a committed transaction has it applied
+ * first.
+ *
+ * @param server The server.
+ * @param view The view.
+ * @return Whether the view is now part of an open transaction.
+ */
+bool
+transaction_view_add(struct bsi_server* server, struct bsi_view* view);
+
+/**
+ * @brief Applies the committed transaction the view is waiting in, if any.
+ * Call this before changing anything about the view that the snapshot would
+ * hide, like its enabled state.
+ *
+ * @param view The view.
+ */
+void
+transaction_view_flush(struct bsi_view* view);
+
+/**
+ * @brief Drops the view from its transaction, call this before the view goes
+ * away.
+ *
+ * @param view The view.
+ */
+void
+transaction_view_remove(struct bsi_view* view);
+
+/**
+ * @brief Applies the transaction to the scene and frees it, regardless of
+ * whether the clients are done.
+ *
+ * @param transaction The transaction.
+ */
+void
+transaction_apply(struct bsi_transaction* transaction);
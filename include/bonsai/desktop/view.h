@@ -10,10 +10,14 @@
 
 #include "bonsai/desktop/decoration.h"
 #include "bonsai/desktop/idle.h"
+#include "bonsai/desktop/transaction.h"
 #include "bonsai/desktop/view.h"
 #include "bonsai/desktop/workspace.h"
 #include "bonsai/input/cursor.h"
 
+/* Commits further apart than this don't count towards the cadence. */
+#define BSI_VIEW_COMMITS_GAP_USEC 500000
+
 enum bsi_view_state
 {
     BSI_VIEW_STATE_NORMAL = 1 << 0,
@@ -30,6 +34,19 @@ enum bsi_view_type
     BSI_VIEW_TYPE_XWAYLAND,
 };
 
+/* Toplevel state waiting to go out in a single configure. */
+enum bsi_view_pending
+{
+    BSI_VIEW_PENDING_NONE = 0,
+    BSI_VIEW_PENDING_SIZE = 1 << 0,
+    BSI_VIEW_PENDING_POSITION = 1 << 1,
+    BSI_VIEW_PENDING_ACTIVATED = 1 << 2,
+    BSI_VIEW_PENDING_MAXIMIZED = 1 << 3,
+    BSI_VIEW_PENDING_FULLSCREEN = 1 << 4,
+    BSI_VIEW_PENDING_TILED = 1 << 5,
+    BSI_VIEW_PENDING_RESIZING = 1 << 6,
+};
+
 union bsi_xdg_toplevel_event
 {
     struct wlr_xdg_toplevel_move_event* move;
@@ -57,6 +74,13 @@ struct bsi_view_impl
                         struct wlr_box* correction);
     void (*set_correct)(struct bsi_view* view, struct wlr_box* correction);
     void (*request_activate)(struct bsi_view* view);
+    void (*set_resizing)(struct bsi_view* view, bool resizing);
+    void (*request_size)(struct bsi_view* view,
+                         int32_t x,
+                         int32_t y,
+                         int32_t width,
+                         int32_t height);
+    void (*configure)(struct bsi_view* view);
 };
 
 struct bsi_view
@@ -69,12 +93,50 @@ struct bsi_view
     struct bsi_workspace* workspace;
 
     bool mapped;
+    bool frame_early; /* Got frame done ahead of composition, see
+                         `BSI_OUTPUT_POLICY_GAME`. */
     enum bsi_view_state state;
     enum wlr_xdg_toplevel_decoration_v1_mode decoration_mode;
     struct bsi_xdg_decoration* decoration;
 
     struct wlr_box geom;
 
+    /* Commit cadence of the surface, videos are composed in step with it. */
+    struct
+    {
+        uint64_t last_usec;
+        uint64_t interval_usec; /* Moving average, 0 until there are two. */
+    } commits;
+
+    /* Interactive resize. Only one size configure is in flight at a time, the
+     * latest requested size goes out when the client acks it. */
+    struct
+    {
+        uint32_t serial; /* Unacked size configure, 0 if none. */
+        bool pending;    /* Size below is waiting for an ack. */
+        int32_t x, y;    /* Where the node goes once the size is drawn. */
+        int32_t width, height;
+        int32_t sent_x, sent_y; /* Node position of the size in flight. */
+        /* The size is acked, the next commit draws it and moves the node. */
+        bool acked;
+        int32_t acked_x, acked_y;
+        size_t sent, superseded;
+    } resize;
+
+    /* State changes collected during one event loop iteration, sent out as a
+     * single configure from an idle callback. */
+    struct
+    {
+        uint32_t fields; /* enum bsi_view_pending */
+        int32_t x, y, width, height;
+        bool activated, maximized, fullscreen, resizing;
+        uint32_t tiled; /* enum wlr_edges */
+        struct wl_event_source* idle;
+        size_t requested, flushed;
+    } pending;
+
+    struct bsi_transaction_view* transaction; /* Waiting to be applied. */
+
     union
     {
         struct wlr_xdg_toplevel* wlr_xdg_toplevel;
@@ -88,11 +150,6 @@ struct bsi_view
         struct bsi_idle_inhibitor* fullscreen;
     } inhibit;
 
-    struct
-    {
-        struct wl_listener workspace_active;
-    } listen;
-
     struct wl_list link_server;     // bsi_server::scene::views
     struct wl_list link_fullscreen; // bsi_server::scene::views_fullscreen
     struct wl_list link_workspace;  // bsi_workspace::views
@@ -107,6 +164,9 @@ struct bsi_xdg_shell_view
         struct wl_listener map;
         struct wl_listener unmap;
         struct wl_listener destroy;
+        struct wl_listener ack_configure;
+        /* wlr_surface */
+        struct wl_listener commit;
         /* wlr_xdg_toplevel */
         struct wl_listener request_maximize;
         struct wl_listener request_fullscreen;
@@ -186,3 +246,89 @@ view_set_correct(struct bsi_view* view, struct wlr_box* correction);
 
 void
 view_request_activate(struct bsi_view* view);
+
+/**
+ * @brief Lays the view out again on the output of its workspace, e.g. after
+ * it was moved there from another output. Maximized, fullscreen and tiled
+ * views take up the new output the way they did the old one, other views are
+ * kept inside its usable area.
+ *
+ * @param view The view.
+ */
+void
+view_relayout(struct bsi_view* view);
+
+/**
+ * @brief Sets the resizing state of the view for the duration of an
+ * interactive resize grab. Ending the resize sends out a size that is still
+ * waiting for an ack.
+ *
+ * @param view The view.
+ * @param resizing Whether an interactive resize is in progress.
+ */
+void
+view_set_resizing(struct bsi_view* view, bool resizing);
+
+/**
+ * @brief Requests a new size for the view during an interactive resize. The
+ * size is sent right away only if the client acked the previous one, else it
+ * replaces any size already waiting. The node moves to the new position only
+ * with the commit that draws the new size, so the opposite edges stay put.
+ *
+ * @param view The view.
+ * @param x The new node x, in layout coordinates.
+ * @param y The new node y, in layout coordinates.
+ * @param width The new width.
+ * @param height The new height.
+ */
+void
+view_request_size(struct bsi_view* view,
+                  int32_t x,
+                  int32_t y,
+                  int32_t width,
+                  int32_t height);
+
+/**
+ * @brief Collects a new size for the view. All pending state is sent as one
+ * configure once the event loop goes idle.
+ *
+ * @param view The view.
+ * @param width The new width.
+ * @param height The new height.
+ */
+void
+view_pending_size(struct bsi_view* view, int32_t width, int32_t height);
+
+/**
+ * @brief Collects a new layout position for the view, applied together with
+ * the rest of the pending state.
+ *
+ * @param view The view.
+ * @param x The new x coordinate.
+ * @param y The new y coordinate.
+ */
+void
+view_pending_position(struct bsi_view* view, int32_t x, int32_t y);
+
+void
+view_pending_activated(struct bsi_view* view, bool activated);
+
+void
+view_pending_maximized(struct bsi_view* view, bool maximized);
+
+void
+view_pending_fullscreen(struct bsi_view* view, bool fullscreen);
+
+void
+view_pending_tiled(struct bsi_view* view, uint32_t edges);
+
+void
+view_pending_resizing(struct bsi_view* view, bool resizing);
+
+/**
+ * @brief Sends out the pending state of the view right away.
+ *
+ * @param view The view.
+ */
+void
+view_pending_flush(struct bsi_view* view);
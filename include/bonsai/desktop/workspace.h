@@ -2,6 +2,7 @@
 
 #include <wayland-server-core.h>
 #include <wayland-util.h>
+#include <wlr/types/wlr_scene.h>
 
 struct bsi_server;
 struct bsi_output;
@@ -25,6 +26,10 @@ struct bsi_workspace
 
     struct wl_list views; /* All views that belong to this workspace. */
 
+    /* Parent of the trees of all views of this workspace. Only the tree of the
+     * active workspace is enabled, so switching is a single node toggle. */
+    struct wlr_scene_tree* tree;
+
     /* The workspace owns the listeners of the server and output, so it can also
      * take care of them when destroying itself. */
     struct bsi_workspace_listener* foreign_listeners; /* len = 2 */
@@ -11,11 +11,15 @@ bsi_notify_func_t(struct wl_listener*, void*);
 /* wlr_backend */
 extern bsi_notify_func_t handle_new_output;
 extern bsi_notify_func_t handle_new_input;
+/* wlr_compositor */
+extern bsi_notify_func_t handle_compositor_new_surface;
 /* wlr_output_layout */
 extern bsi_notify_func_t handle_output_layout_change;
 /* wlr_output_manager_v1 */
 extern bsi_notify_func_t handle_output_manager_apply;
 extern bsi_notify_func_t handle_output_manager_test;
+/* wlr_output_power_manager_v1 */
+extern bsi_notify_func_t handle_output_power_manager_set_mode;
 /* wlr_seat */
 extern bsi_notify_func_t handle_pointer_grab_begin;
 extern bsi_notify_func_t handle_pointer_grab_end;
@@ -34,7 +38,6 @@ extern bsi_notify_func_t handle_xdg_decoration_manager_new_decoration;
 extern bsi_notify_func_t handle_xdg_request_activate;
 /* wlr_idle_inhibit_manager_v1 */
 extern bsi_notify_func_t handle_idle_manager_new_inhibitor;
-extern bsi_notify_func_t handle_idle_activity_notify;
 /* wlr_session_lock_manager_v1 */
 extern bsi_notify_func_t handle_session_lock_manager_new_lock;
 
@@ -43,4 +46,3 @@ extern bsi_notify_func_t handle_session_lock_manager_new_lock;
  */
 extern bsi_notify_func_t handle_server_workspace_active;
 extern bsi_notify_func_t handle_output_workspace_active;
-extern bsi_notify_func_t handle_view_workspace_active;
@@ -7,6 +7,10 @@
 #include <wayland-util.h>
 #include <xkbcommon/xkbcommon.h>
 
+struct bsi_input_keyboard_group;
+struct bsi_input_keymap_job;
+struct bsi_server;
+
 enum bsi_input_device_type
 {
     BSI_INPUT_DEVICE_POINTER,
@@ -21,6 +25,13 @@ struct bsi_input_device
 
     enum bsi_input_device_type type;
 
+    /* Keyboards only, the group they are in or wait to join. */
+    struct bsi_input_keyboard_group* group;
+    /* Keyboards only, it is listened to on its own. Either it couldn't join
+     * its group, or it types with a fallback keymap until the group's keymap
+     * is compiled. */
+    bool alone;
+
     struct
     {
         /* wlr_cursor */
@@ -37,7 +48,7 @@ struct bsi_input_device
         struct wl_listener pinch_end;
         struct wl_listener hold_begin;
         struct wl_listener hold_end;
-        /* wlr_input_device::keyboard */
+        /* wlr_keyboard, only if it's alone */
         struct wl_listener key;
         struct wl_listener modifiers;
         /* wlr_input_device::destroy */
@@ -45,6 +56,51 @@ struct bsi_input_device
     } listen;
 
     struct wl_list link_server; // bsi_server
+    struct wl_list link_group;  // bsi_input_keyboard_group::waiting
+};
+
+/**
+ * @brief A compiled keymap, shared by every keyboard with the same xkb rule
+ * names. Kept until the server goes away, replugging a keyboard costs nothing.
+ *
+ */
+struct bsi_input_keymap
+{
+    struct bsi_server* server;
+    char* names[5]; /* rules, model, layout, variant, options */
+    /* NULL while compiling, or if that failed. */
+    struct xkb_keymap* xkb_keymap;
+    /* Keymaps are compiled by the workers, NULL unless one is on the way. */
+    struct bsi_input_keymap_job* job;
+
+    struct wl_list link; // bsi_server::input.keymaps
+};
+
+/**
+ * @brief Keyboards with the same keymap and repeat info. Modifiers and repeat
+ * are handled once for all of them, and the seat and its clients only ever see
+ * the group keyboard.
+ *
+ */
+struct bsi_input_keyboard_group
+{
+    struct bsi_server* server;
+    struct wlr_keyboard_group* wlr_group;
+    struct bsi_input_keymap* keymap;
+    int32_t repeat_rate, repeat_delay; /* 0 if not configured. */
+
+    /* Keyboards join once the keymap is compiled, they type alone until
+     * then. */
+    struct wl_list waiting; // bsi_input_device::link_group
+
+    struct
+    {
+        /* wlr_keyboard_group::keyboard */
+        struct wl_listener key;
+        struct wl_listener modifiers;
+    } listen;
+
+    struct wl_list link; // bsi_server::input.keyboard_groups
 };
 
 struct bsi_input_device*
@@ -56,6 +112,46 @@ input_device_init(struct bsi_input_device* input_device,
 void
 input_device_destroy(struct bsi_input_device* input_device);
 
+/**
+ * @brief Applies the input config to a device. Anything already as configured
+ * is left alone, a keyboard only changes group if its keymap or repeat info
+ * changed.
+ *
+ * @param device The device.
+ */
+void
+input_device_configure(struct bsi_input_device* device);
+
+/**
+ * @brief Adds a keyboard to the group of keyboards with the same config,
+ * creating it if there is none. The keymap is compiled only if it isn't in
+ * the cache yet. While it compiles the keyboard types on its own with a cached
+ * keymap, the first keymap is compiled right away.
+ *
+ * @param input_device The keyboard.
+ * @param xkb_rule_names The keymap rule names.
+ * @param repeat_rate The repeat rate, 0 for the default.
+ * @param repeat_delay The repeat delay, 0 for the default.
+ */
+void
+input_keyboard_group_join(struct bsi_input_device* input_device,
+                          const struct xkb_rule_names* xkb_rule_names,
+                          int32_t repeat_rate,
+                          int32_t repeat_delay);
+
+/**
+ * @brief Removes a keyboard from its group, the group goes away with its last
+ * keyboard.
+ *
+ * @param input_device The keyboard.
+ */
+void
+input_keyboard_group_leave(struct bsi_input_device* input_device);
+
+/**
+ * @brief Frees the keymap cache and any keyboard groups left.
+ *
+ * @param server The server.
+ */
 void
-input_device_keymap_set(struct bsi_input_device* input_device,
-                        const struct xkb_rule_names* xkb_rule_names);
+input_keymaps_destroy(struct bsi_server* server);
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <pixman.h>
 #include <wlr/types/wlr_pointer.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/box.h>
 
 struct bsi_server;
+struct bsi_output;
 
 enum bsi_cursor_mode
 {
@@ -44,6 +46,26 @@ union bsi_cursor_event
     struct wlr_pointer_hold_end_event* hold_end;
 };
 
+struct bsi_cursor_hit_entry
+{
+    struct wlr_scene_node* node; /* A node with data, not a mere grouping. */
+    struct wlr_box box;          /* Layout box of all buffers in the subtree. */
+};
+
+/**
+ * @brief Hit-test index of an output. Holds the enabled views, layer surfaces
+ * and lock surfaces that intersect the output, found through the output and
+ * workspace trees, topmost first, so a lookup doesn't have to walk the whole
+ * scene graph.
+ *
+ */
+struct bsi_cursor_hit_index
+{
+    uint32_t serial; /* bsi_server::scene::serial this was built at. */
+    struct bsi_cursor_hit_entry* entries;
+    size_t len, cap;
+};
+
 void
 cursor_image_set(struct bsi_server* server, enum bsi_cursor_image cursor_image);
 
@@ -73,6 +95,43 @@ cursor_scene_data_at(struct bsi_server* server,
                      double* sx,
                      double* sy);
 
+/**
+ * @brief Invalidates the hit-test indices of all outputs and the last cursor
+ * hit. Call this whenever the geometry, stacking or enabled state of anything
+ * in the scene changes.
+ *
+ * @param server The server.
+ */
+void
+cursor_scene_invalidate(struct bsi_server* server);
+
+void
+cursor_hit_index_destroy(struct bsi_cursor_hit_index* index);
+
+/**
+ * @brief Defers the compositor side handling of a motion event to the next
+ * frame of the output under the cursor. The client with pointer focus still
+ * receives the motion right away.
+ *
+ * @param server The server.
+ * @param time_msec Timestamp of the motion event.
+ * @param dx Cursor delta on the x axis.
+ * @param dy Cursor delta on the y axis.
+ */
+void
+cursor_motion_defer(struct bsi_server* server,
+                    uint32_t time_msec,
+                    double dx,
+                    double dy);
+
+/**
+ * @brief Processes deferred motion, if any, as a single motion event.
+ *
+ * @param server The server.
+ */
+void
+cursor_motion_flush(struct bsi_server* server);
+
 void
 cursor_process_motion(struct bsi_server* server,
                       union bsi_cursor_event cursor_event);
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <xkbcommon/xkbcommon.h>
+
+struct bsi_server;
+
+/* Only these modifiers tell bindings apart, locks don't. */
+#define BSI_KEYBINDS_MODS                                                      \
+    (WLR_MODIFIER_SHIFT | WLR_MODIFIER_CTRL | WLR_MODIFIER_ALT |               \
+     WLR_MODIFIER_LOGO)
+/* Slots the table starts with, it doubles when half full. */
+#define BSI_KEYBINDS_SLOTS_MIN 64
+
+enum bsi_keybind_action
+{
+    BSI_KEYBIND_NONE, /* Bound to nothing, the client gets the key. */
+    BSI_KEYBIND_EXEC,
+    BSI_KEYBIND_EXEC_OUTPUT, /* The command gets the focused output name. */
+    BSI_KEYBIND_FULLSCREEN,
+    BSI_KEYBIND_MAXIMIZE,
+    BSI_KEYBIND_TILE,
+    BSI_KEYBIND_VIEWS_SHOW,
+    BSI_KEYBIND_VIEWS_CYCLE,
+    BSI_KEYBIND_WORKSPACE,
+    BSI_KEYBIND_DAMAGE,
+    BSI_KEYBIND_HUD,
+    BSI_KEYBIND_EXIT,
+};
+
+/**
+ * @brief A key combination and what it does, compiled when the binding is
+ * loaded. An empty table slot has no keysym.
+ *
+ */
+struct bsi_keybind
+{
+    uint32_t mods;    /* WLR_MODIFIER_* within BSI_KEYBINDS_MODS. */
+    xkb_keysym_t sym; /* Lower case, XKB_KEY_NoSymbol if the slot is free. */
+
+    enum bsi_keybind_action action;
+    int value;   /* On or off, a direction. */
+    char** argp; /* Owned exec argp, NULL terminated. */
+    size_t len_argp;
+    bool resolved;      /* `argp[0]` is the full executable path. */
+    const char* format; /* Of the output command, formatted into `argp[2]`. */
+};
+
+/**
+ * @brief Open addressing table of the bindings, so a key press is a single
+ * lookup.
+ *
+ */
+struct bsi_keybinds
+{
+    struct bsi_keybind* slots;
+    size_t len_slots; /* A power of two. */
+    size_t len;
+};
+
+/**
+ * @brief Loads the default bindings, the config ones replace them.
+ *
+ * @param keybinds The keybinds.
+ * @return struct bsi_keybinds* The keybinds.
+ */
+struct bsi_keybinds*
+keybinds_init(struct bsi_keybinds* keybinds);
+
+/**
+ * @brief Frees every binding.
+ *
+ * @param keybinds The keybinds.
+ */
+void
+keybinds_destroy(struct bsi_keybinds* keybinds);
+
+/**
+ * @brief Compiles a binding config line and adds it, or replaces the binding
+ * of the same combination.
+ *
+ * @param keybinds The keybinds.
+ * @param line The line, `bind <mods+key> <action> [args]`.
+ * @return true The line is valid.
+ * @return false It isn't, nothing changed.
+ */
+bool
+keybinds_add(struct bsi_keybinds* keybinds, const char* line);
+
+/**
+ * @brief Undoes a binding config line, the combination goes back to its
+ * default binding or to none.
+ *
+ * @param keybinds The keybinds.
+ * @param line The line, `bind <mods+key> <action> [args]`.
+ */
+void
+keybinds_remove(struct bsi_keybinds* keybinds, const char* line);
+
+/**
+ * @brief Runs the binding of a key press, if there is one.
+ *
+ * @param server The server.
+ * @param mods The held modifiers.
+ * @param syms The keysyms of the pressed key.
+ * @param len_syms The keysym count.
+ * @return true A binding handled the key.
+ * @return false The client should get the key.
+ */
+bool
+keybinds_dispatch(struct bsi_server* server,
+                  uint32_t mods,
+                  const xkb_keysym_t* syms,
+                  size_t len_syms);
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+
+#include "bonsai/stats.h"
+
+/* Largest exec request, the arguments and the environment together. */
+#define BSI_LAUNCHER_MSG_MAX 65536
+
+/**
+ * @brief Embedded by whoever wants to know what becomes of a launched
+ * program.
+ *
+ */
+struct bsi_launcher_watch
+{
+    /* The program runs as `pid`. */
+    void (*started)(struct bsi_launcher_watch* watch, pid_t pid);
+    /* It exited with a waitpid(2) status, or -1 if it didn't start or the
+     * status got lost. */
+    void (*exited)(struct bsi_launcher_watch* watch, int status);
+};
+
+/**
+ * @brief An exec request that the helper has not answered yet. Requests are
+ * answered in the order they were sent.
+ *
+ */
+struct bsi_launcher_request
+{
+    char name[64];
+    uint64_t sent_usec;
+    struct bsi_launcher_watch* watch; /* Can be NULL. */
+
+    struct wl_list link; // bsi_launcher::requests
+};
+
+/**
+ * @brief A program started by the helper. The compositor holds its pidfd to
+ * see it exit, the helper reaps it and sends the status.
+ *
+ */
+struct bsi_launcher_child
+{
+    struct bsi_launcher* launcher;
+    char name[64];
+    pid_t pid;
+    int pidfd; /* -1 if the kernel has no pidfds. */
+    struct wl_event_source* event_source;
+    struct bsi_launcher_watch* watch; /* Can be NULL. */
+    bool exited; /* The pidfd became readable. */
+    bool reaped; /* The helper sent `status`. */
+    int status;
+
+    struct wl_list link; // bsi_launcher::children
+};
+
+/**
+ * @brief A small helper process forked at startup, before the compositor maps
+ * any GPU or shm memory. Programs are started by it, so the compositor never
+ * forks itself with all of its mappings.
+ *
+ */
+struct bsi_launcher
+{
+    pid_t pid;
+    int fd; /* Our end of the socketpair, -1 once the helper is gone. */
+    struct wl_event_loop* loop;
+    struct wl_event_source* event_source;
+
+    struct wl_list requests; // bsi_launcher_request::link
+    struct wl_list children; // bsi_launcher_child::link
+
+    uint64_t launched;
+    uint64_t failed;
+    struct bsi_histogram latency; /* Request to exec, in microseconds. */
+};
+
+/**
+ * @brief Forks the launcher helper. Call it as early as possible, while the
+ * compositor is still small.
+ *
+ * @return struct bsi_launcher* The launcher, NULL if the helper didn't start.
+ */
+struct bsi_launcher*
+launcher_create(void);
+
+/**
+ * @brief Starts listening for the helper replies and for started programs to
+ * exit. Nothing is launched before this.
+ *
+ * @param launcher The launcher.
+ * @param loop The event loop.
+ */
+void
+launcher_attach(struct bsi_launcher* launcher, struct wl_event_loop* loop);
+
+/**
+ * @brief Stops the helper. Programs it started keep running.
+ *
+ * @param launcher The launcher.
+ */
+void
+launcher_destroy(struct bsi_launcher* launcher);
+
+/**
+ * @brief Has the helper start a program with the environment of the
+ * compositor. Falls back to `util_forkexec(...)` when there is no helper.
+ *
+ * @param launcher The launcher, can be NULL.
+ * @param argp The execve call argp.
+ * @param len_argp The argp len.
+ * @param watch Told when the program starts and exits, can be NULL. It is
+ * never told anything about a fallback fork.
+ * @return true The request was sent, or the fallback fork succeeded.
+ * @return false Nothing was started.
+ */
+bool
+launcher_exec(struct bsi_launcher* launcher,
+              char* const* argp,
+              const size_t len_argp,
+              struct bsi_launcher_watch* watch);
+
+/**
+ * @brief Forgets a watch, before whoever embeds it goes away.
+ *
+ * @param launcher The launcher, can be NULL.
+ * @param watch The watch.
+ */
+void
+launcher_unwatch(struct bsi_launcher* launcher,
+                 struct bsi_launcher_watch* watch);
+
+/**
+ * @brief Logs how many programs were launched and how long it took.
+ *
+ * @param launcher The launcher.
+ */
+void
+launcher_stats_dump(struct bsi_launcher* launcher);
@@ -10,6 +10,45 @@ struct bsi_server;
 
 #include "bonsai/desktop/layers.h"
 #include "bonsai/desktop/workspace.h"
+#include "bonsai/input/cursor.h"
+#include "bonsai/overlay.h"
+#include "bonsai/stats.h"
+
+enum bsi_output_dirty
+{
+    BSI_OUTPUT_DIRTY_NONE = 0,
+    BSI_OUTPUT_DIRTY_MODE = 1 << 0,      /* Output mode or layout changed. */
+    BSI_OUTPUT_DIRTY_EXCLUSIVE = 1 << 1, /* The usable area might change. */
+    BSI_OUTPUT_DIRTY_LAYERS = 1 << 2,    /* Some layer surfaces changed. */
+    BSI_OUTPUT_DIRTY_STACKING = 1 << 3,  /* Scene node order changed. */
+};
+
+/* Composition cost samples the adaptive schedule looks back on. */
+#define BSI_OUTPUT_SCHEDULE_HISTORY 32
+/* Slack left between the predicted end of composition and the vblank. */
+#define BSI_OUTPUT_SCHEDULE_MARGIN_USEC 2000
+/* How long composition waits past the predicted commit of a video frame. */
+#define BSI_OUTPUT_SCHEDULE_CONTENT_SLACK_USEC 1000
+
+enum bsi_output_schedule
+{
+    BSI_OUTPUT_SCHEDULE_OFF,      /* Compose when the frame event fires. */
+    BSI_OUTPUT_SCHEDULE_FIXED,    /* Compose a fixed time after it. */
+    BSI_OUTPUT_SCHEDULE_ADAPTIVE, /* Compose as late as recent frames allow. */
+    BSI_OUTPUT_SCHEDULE_CONTENT,  /* Compose once the next content frame is
+                                     due. */
+};
+
+/* Picked every frame from the content type of the views on the output. */
+enum bsi_output_policy
+{
+    BSI_OUTPUT_POLICY_DEFAULT, /* Configured schedule, background stills are
+                                  throttled. */
+    BSI_OUTPUT_POLICY_VIDEO,   /* A video can be seen, compose on the
+                                  cadence of its frames. */
+    BSI_OUTPUT_POLICY_GAME,    /* A game is in front, compose as late as
+                                  possible and let it start right away. */
+};
 
 struct bsi_output
 {
@@ -22,10 +61,9 @@ struct bsi_output
     bool added, destroying; /* If this output has just been added, or is being
                                destroyed. */
 
-    struct wlr_output_damage* damage;
-
     struct bsi_workspace* active_workspace;
     struct wl_list workspaces; /* All workspaces that belong to this output. */
+    struct wlr_scene_tree* tree; /* Parent of the workspace trees. */
 
     /* Basically an ad-hoc map of linked lists indexable by `enum
      * zwlr_layer_shell_v1_layer`
@@ -35,13 +73,57 @@ struct bsi_output
      * ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY = 3, */
     struct wl_list layers[4]; /* All layers that belong to this output. */
 
+    /* Layer arrangement is incremental, only the surfaces that have actually
+     * changed since the last arrangement get reconfigured. */
+    struct
+    {
+        uint32_t dirty;   /* Bitmask of `enum bsi_output_dirty`. */
+        uint32_t layers;  /* Bitmask of layers with dirty members. */
+        size_t performed; /* Arrangements that did some work. */
+        size_t skipped;   /* Arrangements that were a no-op. */
+    } arrange;
+
+    struct bsi_cursor_hit_index hit; /* Built lazily on cursor lookups. */
+
+    /* Frame callbacks of views that can't be seen. */
+    struct
+    {
+        size_t skipped; /* View frames not sent at the output rate. */
+        size_t sent;    /* View frames sent at the throttled rate. */
+    } throttle;
+
+    /* An output that is off composes nothing and its surfaces get no frame
+     * callbacks. */
+    struct
+    {
+        bool idle_off; /* Turned off by the idle timeout, input wakes it. */
+        size_t offs;
+    } power;
+
+    struct bsi_output_stats* stats; /* NULL unless `frame stats yes`. */
+    struct bsi_overlay_damage* overlay_damage; /* NULL unless damage is
+                                                  shown. */
+    struct bsi_overlay_hud* overlay_hud; /* NULL unless the HUD is on. */
+
+    /* Composition is delayed towards the next vblank, so clients and the
+     * cursor are sampled as late as possible. */
+    struct
+    {
+        struct wl_event_source* timer;
+        bool pending;        /* A frame is waiting on the timer. */
+        enum bsi_output_policy policy;
+        uint64_t frame_usec; /* When the frame event came in. */
+        uint64_t content_usec; /* When the video is due to commit next, 0 if
+                                  its cadence isn't known. */
+        uint64_t cost[BSI_OUTPUT_SCHEDULE_HISTORY]; /* Composition times. */
+        size_t len_cost, next_cost;
+    } schedule;
+
     struct
     {
         /* wlr_output */
         struct wl_listener frame;
         struct wl_listener destroy;
-        /* wlr_output_damage */
-        struct wl_listener damage_frame;
         /* bsi_workspace */
         struct wl_list workspace; // bsi_workspace_listener::link
     } listen;
@@ -57,19 +139,58 @@ output_init(struct bsi_output* output,
 void
 output_set_usable_box(struct bsi_output* output, struct wlr_box* box);
 
-void
-output_surface_damage(struct bsi_output* output,
-                      struct wlr_surface* wlr_surface,
-                      bool entire_output);
-
 struct bsi_workspace*
 output_get_next_workspace(struct bsi_output* output);
 
 struct bsi_workspace*
 output_get_prev_workspace(struct bsi_output* output);
 
+/**
+ * @brief Marks the output arrangement state as dirty. The next call to
+ * `output_layers_arrange()` will redo the work the dirty bits ask for.
+ *
+ * @param output The output.
+ * @param dirty Bitmask of `enum bsi_output_dirty`.
+ */
+void
+output_arrange_mark(struct bsi_output* output, uint32_t dirty);
+
+/**
+ * @brief Arranges the layer surfaces of the output, but only does the work that
+ * is needed by the dirty state of the output and its layer surfaces. If nothing
+ * is dirty, this is a no-op.
+ *
+ * @param output The output.
+ */
 void
 output_layers_arrange(struct bsi_output* output);
 
+/**
+ * @brief Sends frame done to the surfaces on the output. Views on inactive
+ * workspaces, minimized views and views covered by a fullscreen view are
+ * throttled, they only get frame done when `throttled` is set.
+ *
+ * @param output The output.
+ * @param now The frame time.
+ * @param throttled Send to the throttled views, instead of the visible ones.
+ */
+void
+output_send_frame_done(struct bsi_output* output,
+                       struct timespec* now,
+                       bool throttled);
+
+/**
+ * @brief Turns the output on or off. Composition and the frame callbacks of
+ * its surfaces stop while it's off, and it is fully redrawn when it comes back
+ * on.
+ *
+ * @param output The output.
+ * @param on Whether to turn it on.
+ * @return true The output is in the requested state.
+ * @return false The commit failed.
+ */
+bool
+output_power_set(struct bsi_output* output, bool on);
+
 void
 output_destroy(struct bsi_output* output);
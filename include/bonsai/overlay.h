@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cairo/cairo.h>
+#include <pixman.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/types/wlr_scene.h>
+
+struct bsi_output;
+struct bsi_server;
+
+/* Damage rectangles on screen per output, the oldest get recycled. */
+#define BSI_OVERLAY_DAMAGE_RECTS 128
+/* A frame damaged in more rectangles than this shows their extents. */
+#define BSI_OVERLAY_DAMAGE_FRAME_RECTS 16
+/* How long a damage rectangle takes to fade out. */
+#define BSI_OVERLAY_DAMAGE_FADE_USEC 500000
+/* The HUD numbers are rates over this period. */
+#define BSI_OVERLAY_HUD_PERIOD_MSEC 1000
+#define BSI_OVERLAY_HUD_TEXT_MAX 256
+
+/**
+ * @brief A read only buffer with some text drawn by cairo, for scene buffers
+ * the compositor puts on screen itself.
+ *
+ */
+struct bsi_overlay_text
+{
+    struct wlr_buffer base;
+    cairo_surface_t* surface;
+};
+
+/**
+ * @brief Text drawn by a worker for an overlay. The overlay owns the job only
+ * while it is pending, and disowns it when it goes away first.
+ *
+ */
+struct bsi_overlay_text_job
+{
+    void* owner; /* NULL once the overlay is gone. */
+    void (*apply)(void* owner, struct wlr_buffer* buffer);
+    char text[BSI_OVERLAY_HUD_TEXT_MAX];
+    struct wlr_buffer* buffer; /* Set by the worker. */
+};
+
+struct bsi_overlay_damage_rect
+{
+    struct wlr_scene_rect* rect; /* NULL if the slot is free. */
+    uint64_t born_usec;
+};
+
+/**
+ * @brief Shows the damage of every frame of an output as translucent
+ * rectangles that fade out, and the damaged pixel count of the last frame.
+ * Only allocated while the damage overlay is on.
+ *
+ */
+struct bsi_overlay_damage
+{
+    struct bsi_output* output;
+    struct wlr_scene_tree* tree;
+    struct wlr_scene_tree* shown; /* Parent of the damage rectangles. */
+    struct wlr_scene_buffer* counter;
+    struct bsi_overlay_text_job* counter_job; /* The counter being drawn. */
+    struct bsi_overlay_damage_rect rects[BSI_OVERLAY_DAMAGE_RECTS];
+    size_t next_rect;
+
+    pixman_region32_t frame; /* Damage of the frame being composed. */
+    pixman_region32_t own;   /* Damage the overlay did to itself. Both are in
+                                output buffer coordinates. */
+    uint64_t pixels;         /* Damaged pixels of the last frame. */
+    bool counter_stale;      /* The counter doesn't show `pixels` yet. */
+};
+
+/**
+ * @brief Frame rate and composition time of an output, with the server wide
+ * numbers next to them. Only allocated while the HUD is on.
+ *
+ */
+struct bsi_overlay_hud
+{
+    struct bsi_output* output;
+    struct wlr_scene_buffer* buffer; /* Redrawn only when the text changes. */
+    char text[BSI_OVERLAY_HUD_TEXT_MAX];
+    struct bsi_overlay_text_job* text_job; /* The text being drawn. */
+
+    uint64_t frames;       /* Committed frames in this period. */
+    uint64_t compose_usec; /* Their summed composition time. */
+};
+
+/**
+ * @brief Creates a buffer with the text drawn on it, lines are split on '\n'.
+ *
+ * @param text The text.
+ * @return struct wlr_buffer* The buffer, drop it when done.
+ */
+struct wlr_buffer*
+overlay_text_create(const char* text);
+
+/**
+ * @brief Creates the damage overlay of an output.
+ *
+ * @param output The output.
+ * @return struct bsi_overlay_damage* The overlay.
+ */
+struct bsi_overlay_damage*
+overlay_damage_create(struct bsi_output* output);
+
+/**
+ * @brief Destroys the damage overlay of an output, and its scene nodes.
+ *
+ * @param overlay The overlay.
+ */
+void
+overlay_damage_destroy(struct bsi_overlay_damage* overlay);
+
+/**
+ * @brief Takes the damage the scene output is about to compose, leaving out
+ * what the overlay itself damaged. Call right before the scene commit.
+ *
+ * @param overlay The overlay.
+ * @param scene_output The scene output of the overlay output.
+ */
+void
+overlay_damage_begin(struct bsi_overlay_damage* overlay,
+                     struct wlr_scene_output* scene_output);
+
+/**
+ * @brief Puts the damage of the composed frame on screen, and fades out the
+ * older damage. Call right after the scene commit.
+ *
+ * @param overlay The overlay.
+ * @param scene_output The scene output of the overlay output.
+ * @param now_usec The monotonic time, in microseconds.
+ */
+void
+overlay_damage_end(struct bsi_overlay_damage* overlay,
+                   struct wlr_scene_output* scene_output,
+                   uint64_t now_usec);
+
+/**
+ * @brief Turns the damage overlay of every output on or off.
+ *
+ * @param server The server.
+ * @param enabled Show damage.
+ */
+void
+overlays_damage_set(struct bsi_server* server, bool enabled);
+
+/**
+ * @brief Creates the HUD of an output, it shows up on the next HUD period.
+ *
+ * @param output The output.
+ * @return struct bsi_overlay_hud* The HUD.
+ */
+struct bsi_overlay_hud*
+overlay_hud_create(struct bsi_output* output);
+
+/**
+ * @brief Destroys the HUD of an output, and its scene buffer.
+ *
+ * @param hud The HUD.
+ */
+void
+overlay_hud_destroy(struct bsi_overlay_hud* hud);
+
+/**
+ * @brief Accounts a composed frame of the HUD output.
+ *
+ * @param hud The HUD.
+ * @param committed Whether the frame committed a buffer.
+ * @param compose_usec How long the composition took.
+ */
+void
+overlay_hud_frame(struct bsi_overlay_hud* hud,
+                  bool committed,
+                  uint64_t compose_usec);
+
+/**
+ * @brief Turns the HUD of every output on or off.
+ *
+ * @param server The server.
+ * @param enabled Show the HUD.
+ */
+void
+overlays_hud_set(struct bsi_server* server, bool enabled);
@@ -7,14 +7,20 @@
 #include <wlr/types/wlr_xdg_decoration_v1.h>
 
 #include "bonsai/config/config.h"
+#include "bonsai/desktop/content_type.h"
 #include "bonsai/desktop/decoration.h"
 #include "bonsai/desktop/layers.h"
 #include "bonsai/desktop/lock.h"
+#include "bonsai/desktop/transaction.h"
 #include "bonsai/desktop/view.h"
 #include "bonsai/desktop/workspace.h"
 #include "bonsai/input.h"
 #include "bonsai/input/cursor.h"
+#include "bonsai/input/keybinds.h"
+#include "bonsai/launcher.h"
 #include "bonsai/output.h"
+#include "bonsai/supervisor.h"
+#include "bonsai/worker.h"
 
 struct bsi_server
 {
@@ -23,8 +29,14 @@ struct bsi_server
     struct wlr_backend* wlr_backend;
     struct wlr_renderer* wlr_renderer;
     struct wlr_allocator* wlr_allocator;
+    struct wlr_compositor* wlr_compositor;
     struct wlr_output_layout* wlr_output_layout;
     struct wlr_scene* wlr_scene;
+    struct wlr_presentation* wlr_presentation;
+    struct bsi_content_type_manager* content_type_manager;
+    struct bsi_workers* workers; /* NULL if the threads didn't start. */
+    struct bsi_launcher* launcher; /* NULL if the helper didn't start. */
+    struct bsi_supervisor* supervisor;
     struct wlr_xdg_shell* wlr_xdg_shell;
     struct wlr_seat* wlr_seat;
     struct wlr_cursor* wlr_cursor;
@@ -32,6 +44,7 @@ struct bsi_server
     struct wlr_layer_shell_v1* wlr_layer_shell;
     struct wlr_xdg_activation_v1* wlr_xdg_activation;
     struct wlr_output_manager_v1* wlr_output_manager;
+    struct wlr_output_power_manager_v1* wlr_output_power_manager;
     struct wlr_xcursor_manager* wlr_xcursor_manager;
     struct wlr_xdg_decoration_manager_v1* wlr_xdg_decoration_manager;
     struct wlr_idle_inhibit_manager_v1* wlr_idle_inhibit_manager;
@@ -43,11 +56,15 @@ struct bsi_server
         /* wlr_backend */
         struct wl_listener new_output;
         struct wl_listener new_input;
+        /* wlr_compositor */
+        struct wl_listener compositor_new_surface;
         /* wlr_output_layout */
         struct wl_listener output_layout_change;
         /* wlr_output_manager_v1 */
         struct wl_listener output_manager_apply;
         struct wl_listener output_manager_test;
+        /* wlr_output_power_manager_v1 */
+        struct wl_listener output_power_set_mode;
         /* wlr_seat */
         struct wl_listener pointer_grab_begin;
         struct wl_listener pointer_grab_end;
@@ -66,8 +83,6 @@ struct bsi_server
         struct wl_listener request_activate;
         /* wlr_idle_inhibit_manager_v1 */
         struct wl_listener new_inhibitor;
-        /* wlr_idle */
-        struct wl_listener activity_notify;
         /* wlr_session_lock_manager_v1 */
         struct wl_listener new_lock;
         /* bsi_workspace */
@@ -82,14 +97,71 @@ struct bsi_server
         struct wl_list outputs;
     } output;
 
+    /* Frame callbacks of views that can't be seen, at a low fixed rate. */
+    struct
+    {
+        uint32_t throttle_hz; /* Config `frame throttle_hidden <hz>` */
+        struct wl_event_source* throttle_timer;
+        /* Config `frame schedule <off|adaptive|fixed <ms>>` */
+        enum bsi_output_schedule schedule;
+        uint64_t schedule_delay_usec; /* Delay of the fixed schedule. */
+    } frame;
+
+    /* Per output frame timing, dumped to the log on SIGUSR1. */
+    struct
+    {
+        bool enabled; /* Config `frame stats <yes|no>` */
+        struct wl_event_source* dump_signal;
+    } stats;
+
+    /* Debug drawing of the compositor, above everything else. */
+    struct
+    {
+        struct wlr_scene_tree* tree;
+        bool damage; /* Config `frame show_damage <yes|no>` */
+
+        /* Samples the per output HUDs share, from the last period. */
+        struct
+        {
+            bool enabled; /* Config `frame hud <yes|no>` */
+            struct wl_event_source* timer;
+            uint64_t sampled_usec;
+            size_t input_events;
+            struct bsi_view* focused; /* Only compared, never dereferenced. */
+            uint32_t focused_seq;     /* Commit sequence of its surface. */
+        } hud;
+    } overlay;
+
     struct
     {
         struct wl_list inputs;
+        size_t events; /* Pointer, gesture and key events. */
+        struct wl_list keymaps;         // bsi_input_keymap::link
+        struct wl_list keyboard_groups; // bsi_input_keyboard_group::link
+        size_t keymap_hits, keymap_compiles;
+        struct bsi_keybinds keybinds; /* Config `bind <mods+key> <action>` */
     } input;
 
     struct
     {
         struct wl_list inhibitors;
+        bool inhibited;
+
+        /* Input only stamps the time, timers look at it when they fire. */
+        uint64_t activity_msec;
+        uint32_t granularity_msec; /* Config `idle granularity <ms>` */
+        uint64_t reset_msec;       /* Legacy timers were last reset then. */
+        uint64_t reset_interval_msec;
+        size_t idled; /* ext-idle-notify notifications that are idle. */
+        struct bsi_idle_notifier* notifier;
+        size_t activity, resets;
+
+        /* Outputs are turned off after this much inactivity, and back on by
+         * the next input. */
+        uint32_t power_off_sec; /* Config `idle power-off <s>`, 0 never. */
+        struct wl_event_source* power_timer; /* NULL if they never are. */
+        bool powered_off;
+        size_t power_offs;
     } idle;
 
     struct
@@ -97,11 +169,15 @@ struct bsi_server
         bool locked;
         bool shutting_down;
         struct bsi_session_lock* lock;
+        /* Covers the outputs after a lock client died while locked. */
+        struct wlr_scene_tree* blank;
     } session;
 
     struct
     {
         struct bsi_config* config;
+        /* Reloads the config file on change, NULL if there is none. */
+        struct bsi_config_watch* watch;
         char* wallpaper;
         size_t workspaces;
         struct wl_list input;
@@ -110,9 +186,18 @@ struct bsi_server
     struct bsi_workspace* active_workspace;
     struct
     {
+        uint32_t serial; /* Bumped on every hit-test relevant scene change. */
         struct wl_list views;
         struct wl_list views_fullscreen;
         struct wl_list xdg_decorations;
+
+        struct
+        {
+            struct bsi_transaction* open;
+            size_t depth;         /* Nesting of transaction_begin. */
+            struct wl_list running; // bsi_transaction::link_server
+            size_t committed, timed_out;
+        } transaction;
     } scene;
 
     struct
@@ -127,6 +212,29 @@ struct bsi_server
         struct wlr_box grab_box;
         double grab_sx, grab_sy;
         double swipe_dx, swipe_dy;
+
+        /* The last surface found under the cursor, and the layout region where
+         * that still holds. */
+        struct
+        {
+            uint32_t serial; /* bsi_server::scene::serial */
+            struct wlr_scene_surface* scene_surface;
+            void* data;
+            int32_t lx, ly; /* Layout coordinates of the surface. */
+            pixman_region32_t region;
+            size_t hits, misses;
+            struct wl_listener destroy; /* wlr_scene_node of scene_surface */
+        } hit;
+
+        /* Relative and absolute motion waiting for the next output frame. */
+        struct
+        {
+            bool coalesce; /* Config `cursor coalesce_motion <yes|no>` */
+            bool pending;
+            uint32_t time_msec;
+            double dx, dy;
+            size_t received, processed;
+        } motion;
     } cursor;
 };
 
@@ -149,6 +257,15 @@ server_run(struct bsi_server* server);
 void
 server_destroy(struct bsi_server* server);
 
+/**
+ * @brief Starts, rearms or stops the timer that sends hidden views their frame
+ * callbacks, after `frame throttle_hidden` changed.
+ *
+ * @param server The server.
+ */
+void
+server_frame_throttle_update(struct bsi_server* server);
+
 /* Outputs */
 void
 outputs_add(struct bsi_server* server, struct bsi_output* output);
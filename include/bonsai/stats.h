@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct bsi_output;
+
+/* Histogram buckets are log-linear: each power of two is split into
+ * 2^BSI_HISTOGRAM_SUB_BITS buckets, so any recorded value is within ~3% of its
+ * bucket. Values are microseconds, anything past BSI_HISTOGRAM_MAX_BITS lands
+ * in the last bucket. */
+#define BSI_HISTOGRAM_SUB_BITS 5
+#define BSI_HISTOGRAM_MAX_BITS 28
+#define BSI_HISTOGRAM_BUCKETS                                                  \
+    ((BSI_HISTOGRAM_MAX_BITS - BSI_HISTOGRAM_SUB_BITS + 1)                     \
+     << BSI_HISTOGRAM_SUB_BITS)
+
+struct bsi_histogram
+{
+    uint64_t count;
+    uint64_t min, max, sum;
+    uint32_t buckets[BSI_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * @brief Frame timing of an output, only allocated while stats are enabled.
+ *
+ */
+struct bsi_output_stats
+{
+    struct bsi_histogram commit;   /* Scene commit duration. */
+    struct bsi_histogram cpu;      /* CPU time spent on the frame. */
+    struct bsi_histogram interval; /* Time between consecutive frames. */
+    struct bsi_histogram delay;    /* Frame event to composition, the latency
+                                      the schedule saves. */
+    uint64_t frames;               /* Frame events. */
+    uint64_t skipped;              /* Frames with no damage to commit. */
+    uint64_t missed;               /* Frames that came a vblank late. */
+    uint64_t last_frame_usec;
+    bool last_committed; /* The previous frame committed a buffer. */
+};
+
+/**
+ * @brief Returns the monotonic clock in microseconds.
+ *
+ * @return uint64_t The time.
+ */
+uint64_t
+stats_now_usec(void);
+
+/**
+ * @brief Returns the CPU time of the calling thread in microseconds.
+ *
+ * @return uint64_t The time.
+ */
+uint64_t
+stats_cpu_usec(void);
+
+void
+histogram_record(struct bsi_histogram* histogram, uint64_t value);
+
+/**
+ * @brief Adds the recorded values of one histogram to another.
+ *
+ * @param dst The histogram to add to.
+ * @param src The histogram to add.
+ */
+void
+histogram_merge(struct bsi_histogram* dst, const struct bsi_histogram* src);
+
+/**
+ * @brief Returns the value below which the given fraction of the recorded
+ * values fall, rounded up to the end of its bucket.
+ *
+ * @param histogram The histogram.
+ * @param quantile The fraction, between 0 and 1.
+ * @return uint64_t The value.
+ */
+uint64_t
+histogram_quantile(const struct bsi_histogram* histogram, double quantile);
+
+struct bsi_output_stats*
+output_stats_init(struct bsi_output_stats* stats);
+
+/**
+ * @brief Records a frame of the output, call this after the scene commit.
+ *
+ * @param stats The stats of the output.
+ * @param refresh The output refresh rate in mHz, 0 if unknown.
+ * @param frame_usec When the frame event came in.
+ * @param begin_usec When composition started.
+ * @param end_usec When the commit returned.
+ * @param cpu_usec CPU time the frame took.
+ * @param committed Whether the commit had damage to present.
+ */
+void
+output_stats_frame(struct bsi_output_stats* stats,
+                   int32_t refresh,
+                   uint64_t frame_usec,
+                   uint64_t begin_usec,
+                   uint64_t end_usec,
+                   uint64_t cpu_usec,
+                   bool committed);
+
+/**
+ * @brief Logs a summary of the frame timing of the output.
+ *
+ * @param output The output.
+ */
+void
+output_stats_dump(struct bsi_output* output);
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+
+#include "bonsai/launcher.h"
+
+struct bsi_server;
+
+/* A crashed helper waits this long before the first restart, twice as long
+ * after every further crash, up to the max. */
+#define BSI_SUPERVISOR_BACKOFF_MIN_MSEC 500
+#define BSI_SUPERVISOR_BACKOFF_MAX_MSEC 60000
+/* A helper that ran this long before crashing starts over at the min. */
+#define BSI_SUPERVISOR_STABLE_MSEC 30000
+/* CPU time and memory of the helpers are read from /proc this often. */
+#define BSI_SUPERVISOR_SAMPLE_MSEC 5000
+/* A helper that used more of one CPU than this in a sample gets logged. */
+#define BSI_SUPERVISOR_CPU_WARN_PERCENT 50.0
+
+enum bsi_supervised_state
+{
+    BSI_SUPERVISED_STARTING,
+    BSI_SUPERVISED_RUNNING,
+    BSI_SUPERVISED_BACKOFF, /* Crashed, restarts when the timer fires. */
+    BSI_SUPERVISED_STOPPED, /* Exited cleanly, or can't be watched. */
+};
+
+/**
+ * @brief An external helper, such as the bar or the wallpaper, that is kept
+ * running.
+ *
+ */
+struct bsi_supervised
+{
+    struct bsi_supervisor* supervisor;
+    struct bsi_launcher_watch watch;
+    char** argp; /* Owned, NULL terminated. */
+    size_t len_argp;
+
+    enum bsi_supervised_state state;
+    pid_t pid; /* -1 unless running. */
+    uint64_t started_usec;
+    int last_status; /* waitpid(2) status, -1 if it never started. */
+    uint32_t restarts;
+    uint32_t backoff_msec; /* Wait before the next restart. */
+    struct wl_event_source* restart_timer;
+
+    uint64_t cpu_usec;       /* User and system time of this run. */
+    uint64_t cpu_total_usec; /* Of the runs before this one. */
+    double cpu_percent;      /* Of one CPU, over the last sample. */
+    long rss_kb;             /* -1 until sampled. */
+
+    struct wl_list link; // bsi_supervisor::supervised
+};
+
+/**
+ * @brief Restarts helpers that crash, with exponential backoff, and keeps
+ * track of the CPU time and memory they use.
+ *
+ */
+struct bsi_supervisor
+{
+    struct bsi_server* server;
+    struct wl_list supervised; // bsi_supervised::link
+    struct wl_event_source* sample_timer;
+    uint64_t sampled_usec;
+};
+
+/**
+ * @brief Creates the supervisor.
+ *
+ * @param server The server.
+ * @return struct bsi_supervisor* The supervisor.
+ */
+struct bsi_supervisor*
+supervisor_create(struct bsi_server* server);
+
+/**
+ * @brief Destroys the supervisor. The helpers keep running.
+ *
+ * @param supervisor The supervisor.
+ */
+void
+supervisor_destroy(struct bsi_supervisor* supervisor);
+
+/**
+ * @brief Starts a helper and keeps it running.
+ *
+ * @param supervisor The supervisor.
+ * @param argp The execve call argp, **with executable name only**.
+ * @param len_argp The argp len.
+ * @return true The helper is being started.
+ * @return false The executable wasn't found.
+ */
+bool
+supervisor_add(struct bsi_supervisor* supervisor,
+               char* const* argp,
+               const size_t len_argp);
+
+/**
+ * @brief The CPU use of all running helpers over the last sample.
+ *
+ * @param supervisor The supervisor.
+ * @return double Percent of one CPU.
+ */
+double
+supervisor_cpu_percent(struct bsi_supervisor* supervisor);
+
+/**
+ * @brief Logs the restarts, CPU time and memory of every helper.
+ *
+ * @param supervisor The supervisor.
+ */
+void
+supervisor_stats_dump(struct bsi_supervisor* supervisor);
@@ -1,11 +1,19 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 #include <wayland-server-core.h>
 
+struct bsi_launcher;
 struct bsi_server;
 
+/**
+ * @brief Returns the monotonic clock, the clock presentation feedback and frame
+ * callbacks are timed with.
+ *
+ * @return struct timespec The time.
+ */
 struct timespec
 util_timespec_get();
 
@@ -17,24 +25,40 @@ util_slot_connect(struct wl_signal* signal_memb,
 void
 util_slot_disconnect(struct wl_listener* listener_memb);
 
+/**
+ * @brief Finds an executable in `/usr/bin` or `/usr/local/bin`.
+ *
+ * @param name The executable name.
+ * @param path Filled with the executable path.
+ * @param len_path The size of `path`.
+ * @return true The executable was found.
+ * @return false It wasn't.
+ */
+bool
+util_findexec(const char* name, char* path, const size_t len_path);
+
 /**
  * @brief Sets the proper environment and executes an execve call with the
  * specified argp. Takes into account different possible binary locations. As of
- * now, it searches `/usr/bin` and `/usr/local/bin`.
+ * now, it searches `/usr/bin` and `/usr/local/bin`. The launcher helper starts
+ * the program, if there is one.
  *
+ * @param launcher The launcher, can be NULL.
  * @param argp The execve call argp, **with executable name only**.
  * @param len_argp The argp len.
  * @return true Exec was successful.
  * @return false Exec was unsuccessful.
  */
 bool
-util_tryexec(char* const* argp, const size_t len_argp);
+util_tryexec(struct bsi_launcher* launcher,
+             char* const* argp,
+             const size_t len_argp);
 
 /**
  * @brief Sets the proper environment and executes an execve call with the
- * specified argp. Always prefer using the `bsi_util_tryexec(...)`. Only use
- * this if you know the executable will be installed in the same location on all
- * machines.
+ * specified argp. Always prefer using the `util_tryexec(...)`, this forks the
+ * compositor itself and never reaps the child. Only use this if you know the
+ * executable will be installed in the same location on all machines.
  *
  * @param argp The execve call argp.
  * @param len_argp The argp len.
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+
+/* Blocking work is handed to this many threads. */
+#define BSI_WORKERS_THREADS 2
+
+/**
+ * @brief A unit of blocking work. `work` runs on a worker thread and must not
+ * touch compositor state, `done` runs on the event loop afterwards.
+ *
+ */
+struct bsi_worker_job
+{
+    void (*work)(void* data);
+    /* `ran` is false if the pool went away before the job got its turn. */
+    void (*done)(void* data, bool ran);
+    void* data;
+
+    struct wl_list link; // bsi_workers::queued or bsi_workers::finished
+};
+
+/**
+ * @brief A small pool of threads for blocking work, such as compiling keymaps,
+ * file I/O or drawing with cairo. Finished jobs are handed back to the event
+ * loop through an eventfd.
+ *
+ */
+struct bsi_workers
+{
+    pthread_t threads[BSI_WORKERS_THREADS];
+    size_t len_threads;
+
+    pthread_mutex_t lock; /* Guards everything below. */
+    pthread_cond_t cond;  /* Signaled when a job is queued or on stop. */
+    bool stopping;
+    struct wl_list queued;   // bsi_worker_job::link
+    struct wl_list finished; // bsi_worker_job::link
+
+    int event_fd;
+    struct wl_event_source* event_source;
+
+    uint64_t jobs;      /* Jobs that ran. */
+    uint64_t work_usec; /* Time spent in them, off the event loop. */
+    uint64_t max_usec;  /* The longest one. */
+};
+
+/**
+ * @brief Starts the worker threads.
+ *
+ * @param loop The event loop jobs complete on.
+ * @return struct bsi_workers* The pool, NULL on failure.
+ */
+struct bsi_workers*
+workers_create(struct wl_event_loop* loop);
+
+/**
+ * @brief Stops the worker threads. Jobs that didn't run yet are completed
+ * with `ran` unset.
+ *
+ * @param workers The pool.
+ */
+void
+workers_destroy(struct bsi_workers* workers);
+
+/**
+ * @brief Queues some work. If the pool couldn't be created, the work runs
+ * right away on the calling thread, and `done` before this returns.
+ *
+ * @param workers The pool, can be NULL.
+ * @param work Runs on a worker thread.
+ * @param done Runs on the event loop once `work` returned.
+ * @param data Passed to both.
+ */
+void
+workers_submit(struct bsi_workers* workers,
+               void (*work)(void* data),
+               void (*done)(void* data, bool ran),
+               void* data);
+
+/**
+ * @brief Logs how much work the pool took off the event loop.
+ *
+ * @param workers The pool.
+ */
+void
+workers_stats_dump(struct bsi_workers* workers);